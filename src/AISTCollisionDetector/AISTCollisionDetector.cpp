@@ -3,10 +3,12 @@
 #include <cnoid/IdPair>
 #include <cnoid/SceneDrawables>
 #include <cnoid/MeshExtractor>
-#include <cnoid/ThreadPool>
+#include <cnoid/TaskScheduler>
+#include <cnoid/BoundingBox>
 #include <algorithm>
 #include <random>
 #include <set>
+#include <unordered_map>
 
 using namespace std;
 using namespace cnoid;
@@ -15,6 +17,26 @@ namespace {
 
 const bool ENABLE_SHUFFLE = false;
 
+/**
+   Margin added to the world bounding boxes used in the broad phase.
+   The narrow phase uses single precision transforms, so the boxes are slightly
+   enlarged to make sure that the broad phase never culls a colliding pair.
+*/
+constexpr double BoundingBoxMargin = 1.0e-4;
+
+/**
+   The sweep axis is switched only when the variance of the box centers along another axis
+   exceeds that of the current axis by this ratio so that the axis does not flip frequently.
+*/
+constexpr double SweepAxisSwitchRatio = 2.0;
+
+/**
+   The model pairs of the broad phase which have not been the candidates for this number of
+   detections are removed. The removal is done when the number of the pairs has doubled.
+*/
+constexpr unsigned int MaxNumIdleBroadPhaseDetections = 100;
+constexpr size_t MinNumBroadPhasePairsToEvict = 1024;
+
 typedef CollisionDetector::GeometryHandle GeometryHandle;
 
 CollisionDetector* factory()
@@ -39,10 +61,45 @@ public:
     int groupId;
     bool isEnabled;
     bool isStatic;
+    int index;
     stdx::optional<Isometry3> localPosition;
     ColdetModelExPtr sibling;
+
+    // Bounding boxes for the broad phase
+    BoundingBox localBoundingBox;
+    Vector3 bbMin;
+    Vector3 bbMax;
+
+    // Incremented when the position is changed
+    unsigned int positionVersion;
+    Isometry3 lastPosition;
     
-    ColdetModelEx() : groupId(0), isEnabled(true), isStatic(false) { }
+    ColdetModelEx() : groupId(0), isEnabled(true), isStatic(false), index(0), positionVersion(0) { }
+
+    void setPositionWithBoundingBox(const Isometry3& T){
+        setPosition(T);
+        if(localBoundingBox.empty()){
+            bbMin.setZero();
+            bbMax.setZero();
+        } else {
+            const Vector3 c = T * localBoundingBox.center();
+            const Vector3 e =
+                T.linear().cwiseAbs() * (0.5 * localBoundingBox.size()) + Vector3::Constant(BoundingBoxMargin);
+            bbMin = c - e;
+            bbMax = c + e;
+        }
+    }
+
+    void expandBoundingBox(const ColdetModelEx* other){
+        bbMin = bbMin.cwiseMin(other->bbMin);
+        bbMax = bbMax.cwiseMax(other->bbMax);
+    }
+
+    bool checkBoundingBoxOverlap(const ColdetModelEx* other) const {
+        return (bbMin.x() <= other->bbMax.x() && other->bbMin.x() <= bbMax.x() &&
+                bbMin.y() <= other->bbMax.y() && other->bbMin.y() <= bbMax.y() &&
+                bbMin.z() <= other->bbMax.z() && other->bbMin.z() <= bbMax.z());
+    }
 };
 
 class ColdetModelPairEx;
@@ -81,6 +138,22 @@ public:
     }
 
     ColdetModelPairExPtr sibling;
+
+    // The result of the last detection, which is reused while the models do not move
+    CollisionPair cachedCollisionPair;
+    unsigned int cachedPositionVersions[2];
+    unsigned int cachedStateVersion;
+    bool hasCachedCollisionPair = false;
+
+    // The broad phase detection count when the pair was a candidate last time
+    unsigned int lastCandidateDetectionCount = 0;
+
+    bool checkIfCachedCollisionPairValid(unsigned int stateVersion) {
+        return hasCachedCollisionPair &&
+            cachedPositionVersions[0] == model(0)->positionVersion &&
+            cachedPositionVersions[1] == model(1)->positionVersion &&
+            cachedStateVersion == stateVersion;
+    }
 };
 
 
@@ -129,6 +202,7 @@ class AISTCollisionDetector::Impl
 public:
     vector<ColdetModelExPtr> models;
     vector<ColdetModelPairExPtr> modelPairs;
+    vector<ColdetModelPairEx*> activePairs;
     int maxNumThreads;
     set<IdPair<GeometryHandle>> ignoredPairs;
     set<IdPair<int>> ignoredGroupPairs;
@@ -136,6 +210,11 @@ public:
     bool isReady;
     bool isDynamicGeometryPairChangeEnabled;
     CollisionPair collisionPair;
+
+    // for the incremental detection
+    bool isIncrementalDetectionEnabled;
+    // Incremented when the enabled states of the geometries or geometry pairs are changed
+    unsigned int stateVersion;
         
     Impl();
     Impl(const AISTCollisionDetector::Impl& org);
@@ -145,21 +224,37 @@ public:
     void addMesh(ColdetModelEx* model);
     void makeReady();
     bool checkIfGroupPairEnabled(int groupId1, int groupId2);
+    bool checkIfModelPairEnabled(ColdetModelEx* model0, ColdetModelEx* model1);
     bool checkIfModelPairEnabled(ColdetModelPairEx* modelPair);
+    void updatePosition(ColdetModelEx* model, const Isometry3& position);
     void detectCollisions(GeometryHandle geometry, const std::function<void(const CollisionPair&)>& callback);
     void detectCollisions(const std::function<void(const CollisionPair&)>& callback);
     void detectCollisionsInParallel(const std::function<void(const CollisionPair&)>& callback);
+    const CollisionPair& detectCollisionsOfModelPair(ColdetModelPairEx* modelPair, bool doReserve);
 
     // for multithread version
     int numThreads;
-    unique_ptr<ThreadPool> threadPool;
     vector<int> shuffledPairIndices;
-    vector<vector<CollisionPair>> collisionPairArrays;
+    vector<vector<ColdetModelPairEx*>> collidingPairArrays;
     mt19937 randomEngine;
     
     void extractCollisionsOfAssignedPairs(
-        int pairIndexBegin, int pairIndexEnd, vector<CollisionPair>& collisionPairs);    
+        int pairIndexBegin, int pairIndexEnd, vector<ColdetModelPairEx*>& collidingPairs);
     void dispatchCollisionsInCollisionPairArrays(std::function<void(const CollisionPair&)> callback);    
+
+    // for the broad phase
+    bool isBroadPhaseEnabled;
+    int sweepAxis;
+    bool isSweepListSorted;
+    vector<ColdetModelEx*> sweepList;
+    unordered_map<IdPair<ColdetModelEx*>, ColdetModelPairExPtr> broadPhasePairMap;
+    unsigned int broadPhaseDetectionCount;
+    size_t numBroadPhasePairsToEvict;
+
+    void updateBroadPhaseCandidatePairs();
+    ColdetModelPairEx* findOrCreateModelPair(ColdetModelEx* model0, ColdetModelEx* model1);
+    void evictIdleBroadPhasePairs();
+    void removeModelFromBroadPhase(ColdetModelEx* model);
 };
 
 }
@@ -175,6 +270,8 @@ AISTCollisionDetector::Impl::Impl()
 {
     isDynamicGeometryPairChangeEnabled = false;
     maxNumThreads = 0;
+    isBroadPhaseEnabled = true;
+    isIncrementalDetectionEnabled = true;
 
     initialize();
 }
@@ -190,6 +287,8 @@ AISTCollisionDetector::Impl::Impl(const AISTCollisionDetector::Impl& org)
 {
     isDynamicGeometryPairChangeEnabled = org.isDynamicGeometryPairChangeEnabled;
     maxNumThreads = org.maxNumThreads;
+    isBroadPhaseEnabled = org.isBroadPhaseEnabled;
+    isIncrementalDetectionEnabled = org.isIncrementalDetectionEnabled;
 
     initialize();
 }
@@ -199,6 +298,11 @@ void AISTCollisionDetector::Impl::initialize()
 {
     isReady = false;
     numThreads = 0;
+    sweepAxis = 0;
+    isSweepListSorted = false;
+    broadPhaseDetectionCount = 0;
+    numBroadPhasePairsToEvict = MinNumBroadPhasePairsToEvict;
+    stateVersion = 0;
     meshExtractor = new MeshExtractor;
 
     if(ENABLE_SHUFFLE){
@@ -238,11 +342,53 @@ void AISTCollisionDetector::setNumThreads(int n)
     impl->maxNumThreads = n;
 }
 
+
+/**
+   When the broad phase is enabled, the world bounding boxes of the geometries are
+   sorted and swept to extract the candidate pairs whose boxes overlap, and only those
+   pairs are passed to the narrow phase. Otherwise all the geometry pairs are tested
+   by the narrow phase in every detection. The broad phase is enabled by default.
+*/
+void AISTCollisionDetector::setBroadPhaseEnabled(bool on)
+{
+    if(on != impl->isBroadPhaseEnabled){
+        impl->isBroadPhaseEnabled = on;
+        impl->isReady = false;
+    }
+}
+
+
+bool AISTCollisionDetector::isBroadPhaseEnabled() const
+{
+    return impl->isBroadPhaseEnabled;
+}
+
+
+/**
+   When the incremental detection is enabled, the collisions of a geometry pair detected
+   in the last detection are reused as they are if neither of the geometries has moved
+   since then. The incremental detection is enabled by default.
+*/
+void AISTCollisionDetector::setIncrementalDetectionEnabled(bool on)
+{
+    impl->isIncrementalDetectionEnabled = on;
+    ++impl->stateVersion;
+}
+
+
+bool AISTCollisionDetector::isIncrementalDetectionEnabled() const
+{
+    return impl->isIncrementalDetectionEnabled;
+}
+
         
 void AISTCollisionDetector::clearGeometries()
 {
     impl->models.clear();
     impl->modelPairs.clear();
+    impl->activePairs.clear();
+    impl->sweepList.clear();
+    impl->broadPhasePairMap.clear();
     impl->ignoredPairs.clear();
     impl->ignoredGroupPairs.clear();
     impl->isReady = false;
@@ -269,6 +415,7 @@ stdx::optional<GeometryHandle> AISTCollisionDetector::Impl::addGeometry(SgNode*
             model->setName(geometry->name());
             model->build();
             if(model->isValid()){
+                model->setPositionWithBoundingBox(Isometry3::Identity());
                 models.push_back(model);
                 isReady = false;
                 return getHandle(model);
@@ -291,6 +438,7 @@ void AISTCollisionDetector::Impl::addMesh(ColdetModelEx* model)
     for(int i=0; i < numVertices; ++i){
         const Vector3 v = T * vertices[i].cast<Affine3::Scalar>();
         model->addVertex(v.x(), v.y(), v.z());
+        model->localBoundingBox.expandBy(v);
     }
 
     const int numTriangles = mesh->numTriangles();
@@ -320,6 +468,7 @@ void AISTCollisionDetector::setGeometryStatic(GeometryHandle geometry, bool isSt
 void AISTCollisionDetector::setGroup(GeometryHandle geometry, int groupId)
 {
     getColdetModel(geometry)->groupId = groupId;
+    ++impl->stateVersion;
 }
 
 
@@ -330,6 +479,7 @@ void AISTCollisionDetector::setGroupPairEnabled(int groupId1, int groupId2, bool
     } else {
         impl->ignoredGroupPairs.insert(IdPair<int>(groupId1, groupId2));
     }
+    ++impl->stateVersion;
 }
 
 
@@ -340,12 +490,14 @@ void AISTCollisionDetector::ignoreGeometryPair(GeometryHandle geometry1, Geometr
         auto result = impl->ignoredPairs.insert(idPair);
         if(result.second){
             impl->isReady = false;
+            ++impl->stateVersion;
         }
     } else {
         auto p = impl->ignoredPairs.find(idPair);
         if(p != impl->ignoredPairs.end()){
             impl->ignoredPairs.erase(p);
             impl->isReady = false;
+            ++impl->stateVersion;
         }
     }
 }
@@ -353,7 +505,11 @@ void AISTCollisionDetector::ignoreGeometryPair(GeometryHandle geometry1, Geometr
 
 void AISTCollisionDetector::setGeometryEnabled(GeometryHandle geometry, bool isEnabled)
 {
-    getColdetModel(geometry)->isEnabled = isEnabled;
+    auto model = getColdetModel(geometry);
+    if(isEnabled != model->isEnabled){
+        model->isEnabled = isEnabled;
+        ++impl->stateVersion;
+    }
 }
 
 
@@ -397,6 +553,8 @@ bool AISTCollisionDetector::removeGeometry(GeometryHandle geometry)
                 ++pi;
             }
         }
+        impl->activePairs.assign(impl->modelPairs.begin(), impl->modelPairs.end());
+        impl->removeModelFromBroadPhase(model);
         auto ii = impl->ignoredPairs.begin();
         while(ii != impl->ignoredPairs.end()){
             auto& idPair = *ii;
@@ -428,44 +586,51 @@ bool AISTCollisionDetector::makeReady()
 void AISTCollisionDetector::Impl::makeReady()
 {
     modelPairs.clear();
+    activePairs.clear();
+    sweepList.clear();
+    isSweepListSorted = false;
+    broadPhasePairMap.clear();
+    numBroadPhasePairsToEvict = MinNumBroadPhasePairsToEvict;
+    
     const int n = models.size();
     for(int i=0; i < n; ++i){
-        ColdetModelEx* model0 = models[i];
-        for(int j = i + 1; j < n; ++j){
-            ColdetModelEx* model1 = models[j];
-            if(!model0->isStatic || !model1->isStatic){
-                bool doRegisterPair = isDynamicGeometryPairChangeEnabled;
-                if(!doRegisterPair){
-                    if(checkIfGroupPairEnabled(model0->groupId, model1->groupId)){
-                        IdPair<GeometryHandle> handlePair(getHandle(model0), getHandle(model1));
-                        if(ignoredPairs.find(handlePair) == ignoredPairs.end()){
-                            doRegisterPair = true;
-                        }
+        models[i]->index = i;
+    }
+
+    if(isBroadPhaseEnabled){
+        // The model pairs are created on demand by the broad phase
+        sweepList.reserve(n);
+        for(auto& model : models){
+            sweepList.push_back(model);
+        }
+    } else {
+        for(int i=0; i < n; ++i){
+            ColdetModelEx* model0 = models[i];
+            for(int j = i + 1; j < n; ++j){
+                ColdetModelEx* model1 = models[j];
+                if(!model0->isStatic || !model1->isStatic){
+                    bool doRegisterPair = isDynamicGeometryPairChangeEnabled;
+                    if(!doRegisterPair){
+                        doRegisterPair = checkIfModelPairEnabled(model0, model1);
+                    }
+                    if(doRegisterPair){
+                        modelPairs.push_back(new ColdetModelPairEx(model0, model1));
                     }
-                }
-                if(doRegisterPair){
-                    modelPairs.push_back(new ColdetModelPairEx(model0, model1));
                 }
             }
         }
     }
 
-    const int numPairs = modelPairs.size();
+    activePairs.assign(modelPairs.begin(), modelPairs.end());
+    
+    // The number of the broad phase candidate pairs is not known here
+    const int numPairs = isBroadPhaseEnabled ? maxNumThreads : modelPairs.size();
 
     if(maxNumThreads <= 0){
         numThreads = 0;
-        threadPool.reset();
-        collisionPairArrays.clear();
+        collidingPairArrays.clear();
     } else {
         numThreads = (maxNumThreads > numPairs) ? numPairs : maxNumThreads;
-        threadPool.reset(new ThreadPool(numThreads));
-        if(ENABLE_SHUFFLE){
-            shuffledPairIndices.resize(modelPairs.size());
-            for(size_t i=0; i < shuffledPairIndices.size(); ++i){
-                shuffledPairIndices[i] = i;
-            }
-        }
-        collisionPairArrays.resize(numThreads);
     }
 
     isReady = true;
@@ -478,13 +643,8 @@ bool AISTCollisionDetector::Impl::checkIfGroupPairEnabled(int groupId1, int grou
 }
 
 
-/**
-   This is only used when the dynamic geometry pair change is enabled.
-*/
-bool AISTCollisionDetector::Impl::checkIfModelPairEnabled(ColdetModelPairEx* modelPair)
+bool AISTCollisionDetector::Impl::checkIfModelPairEnabled(ColdetModelEx* model0, ColdetModelEx* model1)
 {
-    auto model0 = modelPair->model(0);
-    auto model1 = modelPair->model(1);
     if(checkIfGroupPairEnabled(model0->groupId, model1->groupId)){
         IdPair<GeometryHandle> handlePair(getHandle(model0), getHandle(model1));
         if(ignoredPairs.find(handlePair) == ignoredPairs.end()){
@@ -495,15 +655,39 @@ bool AISTCollisionDetector::Impl::checkIfModelPairEnabled(ColdetModelPairEx* mod
 }
 
 
+/**
+   This is only used when the dynamic geometry pair change is enabled.
+*/
+bool AISTCollisionDetector::Impl::checkIfModelPairEnabled(ColdetModelPairEx* modelPair)
+{
+    return checkIfModelPairEnabled(modelPair->model(0), modelPair->model(1));
+}
+
+
 void AISTCollisionDetector::updatePosition(GeometryHandle geometry, const Isometry3& position)
 {
-    auto model = getColdetModel(geometry);
+    impl->updatePosition(getColdetModel(geometry), position);
+}
+
+
+void AISTCollisionDetector::Impl::updatePosition(ColdetModelEx* model, const Isometry3& position)
+{
+    if(model->positionVersion > 0 && position.matrix() == model->lastPosition.matrix()){
+        return;
+    }
+    model->lastPosition = position;
+    ++model->positionVersion;
+    
+    auto head = model;
     do {
         if(model->localPosition){
             Isometry3 T = position * (*model->localPosition);
-            model->setPosition(T);
+            model->setPositionWithBoundingBox(T);
         } else {
-            model->setPosition(position);
+            model->setPositionWithBoundingBox(position);
+        }
+        if(model != head){
+            head->expandBoundingBox(model);
         }
         model = model->sibling;
     } while(model);
@@ -514,17 +698,9 @@ void AISTCollisionDetector::updatePositions
 (std::function<void(Referenced* object, Isometry3*& out_Position)> positionQuery)
 {
     for(ColdetModelEx* model : impl->models){ // Do not use auto&
-        do {
-            Isometry3* T;
-            positionQuery(model->object, T);
-            if(model->localPosition){
-                Isometry3 T2 = (*T) * (*model->localPosition);
-                model->setPosition(T2);
-            } else {
-                model->setPosition(*T);
-            }
-            model = model->sibling; // Elements in models are overridden here if auto& is used
-        } while(model);
+        Isometry3* T;
+        positionQuery(model->object, T);
+        impl->updatePosition(model, *T);
     }
 }
 
@@ -542,8 +718,19 @@ void AISTCollisionDetector::Impl::detectCollisions
 (GeometryHandle geometry, const std::function<void(const CollisionPair&)>& callback)
 {
     auto& collisions = collisionPair.collisions();
+
+    if(isBroadPhaseEnabled){
+        activePairs.clear();
+        auto target = getColdetModel(geometry);
+        for(auto& model : models){
+            if(model != target && (!model->isStatic || !target->isStatic) &&
+               model->checkBoundingBoxOverlap(target) && checkIfModelPairEnabled(model, target)){
+                activePairs.push_back(findOrCreateModelPair(model, target));
+            }
+        }
+    }
     
-    for(ColdetModelPairEx* modelPair : modelPairs){ // Do not use auto&
+    for(ColdetModelPairEx* modelPair : activePairs){ // Do not use auto&
         collisions.clear();
         do {
             auto model0 = modelPair->model(0);
@@ -572,6 +759,9 @@ void AISTCollisionDetector::detectCollisions(std::function<void(const CollisionP
     if(!impl->isReady){
         impl->makeReady();
     }
+    if(impl->isBroadPhaseEnabled){
+        impl->updateBroadPhaseCandidatePairs();
+    }
     if(impl->numThreads > 0){
         impl->detectCollisionsInParallel(callback);
     } else {
@@ -580,104 +770,247 @@ void AISTCollisionDetector::detectCollisions(std::function<void(const CollisionP
 } 
 
 
+void AISTCollisionDetector::Impl::detectCollisions(const std::function<void(const CollisionPair&)>& callback)
+{
+    for(ColdetModelPairEx* modelPair : activePairs){ // Do not use auto&
+        auto& collisionPair = detectCollisionsOfModelPair(modelPair, false);
+        if(!collisionPair.empty()){
+            callback(collisionPair);
+        }
+    }
+}
+
+
 /**
-   \todo Remeber which geometry positions are updated after the last collision detection
-   and do the actual collision detection only for the updated geometry pairs.
+   The positions of the models are versioned by updatePosition, and the collisions of a model
+   pair detected in the last detection are returned as they are if the positions of both the
+   models and the enabled states have not been changed since then.
 */
-void AISTCollisionDetector::Impl::detectCollisions(const std::function<void(const CollisionPair&)>& callback)
+const CollisionPair& AISTCollisionDetector::Impl::detectCollisionsOfModelPair
+(ColdetModelPairEx* modelPair, bool doReserve)
 {
-    auto& collisions = collisionPair.collisions();
-    
-    for(ColdetModelPairEx* modelPair : modelPairs){ // Do not use auto&
-        collisions.clear();
-        do {
-            if(modelPair->model(0)->isEnabled && modelPair->model(1)->isEnabled){
-                if(!isDynamicGeometryPairChangeEnabled || checkIfModelPairEnabled(modelPair)){
-                    if(!modelPair->detectCollisions().empty()){
-                        copyCollisionPairCollisions(modelPair, collisionPair);
-                    }
+    auto head = modelPair;
+    auto& collisionPair = head->cachedCollisionPair;
+
+    if(isIncrementalDetectionEnabled && head->checkIfCachedCollisionPairValid(stateVersion)){
+        return collisionPair;
+    }
+
+    collisionPair.collisions().clear();
+    do {
+        if(modelPair->model(0)->isEnabled && modelPair->model(1)->isEnabled){
+            if(!isDynamicGeometryPairChangeEnabled || checkIfModelPairEnabled(modelPair)){
+                if(!modelPair->detectCollisions().empty()){
+                    copyCollisionPairCollisions(modelPair, collisionPair, doReserve);
                 }
             }
-            modelPair = modelPair->sibling;  // Elements in models are overridden here if auto& is used
-        } while(modelPair);
-
-        if(!collisions.empty()){
-            callback(collisionPair);
         }
-    }
+        modelPair = modelPair->sibling;
+    } while(modelPair);
+
+    head->cachedPositionVersions[0] = head->model(0)->positionVersion;
+    head->cachedPositionVersions[1] = head->model(1)->positionVersion;
+    head->cachedStateVersion = stateVersion;
+    head->hasCachedCollisionPair = true;
+
+    return collisionPair;
 }
 
 
 void AISTCollisionDetector::Impl::detectCollisionsInParallel(const std::function<void(const CollisionPair&)>& callback)
 {
+    const int numPairs = activePairs.size();
+
     if(ENABLE_SHUFFLE){
+        shuffledPairIndices.resize(numPairs);
+        for(int i=0; i < numPairs; ++i){
+            shuffledPairIndices[i] = i;
+        }
         std::shuffle(shuffledPairIndices.begin(), shuffledPairIndices.end(), randomEngine);
     }
 
-    const int numPairs = modelPairs.size();
-    const int minSize = numPairs / numThreads;
-    int remainder = numPairs % numThreads;
-    int index = 0;
-    for(int i=0; i < numThreads; ++i){
-        int size = minSize;
-        if(remainder > 0){
-            ++size;
-            --remainder;
-        }
-        if(size == 0){
-            break;
-        }
-        threadPool->post([this, i, index, size](){
-            extractCollisionsOfAssignedPairs(index, index + size, collisionPairArrays[i]);
-        });
-        index += size;
+    /*
+      The pairs are divided into more chunks than the threads so that the chunks are
+      balanced among the threads by the scheduler. The colliding pairs are stored for
+      each chunk to dispatch them in the order of the pairs.
+    */
+    const int maxNumChunks = std::min(numPairs, numThreads * 4);
+    if(maxNumChunks == 0){
+        return;
     }
-    threadPool->waitLoop();
-    //threadPool->wait();
+    const int chunkSize = (numPairs + maxNumChunks - 1) / maxNumChunks;
+    // The actual number of the chunks may be less than maxNumChunks
+    const int numChunks = (numPairs + chunkSize - 1) / chunkSize;
+    collidingPairArrays.resize(numChunks);
+
+    TaskScheduler::instance()->parallelFor(
+        0, numPairs, chunkSize,
+        [this, chunkSize](int begin, int end){
+            extractCollisionsOfAssignedPairs(begin, end, collidingPairArrays[begin / chunkSize]);
+        },
+        numThreads);
 
     dispatchCollisionsInCollisionPairArrays(callback);
 }
 
 
 void AISTCollisionDetector::Impl::extractCollisionsOfAssignedPairs
-(int pairIndexBegin, int pairIndexEnd, vector<CollisionPair>& collisionPairs)
+(int pairIndexBegin, int pairIndexEnd, vector<ColdetModelPairEx*>& collidingPairs)
 {
-    collisionPairs.clear();
+    collidingPairs.clear();
 
     for(int i=pairIndexBegin; i < pairIndexEnd; ++i){
         ColdetModelPairEx* modelPair;
         if(ENABLE_SHUFFLE){
-            modelPair = modelPairs[shuffledPairIndices[i]];
+            modelPair = activePairs[shuffledPairIndices[i]];
         } else {
-            modelPair = modelPairs[i];
+            modelPair = activePairs[i];
+        }
+        if(!detectCollisionsOfModelPair(modelPair, true).empty()){
+            collidingPairs.push_back(modelPair);
         }
+    }
+}
 
-        collisionPairs.push_back(CollisionPair());
-        CollisionPair& collisionPair = collisionPairs.back();
-        do {
-            if(modelPair->model(0)->isEnabled && modelPair->model(1)->isEnabled){
-                if(!isDynamicGeometryPairChangeEnabled || checkIfModelPairEnabled(modelPair)){
-                    if(!modelPair->detectCollisions().empty()){
-                        copyCollisionPairCollisions(modelPair, collisionPair, true);
-                    }
+void AISTCollisionDetector::Impl::dispatchCollisionsInCollisionPairArrays
+(std::function<void(const CollisionPair&)> callback)
+{
+    const int numChunks = collidingPairArrays.size();
+    for(int i=0; i < numChunks; ++i){
+        const vector<ColdetModelPairEx*>& collidingPairs = collidingPairArrays[i];
+        for(size_t j=0; j < collidingPairs.size(); ++j){
+            callback(collidingPairs[j]->cachedCollisionPair);
+        }
+    }
+}
+
+
+/**
+   Sort and sweep over the world bounding boxes. The insertion sort is efficient
+   because the order of the boxes changes little between successive detections.
+   The axis for the next detection is selected by the variance of the box centers,
+   and the list is sorted from scratch when the axis has been switched.
+*/
+void AISTCollisionDetector::Impl::updateBroadPhaseCandidatePairs()
+{
+    activePairs.clear();
+    ++broadPhaseDetectionCount;
+
+    const int n = sweepList.size();
+    if(!isSweepListSorted){
+        const int axis = sweepAxis;
+        std::sort(sweepList.begin(), sweepList.end(),
+                  [axis](ColdetModelEx* model1, ColdetModelEx* model2){
+                      return model1->bbMin[axis] < model2->bbMin[axis]; });
+        isSweepListSorted = true;
+    } else {
+        for(int i=1; i < n; ++i){
+            auto model = sweepList[i];
+            const double key = model->bbMin[sweepAxis];
+            int j = i - 1;
+            while(j >= 0 && sweepList[j]->bbMin[sweepAxis] > key){
+                sweepList[j + 1] = sweepList[j];
+                --j;
+            }
+            sweepList[j + 1] = model;
+        }
+    }
+
+    Vector3 sum = Vector3::Zero();
+    Vector3 sum2 = Vector3::Zero();
+    
+    for(int i=0; i < n; ++i){
+        auto model0 = sweepList[i];
+        const Vector3 c = 0.5 * (model0->bbMin + model0->bbMax);
+        sum += c;
+        sum2 += c.cwiseProduct(c);
+        if(!model0->isEnabled){
+            continue;
+        }
+        const double max0 = model0->bbMax[sweepAxis];
+        for(int j = i + 1; j < n; ++j){
+            auto model1 = sweepList[j];
+            if(model1->bbMin[sweepAxis] > max0){
+                break;
+            }
+            if(model1->isEnabled && (!model0->isStatic || !model1->isStatic)){
+                if(model0->checkBoundingBoxOverlap(model1) && checkIfModelPairEnabled(model0, model1)){
+                    activePairs.push_back(findOrCreateModelPair(model0, model1));
                 }
             }
-            modelPair = modelPair->sibling;
-        } while(modelPair);
+        }
+    }
 
-        if(collisionPair.empty()){
-            collisionPairs.pop_back();
+    if(n > 1){
+        const Vector3 variance = sum2 - sum.cwiseProduct(sum) / n;
+        int axis;
+        variance.maxCoeff(&axis);
+        if(axis != sweepAxis && variance[axis] > SweepAxisSwitchRatio * variance[sweepAxis]){
+            sweepAxis = axis;
+            isSweepListSorted = false;
         }
     }
+
+    if(broadPhasePairMap.size() >= numBroadPhasePairsToEvict){
+        evictIdleBroadPhasePairs();
+    }
+
+    // Keep the same order as the pairs enumerated without the broad phase
+    std::sort(activePairs.begin(), activePairs.end(),
+              [](ColdetModelPairEx* pair1, ColdetModelPairEx* pair2){
+                  if(pair1->model(0)->index != pair2->model(0)->index){
+                      return pair1->model(0)->index < pair2->model(0)->index;
+                  }
+                  return pair1->model(1)->index < pair2->model(1)->index;
+              });
 }
 
-void AISTCollisionDetector::Impl::dispatchCollisionsInCollisionPairArrays
-(std::function<void(const CollisionPair&)> callback)
+
+ColdetModelPairEx* AISTCollisionDetector::Impl::findOrCreateModelPair(ColdetModelEx* model0, ColdetModelEx* model1)
 {
-    for(int i=0; i < numThreads; ++i){
-        const vector<CollisionPair>& collisionPairs = collisionPairArrays[i];
-        for(size_t j=0; j < collisionPairs.size(); ++j){
-            callback(collisionPairs[j]);
+    if(model0->index > model1->index){
+        std::swap(model0, model1);
+    }
+    auto& modelPair = broadPhasePairMap[IdPair<ColdetModelEx*>(model0, model1)];
+    if(!modelPair){
+        modelPair = new ColdetModelPairEx(model0, model1);
+    }
+    modelPair->lastCandidateDetectionCount = broadPhaseDetectionCount;
+    return modelPair;
+}
+
+
+/**
+   The pairs in activePairs are never removed because they are the candidates of the current
+   detection. The threshold is updated with the remaining pairs so that the cost of the removal
+   is amortized over the detections.
+*/
+void AISTCollisionDetector::Impl::evictIdleBroadPhasePairs()
+{
+    auto p = broadPhasePairMap.begin();
+    while(p != broadPhasePairMap.end()){
+        if(broadPhaseDetectionCount - p->second->lastCandidateDetectionCount > MaxNumIdleBroadPhaseDetections){
+            p = broadPhasePairMap.erase(p);
+        } else {
+            ++p;
+        }
+    }
+    numBroadPhasePairsToEvict = std::max(MinNumBroadPhasePairsToEvict, broadPhasePairMap.size() * 2);
+}
+
+
+void AISTCollisionDetector::Impl::removeModelFromBroadPhase(ColdetModelEx* model)
+{
+    auto it = std::find(sweepList.begin(), sweepList.end(), model);
+    if(it != sweepList.end()){
+        sweepList.erase(it);
+    }
+    auto p = broadPhasePairMap.begin();
+    while(p != broadPhasePairMap.end()){
+        if(p->first.hasId(model)){
+            p = broadPhasePairMap.erase(p);
+        } else {
+            ++p;
         }
     }
 }
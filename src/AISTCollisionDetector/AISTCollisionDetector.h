@@ -40,6 +40,10 @@ public:
 
     // experimental
     void setNumThreads(int n);
+    void setBroadPhaseEnabled(bool on);
+    bool isBroadPhaseEnabled() const;
+    void setIncrementalDetectionEnabled(bool on);
+    bool isIncrementalDetectionEnabled() const;
     stdx::optional<double> detectDistanceToRayIntersection(
         GeometryHandle geometry, const Vector3& point, const Vector3& direction);
 
@@ -1,14 +1,52 @@
 #include "ColdetModel.h"
 #include "ColdetModelInternalModel.h"
 #include "Opcode/Opcode.h"
+#include <cnoid/stdx/filesystem>
 #include <map>
+#include <mutex>
+#include <fstream>
 #include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
 
 using namespace std;
 using namespace cnoid;
+namespace filesystem = stdx::filesystem;
 
 namespace {
 
+const char treeCacheFileSignature[8] = { 'C', 'N', 'O', 'I', 'D', 'C', 'D', 'T' };
+const uint32_t treeCacheFileVersion = 1;
+
+struct TreeCacheFileHeader
+{
+    char signature[8];
+    uint32_t version;
+    uint32_t nodeSize;
+    uint64_t meshHash;
+    uint32_t numVertices;
+    uint32_t numTriangles;
+    uint32_t numNodes;
+    uint32_t reserved;
+};
+
+std::mutex treeCacheDirectoryMutex;
+bool isTreeCacheDirectoryInitialized = false;
+string treeCacheDirectory_;
+
+// FNV-1a
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+    auto bytes = static_cast<const unsigned char*>(data);
+    for(size_t i=0; i < size; ++i){
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
 class Edge
 {
     int vertex[2];
@@ -98,6 +136,7 @@ ColdetModelInternalModel::ColdetModelInternalModel()
     refCounter = 0;
     pType = ColdetModel::SP_MESH;
     AABBTreeMaxDepth=0;
+    meshHash = 0;
 }    
 
 
@@ -254,8 +293,6 @@ bool ColdetModelInternalModel::build()
     
     if(triangles.size() > 0){
 
-        extractNeghiborTriangles();
-
         Opcode::OPCODECREATE OPCC;
 
         iMesh.SetPointers(&triangles[0], &vertices[0]);
@@ -267,8 +304,16 @@ bool ColdetModelInternalModel::build()
         OPCC.mNoLeaf = false;
         OPCC.mQuantized = false;
         OPCC.mKeepOriginal = false;
+
+        string cacheFilename = getTreeCacheFilename(OPCC);
+        if(cacheFilename.empty() || !loadTreeCache(cacheFilename, OPCC)){
+            extractNeghiborTriangles();
+            model.Build(OPCC);
+            if(!cacheFilename.empty() && model.GetTree()){
+                saveTreeCache(cacheFilename);
+            }
+        }
         
-        model.Build(OPCC);
         if(model.GetTree()){
             AABBTreeMaxDepth = computeDepth(((Opcode::AABBCollisionTree*)model.GetTree())->GetNodes(), 0, -1) + 1;
             for(int i=0; i<AABBTreeMaxDepth; i++)
@@ -282,6 +327,135 @@ bool ColdetModelInternalModel::build()
 }
 
 
+void ColdetModel::setTreeCacheDirectory(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(treeCacheDirectoryMutex);
+    treeCacheDirectory_ = directory;
+    isTreeCacheDirectoryInitialized = true;
+}
+
+
+std::string ColdetModel::treeCacheDirectory()
+{
+    std::lock_guard<std::mutex> lock(treeCacheDirectoryMutex);
+    if(!isTreeCacheDirectoryInitialized){
+        if(auto dir = getenv("CNOID_COLDET_TREE_CACHE_DIR")){
+            treeCacheDirectory_ = dir;
+        }
+        isTreeCacheDirectoryInitialized = true;
+    }
+    return treeCacheDirectory_;
+}
+
+
+/**
+   The cache file is identified by the hash of the mesh data and the build options.
+   An empty string is returned when the cache is disabled or not applicable.
+*/
+std::string ColdetModelInternalModel::getTreeCacheFilename(const Opcode::OPCODECREATE& create)
+{
+    // Only the normal tree is supported by the cache
+    if(create.mNoLeaf || create.mQuantized){
+        return string();
+    }
+    string directory = ColdetModel::treeCacheDirectory();
+    if(directory.empty()){
+        return string();
+    }
+    
+    uint64_t hash = 14695981039346656037ULL;
+    hash = hashBytes(&treeCacheFileVersion, sizeof(treeCacheFileVersion), hash);
+    hash = hashBytes(&create.mSettings, sizeof(create.mSettings), hash);
+    hash = hashBytes(vertices.data(), vertices.size() * sizeof(IceMaths::Point), hash);
+    hash = hashBytes(triangles.data(), triangles.size() * sizeof(IceMaths::IndexedTriangle), hash);
+    meshHash = hash;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.cdt", static_cast<unsigned long long>(hash));
+    return (filesystem::path(directory) / name).string();
+}
+
+
+bool ColdetModelInternalModel::loadTreeCache(const std::string& filename, const Opcode::OPCODECREATE& create)
+{
+    ifstream ifs(filename, ios::in | ios::binary);
+    if(!ifs){
+        return false;
+    }
+    TreeCacheFileHeader header;
+    if(!ifs.read(reinterpret_cast<char*>(&header), sizeof(header))){
+        return false;
+    }
+    if(memcmp(header.signature, treeCacheFileSignature, sizeof(treeCacheFileSignature)) != 0 ||
+       header.version != treeCacheFileVersion ||
+       header.nodeSize != sizeof(Opcode::AABBCollisionNode) ||
+       header.meshHash != meshHash ||
+       header.numVertices != vertices.size() ||
+       header.numTriangles != triangles.size()){
+        return false;
+    }
+
+    vector<Opcode::AABBCollisionNode> nodes(header.numNodes);
+    neighbors.resize(header.numTriangles);
+    if(!ifs.read(reinterpret_cast<char*>(nodes.data()), nodes.size() * sizeof(Opcode::AABBCollisionNode)) ||
+       !ifs.read(reinterpret_cast<char*>(neighbors.data()), neighbors.size() * sizeof(NeighborTriangleSet))){
+        neighbors.clear();
+        return false;
+    }
+    if(!model.Restore(create, nodes.data(), nodes.size())){
+        neighbors.clear();
+        return false;
+    }
+    return true;
+}
+
+
+void ColdetModelInternalModel::saveTreeCache(const std::string& filename)
+{
+    auto tree = static_cast<const Opcode::AABBCollisionTree*>(model.GetTree());
+    
+    TreeCacheFileHeader header;
+    memcpy(header.signature, treeCacheFileSignature, sizeof(treeCacheFileSignature));
+    header.version = treeCacheFileVersion;
+    header.nodeSize = sizeof(Opcode::AABBCollisionNode);
+    header.meshHash = meshHash;
+    header.numVertices = vertices.size();
+    header.numTriangles = triangles.size();
+    header.numNodes = tree->GetNbNodes();
+    header.reserved = 0;
+
+    vector<Opcode::AABBCollisionNode> nodes(header.numNodes);
+    tree->Export(nodes.data());
+
+    /*
+      The data is written into a temporary file which is renamed to the cache file
+      so that other processes never read an incomplete cache file.
+    */
+    stdx::error_code ec;
+    filesystem::path path(filename);
+    filesystem::create_directories(path.parent_path(), ec);
+    filesystem::path tmpPath(filename + ".tmp" + std::to_string(reinterpret_cast<uintptr_t>(this)));
+    {
+        ofstream ofs(tmpPath.string(), ios::out | ios::binary | ios::trunc);
+        if(!ofs){
+            return;
+        }
+        ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        ofs.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(Opcode::AABBCollisionNode));
+        ofs.write(reinterpret_cast<const char*>(neighbors.data()), neighbors.size() * sizeof(NeighborTriangleSet));
+        if(!ofs.flush()){
+            ofs.close();
+            filesystem::remove(tmpPath, ec);
+            return;
+        }
+    }
+    filesystem::rename(tmpPath, path, ec);
+    if(ec){
+        filesystem::remove(tmpPath, ec);
+    }
+}
+
+
 void ColdetModel::setPosition(const Isometry3& T)
 {
     transform->Set((float)T(0,0), (float)T(1,0), (float)T(2,0), 0.0f,
@@ -207,6 +207,17 @@ public:
     int getAABBmaxNum();
     int numofBBtoDepth(int minNumofBB);
 
+    /**
+     * @brief set the directory to cache the built collision trees
+     *
+     * The built tree and the neighbor triangle table of a mesh are saved into the directory,
+     * and they are loaded instead of building them when a mesh with the same data is built.
+     * The initial directory is given by the CNOID_COLDET_TREE_CACHE_DIR environment variable.
+     * An empty directory disables the cache.
+     */
+    static void setTreeCacheDirectory(const std::string& directory);
+    static std::string treeCacheDirectory();
+
 private:
     void initialize();
         
@@ -8,6 +8,8 @@
 #include "ColdetModel.h"
 #include "Opcode/Opcode.h"
 #include <vector>
+#include <string>
+#include <cstdint>
 
 namespace cnoid {
 
@@ -75,8 +77,12 @@ private:
     int AABBTreeMaxDepth;
     std::vector<int> numBBMap;
     std::vector<int> numLeafMap;
+    uint64_t meshHash;
 
     void extractNeghiborTriangles();
+    std::string getTreeCacheFilename(const Opcode::OPCODECREATE& create);
+    bool loadTreeCache(const std::string& filename, const Opcode::OPCODECREATE& create);
+    void saveTreeCache(const std::string& filename);
     int computeDepth(const Opcode::AABBCollisionNode* node, int currentDepth, int max );
 
     friend class ColdetModel;
@@ -211,6 +211,37 @@ bool Model::Build(const OPCODECREATE& create)
 
 	return true;
 }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Restores a collision model from the exported nodes without building the tree. (Added by AIST)
+ *	\param		create		[in] model creation structure
+ *	\param		nodes		[in] exported nodes
+ *	\param		nb_nodes	[in] number of nodes
+ *	\return		true if success
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool Model::Restore(const OPCODECREATE& create, const AABBCollisionNode* nodes, udword nb_nodes)
+{
+	if(!create.mIMesh || !create.mIMesh->IsValid())	return false;
+	if(create.mNoLeaf || create.mQuantized)	return false;
+
+	// The complete tree has 2*N-1 nodes
+	if(nb_nodes!=create.mIMesh->GetNbTriangles()*2-1)	return false;
+
+	Release();
+
+	SetMeshInterface(create.mIMesh);
+
+	if(!CreateTree(false, false))	return false;
+
+	if(!static_cast<AABBCollisionTree*>(mTree)->Import(nodes, nb_nodes))
+	{
+		Release();
+		return false;
+	}
+	return true;
+}
 #pragma clang diagnostic pop
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
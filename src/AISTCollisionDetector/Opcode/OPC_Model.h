@@ -36,6 +36,18 @@
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		override(BaseModel)	bool				Build(const OPCODECREATE& create);
 
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+		/**
+		 *	Restores a collision model from the nodes exported by AABBCollisionTree::Export. (Added by AIST)
+		 *	Only the normal tree, which is neither no-leaf nor quantized, is supported.
+		 *	\param		create		[in] model creation structure
+		 *	\param		nodes		[in] exported nodes
+		 *	\param		nb_nodes	[in] number of nodes
+		 *	\return		true if success
+		 */
+		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+							bool				Restore(const OPCODECREATE& create, const AABBCollisionNode* nodes, udword nb_nodes);
+
 #ifdef __MESHMERIZER_H__
 		///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 		/**
@@ -309,6 +309,64 @@ bool AABBCollisionTree::Walk(GenericWalkingCallback callback, void* user_data) c
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Copies the nodes into a buffer of GetNbNodes() nodes, replacing the links between the nodes
+ *	with the node indices so that the tree can be saved as a flat binary data. (Added by AIST)
+ *	\param		nodes		[out] destination nodes
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+void AABBCollisionTree::Export(AABBCollisionNode* nodes) const
+{
+	for(udword i=0;i<mNbNodes;i++)
+	{
+		nodes[i] = mNodes[i];
+		if(!mNodes[i].IsLeaf())
+		{
+			// Keep the leaf bit cleared
+			nodes[i].mData = EXWORD(mNodes[i].GetPos() - mNodes)<<1;
+		}
+		nodes[i].mB = (AABBCollisionNode*)EXWORD(mNodes[i].mB - mNodes);
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+/**
+ *	Restores the tree from the nodes exported by the Export function. (Added by AIST)
+ *	\param		nodes		[in] exported nodes
+ *	\param		nb_nodes	[in] number of nodes
+ *	\return		true if success
+ */
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+bool AABBCollisionTree::Import(const AABBCollisionNode* nodes, udword nb_nodes)
+{
+	if(!nodes || !nb_nodes)	return false;
+
+	if(mNbNodes!=nb_nodes)
+	{
+		mNbNodes = nb_nodes;
+		DELETEARRAY(mNodes);
+		mNodes = new AABBCollisionNode[mNbNodes];
+		CHECKALLOC(mNodes);
+	}
+
+	for(udword i=0;i<mNbNodes;i++)
+	{
+		mNodes[i] = nodes[i];
+		if(!nodes[i].IsLeaf())
+		{
+			// The negative child is implicitly next to the positive one
+			EXWORD PosID = nodes[i].mData>>1;
+			if(PosID+1>=mNbNodes)	return false;
+			mNodes[i].mData = (EXWORD)&mNodes[PosID];
+		}
+		EXWORD ParentID = (EXWORD)nodes[i].mB;
+		if(ParentID>=mNbNodes)	return false;
+		mNodes[i].mB = &mNodes[ParentID];
+	}
+	return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /**
  *	Constructor.
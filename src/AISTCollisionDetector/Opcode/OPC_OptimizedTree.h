@@ -188,6 +188,11 @@
 	class OPCODE_API AABBCollisionTree : public AABBOptimizedTree
 	{
 		IMPLEMENT_COLLISION_TREE(AABBCollisionTree, AABBCollisionNode)
+
+		// Added by AIST to save and restore the built tree
+		public:
+						void			Export(AABBCollisionNode* nodes)					const;
+						bool			Import(const AABBCollisionNode* nodes, udword nb_nodes);
 	};
 
 	class OPCODE_API AABBNoLeafTree : public AABBOptimizedTree
@@ -12,13 +12,14 @@
 #include <cnoid/SceneNodeClassRegistry>
 #include <cnoid/SceneRenderer>
 #include <cnoid/CollisionDetector>
-#include <cnoid/ThreadPool>
+#include <cnoid/TaskScheduler>
 #include <cnoid/MathUtil>
 #include <cnoid/EigenUtil>
 #include <cnoid/EigenArchive>
 #include <cnoid/Format>
 #include <cnoid/stdx/optional>
 #include <vector>
+#include <mutex>
 #include "gettext.h"
 
 using namespace std;
@@ -104,7 +105,6 @@ public:
     CollisionDetectorDistanceAPI* collisionDetectorDistanceAPI;
     typedef CollisionDetector::GeometryHandle GeometryHandle;
     vector<std::pair<GeometryHandle, GeometryHandle>> handlePairs;
-    unique_ptr<ThreadPool> threadPool;
     LazyCaller calcDistanceLater;
     double distance;
     Signal<void(bool isValid)> sigDistanceUpdated;
@@ -530,9 +530,6 @@ void DistanceMeasurementItem::Impl::initializeCollisionDetector()
             }
         }
     }
-    int numThreads = std::min(static_cast<unsigned int>(handlePairs.size()), thread::hardware_concurrency());
-    threadPool = make_unique<ThreadPool>(numThreads);
-    
     collisionDetector->makeReady();
 }
 
@@ -567,23 +564,25 @@ void DistanceMeasurementItem::Impl::calcShortestDistance()
     std::mutex distanceMutex;
     bool detected = false;
     
-    for(auto& handlePair : handlePairs){
-        threadPool->post([&](){
-            Vector3 p1, p2;
-            auto distance = collisionDetectorDistanceAPI->detectDistance(
-                handlePair.first, handlePair.second, p1, p2);
-            {
-                std::lock_guard<std::mutex> guard(distanceMutex);
-                if(distance < shortestDistance){
-                    shortestDistance = distance;
-                    p1s = p1;
-                    p2s = p2;
-                    detected = true;
+    TaskScheduler::instance()->parallelFor(
+        0, handlePairs.size(), 1,
+        [&](int begin, int end){
+            for(int i = begin; i < end; ++i){
+                auto& handlePair = handlePairs[i];
+                Vector3 p1, p2;
+                auto distance = collisionDetectorDistanceAPI->detectDistance(
+                    handlePair.first, handlePair.second, p1, p2);
+                {
+                    std::lock_guard<std::mutex> guard(distanceMutex);
+                    if(distance < shortestDistance){
+                        shortestDistance = distance;
+                        p1s = p1;
+                        p2s = p2;
+                        detected = true;
+                    }
                 }
             }
         });
-    }
-    threadPool->wait();
 
     hasValidDistance = detected;
 
@@ -8,6 +8,7 @@
 #include "Buttons.h"
 #include "CheckBox.h"
 #include "Dialog.h"
+#include <cnoid/SceneGraph>
 #include <QDialogButtonBox>
 #include <QElapsedTimer>
 #include <cmath>
@@ -862,6 +863,8 @@ bool TimeBar::Impl::setTime
     bool doExpansion = options & Expand;
     bool isWithinTimeRange = setTimeBarTime(newTime, doExpansion, calledFromPlaybackLoop, callerWidget);
     if(isWithinTimeRange || calledFromPlaybackLoop){
+        // The scene updates of all the items synchronized with the time are notified together
+        SgUpdateBatch updateBatch;
         sigTimeChanged.emitAndGetAllResults(self->time_, playbackContinueFlags);
         for(auto flag : playbackContinueFlags){
             if(flag){
@@ -217,7 +217,7 @@ void BodyMotion::updateLinkPosSeqWithBodyStateSeq()
             auto& pframe = stateSeq_->frame(i);
             auto lframe = lseq->frame(i);
             int linkIndex = 0;
-            int m = std::min(numLinks, pframe.numLinkPositions());
+            int m = pframe.empty() ? 0 : std::min(numLinks, pframe.numLinkPositions());
             while(linkIndex < m){
                 auto linkPosition = pframe.linkPosition(linkIndex);
                 lframe[linkIndex].set(linkPosition.translation(), linkPosition.rotation());
@@ -225,6 +225,7 @@ void BodyMotion::updateLinkPosSeqWithBodyStateSeq()
             }
             while(linkIndex < numLinks){
                 lframe[linkIndex].clear();
+                ++linkIndex;
             }
         }
     }
@@ -243,14 +244,17 @@ void BodyMotion::updateJointPosSeqWithBodyStateSeq()
             auto& pframe = stateSeq_->frame(i);
             int jointIndex = 0;
             auto jframe = jseq->frame(i);
-            auto displacements = pframe.jointDisplacements();
-            int m = std::min(numJoints, pframe.numJointDisplacements());
-            while(jointIndex < m){
-                jframe[jointIndex] = displacements[jointIndex];
-                ++jointIndex;
+            if(!pframe.empty()){
+                auto displacements = pframe.jointDisplacements();
+                int m = std::min(numJoints, pframe.numJointDisplacements());
+                while(jointIndex < m){
+                    jframe[jointIndex] = displacements[jointIndex];
+                    ++jointIndex;
+                }
             }
             while(jointIndex < numJoints){
                 jframe[jointIndex] = 0.0;
+                ++jointIndex;
             }
         }
     }
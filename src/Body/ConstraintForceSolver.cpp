@@ -13,8 +13,10 @@
 #include <cnoid/EigenUtil>
 #include <cnoid/CloneMap>
 #include <cnoid/TimeMeasure>
+#include <cnoid/TaskScheduler>
 #include <cnoid/Format>
 #include <cnoid/stdx/clamp>
+#include <Eigen/SparseCore>
 #include <random>
 #include <unordered_map>
 #include <limits>
@@ -56,6 +58,13 @@ static const bool ENABLE_TRUE_FRICTION_CONE =
 static const bool SKIP_REDUNDANT_ACCEL_CALC = true;
 static const bool ASSUME_SYMMETRIC_MATRIX = false;
 
+/*
+  The LCP matrix is stored as a sparse matrix whose non-zero elements are the blocks
+  of the constrained link pairs sharing a non-static sub body. The pivoting solver and
+  the symmetric matrix assumption require the dense matrix.
+*/
+static const bool USE_SPARSE_LCP_MATRIX = !usePivotingLCP && !ASSUME_SYMMETRIC_MATRIX;
+
 static const int DEFAULT_MAX_NUM_GAUSS_SEIDEL_ITERATION = 25;
 
 //static const int DEFAULT_NUM_GAUSS_SEIDEL_ITERATION_BLOCK = 10;
@@ -69,6 +78,13 @@ static const double THRESH_TO_SWITCH_REL_ERROR = 1.0e-8;
 
 static const bool USE_PREVIOUS_LCP_SOLUTION = true;
 
+/*
+  The relative velocity of the constraint points below which a constraint island
+  is regarded as being at rest. The previous solution of an island at rest is accepted
+  when one Gauss-Seidel iteration from it satisfies the error criterion.
+*/
+static const double ISLAND_REST_VELOCITY_THRESH = 1.0e-4;
+
 static const bool ENABLE_CONTACT_DEPTH_CORRECTION = true;
 
 // normal setting
@@ -188,6 +204,12 @@ public:
         vector<ConstraintPoint> constraintPoints;
         ContactMaterialExPtr contactMaterial;
         bool isNonContactConstraint;
+
+        // The solution of the previous step used as the initial value of the iterative solver
+        VectorXd prevSolution;
+        int prevSolutionStepIndex;
+
+        LinkPair() : prevSolutionStepIndex(-1) { }
     };
 
     unordered_map<IdPair<GeometryHandle>, LinkPair> geometryPairToLinkPairMap;
@@ -232,11 +254,68 @@ public:
     int numUnconverged;
 
     typedef Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> MatrixX;
+    typedef Eigen::SparseMatrix<double, Eigen::RowMajor> SparseMatrixX;
     typedef VectorXd VectorX;
         
     // Mlcp * solution + b   _|_  solution
     MatrixX Mlcp;
 
+    // Used instead of Mlcp when USE_SPARSE_LCP_MATRIX is true
+    SparseMatrixX sparseMlcp;
+    VectorX sparseMlcpDiagonal;
+
+    // Indices of the constrained link pairs coupled with each constrained link pair
+    vector<vector<int>> linkPairCouplings;
+
+    /**
+       A set of the constrained link pairs connected by the couplings.
+       The LCP of each island is solved independently.
+    */
+    struct ConstraintIsland
+    {
+        vector<int> linkPairIndices;
+        vector<int> contactNormalIndices;
+        vector<int> nonContactNormalIndices;
+        vector<int> frictionIndices;
+        VectorXd x0;
+        bool isResting;
+        int numGaussSeidelIterations;
+
+        int size() const {
+            return contactNormalIndices.size() + nonContactNormalIndices.size() + frictionIndices.size();
+        }
+    };
+    vector<ConstraintIsland> constraintIslands;
+    int numConstraintIslands;
+    vector<int> islandSolvingOrder;
+    vector<int> linkPairIndexToIslandIndex;
+    int stepIndex;
+    int numThreads;
+
+    /**
+       Accessor to a sub block of the LCP matrix stored in Mlcp or sparseMlcp.
+       In the sparse case, the element must be in the sparsity pattern.
+    */
+    class LcpMatrixBlock
+    {
+    public:
+        LcpMatrixBlock(Impl* impl, int rowOffset, int colOffset)
+            : dense(impl->Mlcp), sparse(impl->sparseMlcp), rowOffset(rowOffset), colOffset(colOffset) { }
+        
+        double& operator()(int row, int col){
+            if(USE_SPARSE_LCP_MATRIX){
+                return sparse.coeffRef(rowOffset + row, colOffset + col);
+            } else {
+                return dense(rowOffset + row, colOffset + col);
+            }
+        }
+    private:
+        MatrixX& dense;
+        SparseMatrixX& sparse;
+        int rowOffset;
+        int colOffset;
+    };
+
     // constant acceleration term when no external force is applied
     VectorX an0;
     VectorX at0;
@@ -266,6 +345,10 @@ public:
     int numGaussSeidelTotalCalls;
     int numGaussSeidelTotalLoopsMax;
 
+    bool isStatisticsEnabled;
+    Statistics statistics;
+    TimeMeasure statisticsTimer;
+
     Impl(DyWorldBase& world);
     ~Impl();
     void clearBodies();
@@ -290,32 +373,68 @@ public:
     void setAccelCalcSkipInformation();
     void setDefaultAccelerationVector();
     void setAccelerationMatrix();
+    void setLinkPairCouplings();
+    void setConstraintIslands();
+    void solveConstraintIslands();
+    template<class TMatrix>
+    void solveConstraintIsland(const TMatrix& M, ConstraintIsland& island);
+    void setInitialSolutionOfConstraintIsland(ConstraintIsland& island);
+    void storeSolutionOfConstraintIsland(ConstraintIsland& island);
+    void initSparseAccelerationMatrix();
     void initABMForceElementsWithNoExtForce(DySubBody* subBody);
     void calcABMForceElementsWithTestForce(
         DySubBody* subBody, DyLink* linkToApplyForce, const Vector3& f, const Vector3& tau);
     void calcAccelsABM(DySubBody* subBody, int constraintIndex);
     void calcAccelsMM(DySubBody* bodyData, int constraintIndex);
     void extractRelAccelsOfConstraintPoints(
-        Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt, int testForceIndex, int constraintIndex);
+        LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt, int linkPairIndex, int testForceIndex, int constraintIndex);
     void extractRelAccelsFromLinkPairCase1(
-        Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt,
+        LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt,
         LinkPair& linkPair, int testForceIndex, int constraintIndex);
     void extractRelAccelsFromLinkPairCase2(
-        Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt,
+        LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt,
         LinkPair& linkPair, int iTestForce, int iDefault, int testForceIndex, int constraintIndex);
     void extractRelAccelsFromLinkPairCase3(
-        Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt,
+        LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt,
         LinkPair& linkPair, int testForceIndex, int constraintIndex);
     void copySymmetricElementsOfAccelerationMatrix(
-        Eigen::Block<MatrixX>& Knn, Eigen::Block<MatrixX>& Ktn, Eigen::Block<MatrixX>& Knt, Eigen::Block<MatrixX>& Ktt);
+        LcpMatrixBlock& Knn, LcpMatrixBlock& Ktn, LcpMatrixBlock& Knt, LcpMatrixBlock& Ktt);
     void clearSingularPointConstraintsOfClosedLoopConnections();
     void setConstantVectorAndMuBlock();
     void addConstraintForceToLinks();
     void addConstraintForceToLink(LinkPair* linkPair, int ipair);
-    void solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b, VectorX& x);
-    void solveMCPByProjectedGaussSeidelMainStep(const MatrixX& M, const VectorX& b, VectorX& x);
+
+    double getDiagonalElement(const MatrixX& M, int j) const {
+        return M(j, j);
+    }
+    double getDiagonalElement(const SparseMatrixX& /* M */, int j) const {
+        return sparseMlcpDiagonal[j];
+    }
+    double calcRowProductWithoutDiagonal(const MatrixX& M, const VectorX& x, int j, int size) const {
+        double sum = -M(j, j) * x(j);
+        for(int k=0; k < size; ++k){
+            sum += M(j, k) * x(k);
+        }
+        return sum;
+    }
+    double calcRowProductWithoutDiagonal(const SparseMatrixX& M, const VectorX& x, int j, int /* size */) const {
+        double sum = -sparseMlcpDiagonal[j] * x(j);
+        for(SparseMatrixX::InnerIterator it(M, j); it; ++it){
+            sum += it.value() * x(it.index());
+        }
+        return sum;
+    }
+    template<class TMatrix>
+    void solveMCPByProjectedGaussSeidel(
+        const TMatrix& M, const VectorX& b, VectorX& x, ConstraintIsland& island);
+    template<class TMatrix>
+    void solveMCPByProjectedGaussSeidelMainStep(
+        const TMatrix& M, const VectorX& b, VectorX& x, const ConstraintIsland& island);
+    template<class TMatrix>
     void solveMCPByProjectedGaussSeidelInitial(
-        const MatrixX& M, const VectorX& b, VectorX& x, const int numIteration);
+        const TMatrix& M, const VectorX& b, VectorX& x, const ConstraintIsland& island, const int numIteration);
+    void storeCurrentSolutionOfConstraintIsland(const VectorX& x, ConstraintIsland& island);
+    double calcSolutionErrorOfConstraintIsland(const VectorX& x, const ConstraintIsland& island);
     void checkLCPResult(MatrixX& M, VectorX& b, VectorX& x);
     void checkMCPResult(MatrixX& M, VectorX& b, VectorX& x);
 
@@ -386,6 +505,9 @@ ConstraintForceSolver::Impl::Impl(DyWorldBase& world)
 
     bodyIndexToCollisionDetectionModeMap.clear();
     is2Dmode = false;
+
+    isStatisticsEnabled = false;
+    statistics = Statistics();
 }
 
 
@@ -579,6 +701,9 @@ void ConstraintForceSolver::Impl::initialize(void)
     prevGlobalNumConstraintVectors = 0;
     prevGlobalNumFrictionVectors = 0;
     numUnconverged = 0;
+    stepIndex = 0;
+
+    numThreads = USE_SPARSE_LCP_MATRIX ? world.numThreads() : 1;
 
     if(ENABLE_RANDOM_STATIC_FRICTION_BASE){
         randomEngine.seed();
@@ -656,6 +781,10 @@ void ConstraintForceSolver::Impl::solve()
         }
     }
 
+    if(isStatisticsEnabled){
+        statisticsTimer.begin();
+    }
+
     bodyCollisionDetector.updatePositions();
 
     globalNumConstraintVectors = 0;
@@ -670,6 +799,12 @@ void ConstraintForceSolver::Impl::solve()
         cout << globalNumContactNormalVectors;
     }
 
+    if(isStatisticsEnabled){
+        statistics.collisionDetectionTime += statisticsTimer.measure();
+        statistics.numContacts += globalNumContactNormalVectors;
+        statisticsTimer.begin();
+    }
+
     if(globalNumConstraintVectors > 0){
 
         if(CFS_DEBUG){
@@ -693,6 +828,7 @@ void ConstraintForceSolver::Impl::solve()
         }
 
         setDefaultAccelerationVector();
+        setLinkPairCouplings();
         setAccelerationMatrix();
 
         clearSingularPointConstraintsOfClosedLoopConnections();
@@ -702,19 +838,26 @@ void ConstraintForceSolver::Impl::solve()
         if(CFS_DEBUG_VERBOSE){
             debugPutVector(an0, "an0");
             debugPutVector(at0, "at0");
-            debugPutMatrix(Mlcp, "Mlcp");
+            if(USE_SPARSE_LCP_MATRIX){
+                debugPutMatrix(MatrixX(sparseMlcp), "Mlcp");
+            } else {
+                debugPutMatrix(Mlcp, "Mlcp");
+            }
             debugPutVector(b.head(globalNumConstraintVectors), "b1");
             debugPutVector(b.segment(globalNumConstraintVectors, globalNumFrictionVectors), "b2");
         }
 
+        if(isStatisticsEnabled){
+            statistics.lcpBuildingTime += statisticsTimer.measure();
+            statisticsTimer.begin();
+        }
+
         bool isConverged;
 #ifdef USE_PIVOTING_LCP
         isConverged = callPathLCPSolver(Mlcp, b, solution);
 #else
-        if(!USE_PREVIOUS_LCP_SOLUTION || constraintsSizeChanged){
-            solution.setZero();
-        }
-        solveMCPByProjectedGaussSeidel(Mlcp, b, solution);
+        setConstraintIslands();
+        solveConstraintIslands();
         isConverged = true;
 #endif
 
@@ -727,15 +870,35 @@ void ConstraintForceSolver::Impl::solve()
                 os << "LCP converged" << std::endl;
             if(CFS_DEBUG_LCPCHECK){
                 // checkLCPResult(Mlcp, b, solution);
-                checkMCPResult(Mlcp, b, solution);
+                if(USE_SPARSE_LCP_MATRIX){
+                    MatrixX M(sparseMlcp);
+                    checkMCPResult(M, b, solution);
+                } else {
+                    checkMCPResult(Mlcp, b, solution);
+                }
             }
 
             addConstraintForceToLinks();
         }
+
+        if(isStatisticsEnabled){
+            statistics.lcpSolvingTime += statisticsTimer.measure();
+#ifndef USE_PIVOTING_LCP
+            statistics.numConstraintIslands += numConstraintIslands;
+            for(int i=0; i < numConstraintIslands; ++i){
+                statistics.numGaussSeidelIterations += constraintIslands[i].numGaussSeidelIterations;
+            }
+#endif
+        }
+    }
+
+    if(isStatisticsEnabled){
+        ++statistics.numSteps;
     }
 
     prevGlobalNumConstraintVectors = globalNumConstraintVectors;
     prevGlobalNumFrictionVectors = globalNumFrictionVectors;
+    ++stepIndex;
 }
 
 
@@ -1091,7 +1254,9 @@ void ConstraintForceSolver::Impl::initMatrices()
 
     const int dimLCP = usePivotingLCP ? (n + m + m) : (n + m);
 
-    Mlcp.resize(dimLCP, dimLCP);
+    if(!USE_SPARSE_LCP_MATRIX){
+        Mlcp.resize(dimLCP, dimLCP);
+    }
     b.resize(dimLCP);
     solution.resize(dimLCP);
 
@@ -1197,12 +1362,15 @@ void ConstraintForceSolver::Impl::setDefaultAccelerationVector()
 void ConstraintForceSolver::Impl::setAccelerationMatrix()
 {
     const int n = globalNumConstraintVectors;
-    const int m = globalNumFrictionVectors;
 
-    Eigen::Block<MatrixX> Knn = Mlcp.block(0, 0, n, n);
-    Eigen::Block<MatrixX> Ktn = Mlcp.block(0, n, n, m);
-    Eigen::Block<MatrixX> Knt = Mlcp.block(n, 0, m, n);
-    Eigen::Block<MatrixX> Ktt = Mlcp.block(n, n, m, m);
+    if(USE_SPARSE_LCP_MATRIX){
+        initSparseAccelerationMatrix();
+    }
+
+    LcpMatrixBlock Knn(this, 0, 0);
+    LcpMatrixBlock Ktn(this, 0, n);
+    LcpMatrixBlock Knt(this, n, 0);
+    LcpMatrixBlock Ktt(this, n, n);
 
     for(size_t i=0; i < constrainedLinkPairs.size(); ++i){
 
@@ -1240,7 +1408,7 @@ void ConstraintForceSolver::Impl::setAccelerationMatrix()
                     }
                 }
             }
-            extractRelAccelsOfConstraintPoints(Knn, Knt, constraintIndex, constraintIndex);
+            extractRelAccelsOfConstraintPoints(Knn, Knt, i, constraintIndex, constraintIndex);
 
             // apply test friction force
             for(int l=0; l < constraint.numFrictionVectors; ++l){
@@ -1267,7 +1435,7 @@ void ConstraintForceSolver::Impl::setAccelerationMatrix()
                         }
                     }
                 }
-                extractRelAccelsOfConstraintPoints(Ktn, Ktt, constraint.globalFrictionIndex + l, constraintIndex);
+                extractRelAccelsOfConstraintPoints(Ktn, Ktt, i, constraint.globalFrictionIndex + l, constraintIndex);
             }
 
             linkPair.link[0]->subBody()->isTestForceBeingApplied = false;
@@ -1281,6 +1449,329 @@ void ConstraintForceSolver::Impl::setAccelerationMatrix()
 }
 
 
+/**
+   Two constrained link pairs are coupled in the LCP matrix when they share a non-static
+   sub body because a test force applied to one of the pairs changes the accelerations
+   of the other pair only through the sub body.
+*/
+void ConstraintForceSolver::Impl::setLinkPairCouplings()
+{
+    const int numLinkPairs = constrainedLinkPairs.size();
+    
+    for(int i=0; i < numLinkPairs; ++i){
+        LinkPair* linkPair = constrainedLinkPairs[i];
+        auto subBody0 = linkPair->link[0]->subBody();
+        auto subBody1 = linkPair->link[1]->subBody();
+        if(!subBody0->isStatic()){
+            subBody0->constrainedLinkPairIndices.push_back(i);
+        }
+        if(subBody1 != subBody0 && !subBody1->isStatic()){
+            subBody1->constrainedLinkPairIndices.push_back(i);
+        }
+    }
+
+    linkPairCouplings.resize(numLinkPairs);
+    
+    for(int i=0; i < numLinkPairs; ++i){
+        LinkPair* linkPair = constrainedLinkPairs[i];
+        auto subBody0 = linkPair->link[0]->subBody();
+        auto subBody1 = linkPair->link[1]->subBody();
+        auto& couplings = linkPairCouplings[i];
+        couplings.clear();
+        if(subBody0->isStatic()){
+            couplings = subBody1->constrainedLinkPairIndices;
+        } else if(subBody1->isStatic() || subBody1 == subBody0){
+            couplings = subBody0->constrainedLinkPairIndices;
+        } else {
+            // Both the index lists are sorted in the ascending order
+            auto& indices0 = subBody0->constrainedLinkPairIndices;
+            auto& indices1 = subBody1->constrainedLinkPairIndices;
+            std::set_union(indices0.begin(), indices0.end(), indices1.begin(), indices1.end(),
+                           std::back_inserter(couplings));
+        }
+    }
+
+    for(auto& linkPair : constrainedLinkPairs){
+        linkPair->link[0]->subBody()->constrainedLinkPairIndices.clear();
+        linkPair->link[1]->subBody()->constrainedLinkPairIndices.clear();
+    }
+}
+
+
+/**
+   The constrained link pairs are divided into the connected components of the coupling graph.
+   The dense LCP matrix is always solved as a single island.
+*/
+void ConstraintForceSolver::Impl::setConstraintIslands()
+{
+    const int numLinkPairs = constrainedLinkPairs.size();
+    const int n = globalNumConstraintVectors;
+
+    numConstraintIslands = 0;
+    linkPairIndexToIslandIndex.assign(numLinkPairs, -1);
+
+    auto addIsland = [&]() -> ConstraintIsland& {
+        if(numConstraintIslands == static_cast<int>(constraintIslands.size())){
+            constraintIslands.emplace_back();
+        }
+        auto& island = constraintIslands[numConstraintIslands++];
+        island.linkPairIndices.clear();
+        island.contactNormalIndices.clear();
+        island.nonContactNormalIndices.clear();
+        island.frictionIndices.clear();
+        return island;
+    };
+
+    if(!USE_SPARSE_LCP_MATRIX){
+        auto& island = addIsland();
+        for(int i=0; i < numLinkPairs; ++i){
+            island.linkPairIndices.push_back(i);
+        }
+    } else {
+        for(int i=0; i < numLinkPairs; ++i){
+            if(linkPairIndexToIslandIndex[i] >= 0){
+                continue;
+            }
+            const int islandIndex = numConstraintIslands;
+            auto& linkPairIndices = addIsland().linkPairIndices;
+            linkPairIndexToIslandIndex[i] = islandIndex;
+            linkPairIndices.push_back(i);
+            for(size_t j=0; j < linkPairIndices.size(); ++j){
+                for(auto& k : linkPairCouplings[linkPairIndices[j]]){
+                    if(linkPairIndexToIslandIndex[k] < 0){
+                        linkPairIndexToIslandIndex[k] = islandIndex;
+                        linkPairIndices.push_back(k);
+                    }
+                }
+            }
+            // The rows of the island are solved in the same order as the global LCP
+            std::sort(linkPairIndices.begin(), linkPairIndices.end());
+        }
+    }
+
+    for(int i=0; i < numConstraintIslands; ++i){
+        auto& island = constraintIslands[i];
+        for(auto& linkPairIndex : island.linkPairIndices){
+            for(auto& constraint : constrainedLinkPairs[linkPairIndex]->constraintPoints){
+                if(constraint.globalIndex < globalNumContactNormalVectors){
+                    island.contactNormalIndices.push_back(constraint.globalIndex);
+                } else {
+                    island.nonContactNormalIndices.push_back(constraint.globalIndex);
+                }
+                for(int k=0; k < constraint.numFrictionVectors; ++k){
+                    island.frictionIndices.push_back(n + constraint.globalFrictionIndex + k);
+                }
+            }
+        }
+    }
+
+    // Large islands are solved first to balance the load of the threads
+    islandSolvingOrder.resize(numConstraintIslands);
+    for(int i=0; i < numConstraintIslands; ++i){
+        islandSolvingOrder[i] = i;
+    }
+    std::stable_sort(
+        islandSolvingOrder.begin(), islandSolvingOrder.end(),
+        [&](int i, int j){ return constraintIslands[i].size() > constraintIslands[j].size(); });
+}
+
+
+void ConstraintForceSolver::Impl::solveConstraintIslands()
+{
+    auto solveIsland = [&](ConstraintIsland& island){
+        if(USE_SPARSE_LCP_MATRIX){
+            solveConstraintIsland(sparseMlcp, island);
+        } else {
+            solveConstraintIsland(Mlcp, island);
+        }
+    };
+
+    if(numThreads <= 1 || numConstraintIslands < 2){
+        for(int i=0; i < numConstraintIslands; ++i){
+            solveIsland(constraintIslands[i]);
+        }
+    } else {
+        TaskScheduler::instance()->parallelFor(
+            0, numConstraintIslands, 1,
+            [&](int begin, int end){
+                for(int i = begin; i < end; ++i){
+                    solveIsland(constraintIslands[islandSolvingOrder[i]]);
+                }
+            },
+            numThreads);
+    }
+}
+
+
+template<class TMatrix>
+void ConstraintForceSolver::Impl::solveConstraintIsland(const TMatrix& M, ConstraintIsland& island)
+{
+    setInitialSolutionOfConstraintIsland(island);
+    island.numGaussSeidelIterations = 0;
+
+    bool isSolved = false;
+    if(island.isResting){
+        // Accept the previous solution if it is still an approximate solution
+        storeCurrentSolutionOfConstraintIsland(solution, island);
+        solveMCPByProjectedGaussSeidelMainStep(M, b, solution, island);
+        island.numGaussSeidelIterations = 1;
+        isSolved = (calcSolutionErrorOfConstraintIsland(solution, island) < gaussSeidelErrorCriterion);
+    }
+    if(!isSolved){
+        solveMCPByProjectedGaussSeidel(M, b, solution, island);
+    }
+
+    storeSolutionOfConstraintIsland(island);
+}
+
+
+void ConstraintForceSolver::Impl::setInitialSolutionOfConstraintIsland(ConstraintIsland& island)
+{
+    const int n = globalNumConstraintVectors;
+    island.isResting = USE_PREVIOUS_LCP_SOLUTION;
+
+    for(auto& linkPairIndex : island.linkPairIndices){
+        LinkPair& linkPair = *constrainedLinkPairs[linkPairIndex];
+        auto& constraintPoints = linkPair.constraintPoints;
+        const int numConstraints = constraintPoints.size();
+        int numFrictionVectors = 0;
+        for(auto& constraint : constraintPoints){
+            numFrictionVectors += constraint.numFrictionVectors;
+        }
+        auto& x = linkPair.prevSolution;
+        const bool isPrevSolutionAvailable =
+            USE_PREVIOUS_LCP_SOLUTION &&
+            linkPair.prevSolutionStepIndex == stepIndex - 1 &&
+            x.size() == numConstraints + numFrictionVectors;
+
+        int frictionIndex = numConstraints;
+        for(int i=0; i < numConstraints; ++i){
+            auto& constraint = constraintPoints[i];
+            if(isPrevSolutionAvailable){
+                solution(constraint.globalIndex) = x[i];
+                for(int k=0; k < constraint.numFrictionVectors; ++k){
+                    solution(n + constraint.globalFrictionIndex + k) = x[frictionIndex++];
+                }
+            } else {
+                solution(constraint.globalIndex) = 0.0;
+                for(int k=0; k < constraint.numFrictionVectors; ++k){
+                    solution(n + constraint.globalFrictionIndex + k) = 0.0;
+                }
+            }
+            if(island.isResting){
+                double v;
+                if(constraint.globalIndex < globalNumContactNormalVectors){
+                    v = constraint.relVelocityOn0.norm();
+                } else {
+                    v = fabs(constraint.normalProjectionOfRelVelocityOn0);
+                }
+                if(v > ISLAND_REST_VELOCITY_THRESH){
+                    island.isResting = false;
+                }
+            }
+        }
+        if(!isPrevSolutionAvailable){
+            island.isResting = false;
+        }
+    }
+}
+
+
+void ConstraintForceSolver::Impl::storeSolutionOfConstraintIsland(ConstraintIsland& island)
+{
+    const int n = globalNumConstraintVectors;
+
+    for(auto& linkPairIndex : island.linkPairIndices){
+        LinkPair& linkPair = *constrainedLinkPairs[linkPairIndex];
+        auto& constraintPoints = linkPair.constraintPoints;
+        const int numConstraints = constraintPoints.size();
+        int numFrictionVectors = 0;
+        for(auto& constraint : constraintPoints){
+            numFrictionVectors += constraint.numFrictionVectors;
+        }
+        auto& x = linkPair.prevSolution;
+        x.resize(numConstraints + numFrictionVectors);
+        int frictionIndex = numConstraints;
+        for(int i=0; i < numConstraints; ++i){
+            auto& constraint = constraintPoints[i];
+            x[i] = solution(constraint.globalIndex);
+            for(int k=0; k < constraint.numFrictionVectors; ++k){
+                x[frictionIndex++] = solution(n + constraint.globalFrictionIndex + k);
+            }
+        }
+        linkPair.prevSolutionStepIndex = stepIndex;
+    }
+}
+
+
+void ConstraintForceSolver::Impl::initSparseAccelerationMatrix()
+{
+    const int n = globalNumConstraintVectors;
+    const int m = globalNumFrictionVectors;
+    const int numLinkPairs = constrainedLinkPairs.size();
+
+    auto getNumFrictionVectors = [](LinkPair* linkPair){
+        int numFrictionVectors = 0;
+        for(auto& constraint : linkPair->constraintPoints){
+            numFrictionVectors += constraint.numFrictionVectors;
+        }
+        return numFrictionVectors;
+    };
+
+    // The number of the columns of the rows of each link pair
+    vector<int> numLinkPairColumns(numLinkPairs, 0);
+    vector<int> numLinkPairFrictionVectors(numLinkPairs);
+    for(int i=0; i < numLinkPairs; ++i){
+        numLinkPairFrictionVectors[i] = getNumFrictionVectors(constrainedLinkPairs[i]);
+    }
+    for(int i=0; i < numLinkPairs; ++i){
+        for(auto& j : linkPairCouplings[i]){
+            numLinkPairColumns[i] += constrainedLinkPairs[j]->constraintPoints.size() + numLinkPairFrictionVectors[j];
+        }
+    }
+
+    Eigen::VectorXi numRowElements(n + m);
+    for(int i=0; i < numLinkPairs; ++i){
+        for(auto& constraint : constrainedLinkPairs[i]->constraintPoints){
+            numRowElements[constraint.globalIndex] = numLinkPairColumns[i];
+            for(int k=0; k < constraint.numFrictionVectors; ++k){
+                numRowElements[n + constraint.globalFrictionIndex + k] = numLinkPairColumns[i];
+            }
+        }
+    }
+
+    sparseMlcp.resize(n + m, n + m);
+    sparseMlcp.reserve(numRowElements);
+
+    // Insert the elements of each row in the ascending order of the column
+    auto insertRowElements = [&](int row, int linkPairIndex){
+        auto& couplings = linkPairCouplings[linkPairIndex];
+        for(auto& j : couplings){
+            for(auto& constraint : constrainedLinkPairs[j]->constraintPoints){
+                sparseMlcp.insert(row, constraint.globalIndex) = 0.0;
+            }
+        }
+        for(auto& j : couplings){
+            for(auto& constraint : constrainedLinkPairs[j]->constraintPoints){
+                for(int k=0; k < constraint.numFrictionVectors; ++k){
+                    sparseMlcp.insert(row, n + constraint.globalFrictionIndex + k) = 0.0;
+                }
+            }
+        }
+    };
+    for(int i=0; i < numLinkPairs; ++i){
+        for(auto& constraint : constrainedLinkPairs[i]->constraintPoints){
+            insertRowElements(constraint.globalIndex, i);
+            for(int k=0; k < constraint.numFrictionVectors; ++k){
+                insertRowElements(n + constraint.globalFrictionIndex + k, i);
+            }
+        }
+    }
+
+    sparseMlcp.makeCompressed();
+}
+
+
 void ConstraintForceSolver::Impl::initABMForceElementsWithNoExtForce(DySubBody* subBody)
 {
     subBody->dpf.setZero();
@@ -1419,12 +1910,17 @@ void ConstraintForceSolver::Impl::calcAccelsMM(DySubBody* subBody, int constrain
 
 
 void ConstraintForceSolver::Impl::extractRelAccelsOfConstraintPoints
-(Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt, int testForceIndex, int constraintIndex)
+(LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt, int linkPairIndex, int testForceIndex, int constraintIndex)
 {
     int maxConstraintIndexToExtract = ASSUME_SYMMETRIC_MATRIX ? constraintIndex : globalNumConstraintVectors;
 
-    for(size_t i=0; i < constrainedLinkPairs.size(); ++i){
-        LinkPair& linkPair = *constrainedLinkPairs[i];
+    // In the sparse case, only the coupled link pairs have non-zero elements
+    const int numLinkPairs =
+        USE_SPARSE_LCP_MATRIX ? linkPairCouplings[linkPairIndex].size() : constrainedLinkPairs.size();
+
+    for(int i=0; i < numLinkPairs; ++i){
+        LinkPair& linkPair =
+            *constrainedLinkPairs[USE_SPARSE_LCP_MATRIX ? linkPairCouplings[linkPairIndex][i] : i];
         auto subBody0 = linkPair.link[0]->subBody();
         auto subBody1 = linkPair.link[1]->subBody();
         if(subBody0->isTestForceBeingApplied){
@@ -1445,7 +1941,7 @@ void ConstraintForceSolver::Impl::extractRelAccelsOfConstraintPoints
 
 
 void ConstraintForceSolver::Impl::extractRelAccelsFromLinkPairCase1
-(Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt,
+(LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt,
  LinkPair& linkPair, int testForceIndex, int maxConstraintIndexToExtract)
 {
     auto& constraintPoints = linkPair.constraintPoints;
@@ -1484,7 +1980,7 @@ void ConstraintForceSolver::Impl::extractRelAccelsFromLinkPairCase1
 
 
 void ConstraintForceSolver::Impl::extractRelAccelsFromLinkPairCase2
-(Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt,
+(LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt,
  LinkPair& linkPair, int iTestForce, int iDefault, int testForceIndex, int maxConstraintIndexToExtract)
 {
     auto& constraintPoints = linkPair.constraintPoints;
@@ -1520,7 +2016,7 @@ void ConstraintForceSolver::Impl::extractRelAccelsFromLinkPairCase2
 
 
 void ConstraintForceSolver::Impl::extractRelAccelsFromLinkPairCase3
-(Eigen::Block<MatrixX>& Kxn, Eigen::Block<MatrixX>& Kxt, LinkPair& linkPair, int testForceIndex, int maxConstraintIndexToExtract)
+(LcpMatrixBlock& Kxn, LcpMatrixBlock& Kxt, LinkPair& linkPair, int testForceIndex, int maxConstraintIndexToExtract)
 {
     auto& constraintPoints = linkPair.constraintPoints;
 
@@ -1543,7 +2039,7 @@ void ConstraintForceSolver::Impl::extractRelAccelsFromLinkPairCase3
 
 
 void ConstraintForceSolver::Impl::copySymmetricElementsOfAccelerationMatrix
-(Eigen::Block<MatrixX>& Knn, Eigen::Block<MatrixX>& Ktn, Eigen::Block<MatrixX>& Knt, Eigen::Block<MatrixX>& Ktt)
+(LcpMatrixBlock& Knn, LcpMatrixBlock& Ktn, LcpMatrixBlock& Knt, LcpMatrixBlock& Ktt)
 {
     for(size_t linkPairIndex=0; linkPairIndex < constrainedLinkPairs.size(); ++linkPairIndex){
 
@@ -1581,6 +2077,24 @@ void ConstraintForceSolver::Impl::copySymmetricElementsOfAccelerationMatrix
 
 void ConstraintForceSolver::Impl::clearSingularPointConstraintsOfClosedLoopConnections()
 {
+    if(USE_SPARSE_LCP_MATRIX){
+        const int size = sparseMlcp.rows();
+        sparseMlcpDiagonal.resize(size);
+        for(int i = 0; i < size; ++i){
+            double& d = sparseMlcp.coeffRef(i, i);
+            if(d < 1.0e-4){
+                // The sparsity pattern is symmetric, so the rows having the elements
+                // of column i are the columns of row i
+                for(SparseMatrixX::InnerIterator it(sparseMlcp, i); it; ++it){
+                    sparseMlcp.coeffRef(it.index(), i) = 0.0;
+                }
+                d = numeric_limits<double>::max();
+            }
+            sparseMlcpDiagonal[i] = d;
+        }
+        return;
+    }
+    
     for(int i = 0; i < Mlcp.rows(); ++i){
         if(Mlcp(i, i) < 1.0e-4){
             for(int j=0; j < Mlcp.rows(); ++j){
@@ -1724,12 +2238,14 @@ void ConstraintForceSolver::Impl::addConstraintForceToLink(LinkPair* linkPair, i
 }
 
 
-void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidel(const MatrixX& M, const VectorX& b, VectorX& x)
+template<class TMatrix>
+void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidel
+(const TMatrix& M, const VectorX& b, VectorX& x, ConstraintIsland& island)
 {
     static const int loopBlockSize = DEFAULT_NUM_GAUSS_SEIDEL_ITERATION_BLOCK;
 
     if(numGaussSeidelInitialIteration > 0){
-        solveMCPByProjectedGaussSeidelInitial(M, b, x, numGaussSeidelInitialIteration);
+        solveMCPByProjectedGaussSeidelInitial(M, b, x, island, numGaussSeidelInitialIteration);
     }
 
     int numBlockLoops = maxNumGaussSeidelIteration / loopBlockSize;
@@ -1742,37 +2258,17 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidel(const MatrixX&
     }
 
     double error = 0.0;
-    VectorXd x0;
     int i = 0;
     while(i < numBlockLoops){
         i++;
 
         for(int j=0; j < loopBlockSize - 1; ++j){
-            solveMCPByProjectedGaussSeidelMainStep(M, b, x);
+            solveMCPByProjectedGaussSeidelMainStep(M, b, x, island);
         }
 
-        x0 = x;
-        solveMCPByProjectedGaussSeidelMainStep(M, b, x);
-
-        if(true){
-            double n = x.norm();
-            if(n > THRESH_TO_SWITCH_REL_ERROR){
-                error = (x - x0).norm() / x.norm();
-            } else {
-                error = (x - x0).norm();
-            }
-        } else {
-            error = 0.0;
-            for(int j=0; j < x.size(); ++j){
-                double d = fabs(x(j) - x0(j));
-                if(d > THRESH_TO_SWITCH_REL_ERROR){
-                    d /= x(j);
-                }
-                if(d > error){
-                    error = d;
-                }
-            }
-        }
+        storeCurrentSolutionOfConstraintIsland(x, island);
+        solveMCPByProjectedGaussSeidelMainStep(M, b, x, island);
+        error = calcSolutionErrorOfConstraintIsland(x, island);
 
         if(error < gaussSeidelErrorCriterion){
             if(CFS_MCP_DEBUG_SHOW_ITERATION_STOP){
@@ -1782,6 +2278,8 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidel(const MatrixX&
         }
     }
 
+    island.numGaussSeidelIterations += numGaussSeidelInitialIteration + loopBlockSize * i;
+
     if(CFS_MCP_DEBUG){
 
         if(i == numBlockLoops){
@@ -1799,21 +2297,60 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidel(const MatrixX&
 }
 
 
-void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelMainStep(const MatrixX& M, const VectorX& b, VectorX& x)
+void ConstraintForceSolver::Impl::storeCurrentSolutionOfConstraintIsland(const VectorX& x, ConstraintIsland& island)
+{
+    island.x0.resize(island.size());
+    int i = 0;
+    for(auto indices : { &island.contactNormalIndices, &island.nonContactNormalIndices, &island.frictionIndices }){
+        for(auto& j : *indices){
+            island.x0(i++) = x(j);
+        }
+    }
+}
+
+
+/**
+   The error from the solution stored by storeCurrentSolutionOfConstraintIsland
+*/
+double ConstraintForceSolver::Impl::calcSolutionErrorOfConstraintIsland(const VectorX& x, const ConstraintIsland& island)
+{
+    double dsum = 0.0;
+    double xsum = 0.0;
+    int i = 0;
+    auto accumulate = [&](const vector<int>& indices){
+        for(auto& j : indices){
+            const double d = x(j) - island.x0(i++);
+            dsum += d * d;
+            xsum += x(j) * x(j);
+        }
+    };
+    accumulate(island.contactNormalIndices);
+    accumulate(island.nonContactNormalIndices);
+    accumulate(island.frictionIndices);
+
+    double n = sqrt(xsum);
+    if(n > THRESH_TO_SWITCH_REL_ERROR){
+        return sqrt(dsum) / n;
+    } else {
+        return sqrt(dsum);
+    }
+}
+
+
+template<class TMatrix>
+void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelMainStep
+(const TMatrix& M, const VectorX& b, VectorX& x, const ConstraintIsland& island)
 {
     const int size = globalNumConstraintVectors + globalNumFrictionVectors;
 
-    for(int j=0; j < globalNumContactNormalVectors; ++j){
+    for(auto& j : island.contactNormalIndices){
 
         double xx;
-        if(M(j,j) == numeric_limits<double>::max()){
+        if(getDiagonalElement(M, j) == numeric_limits<double>::max()){
             xx=0.0;
         } else {
-            double sum = -M(j, j) * x(j);
-            for(int k=0; k < size; ++k){
-                sum += M(j, k) * x(k);
-            }
-            xx = (-b(j) - sum) / M(j, j);
+            double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+            xx = (-b(j) - sum) / getDiagonalElement(M, j);
         }
         if(xx < 0.0){
             x(j) = 0.0;
@@ -1823,48 +2360,42 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelMainStep(const M
         mcpHi[j] = contactIndexToMu[j] * x(j);
     }
     
-    for(int j=globalNumContactNormalVectors; j < globalNumConstraintVectors; ++j){
+    for(auto& j : island.nonContactNormalIndices){
         
-        if(M(j,j) == numeric_limits<double>::max()){
+        if(getDiagonalElement(M, j) == numeric_limits<double>::max()){
             x(j)=0.0;
         } else {
-            double sum = -M(j, j) * x(j);
-            for(int k=0; k < size; ++k){
-                sum += M(j, k) * x(k);
-            }
-            x(j) = (-b(j) - sum) / M(j, j);
+            double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+            x(j) = (-b(j) - sum) / getDiagonalElement(M, j);
         }
     }
     
+    const int numFrictionIndices = island.frictionIndices.size();
     
     if(ENABLE_TRUE_FRICTION_CONE){
 
-        int contactIndex = 0;
-        for(int j=globalNumConstraintVectors; j < size; ++j, ++contactIndex){
+        for(int i=0; i < numFrictionIndices; ++i){
+
+            int j = island.frictionIndices[i];
+            const int contactIndex = frictionIndexToContactIndex[j - globalNumConstraintVectors];
             
             double fx0;
-            if(M(j,j) == numeric_limits<double>::max()) {
+            if(getDiagonalElement(M, j) == numeric_limits<double>::max()) {
                 fx0 = 0.0;
             } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                fx0 = (-b(j) - sum) / M(j, j);
+                double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                fx0 = (-b(j) - sum) / getDiagonalElement(M, j);
             }
             double& fx = x(j);
             
-            ++j;
+            j = island.frictionIndices[++i];
             
             double fy0;
-            if(M(j,j) == numeric_limits<double>::max()) {
+            if(getDiagonalElement(M, j) == numeric_limits<double>::max()) {
                 fy0=0.0;
             } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                fy0 = (-b(j) - sum) / M(j, j);
+                double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                fy0 = (-b(j) - sum) / getDiagonalElement(M, j);
             }
             double& fy = x(j);
             
@@ -1884,21 +2415,17 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelMainStep(const M
         
     } else {
 
-        int frictionIndex = 0;
-        for(int j=globalNumConstraintVectors; j < size; ++j, ++frictionIndex){
+        for(auto& j : island.frictionIndices){
 
             double xx;
-            if(M(j,j) == numeric_limits<double>::max()) {
+            if(getDiagonalElement(M, j) == numeric_limits<double>::max()) {
                 xx=0.0;
             } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                xx = (-b(j) - sum) / M(j, j);
+                double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                xx = (-b(j) - sum) / getDiagonalElement(M, j);
             }
             
-            const int contactIndex = frictionIndexToContactIndex[frictionIndex];
+            const int contactIndex = frictionIndexToContactIndex[j - globalNumConstraintVectors];
             const double fmax = mcpHi[contactIndex];
             const double fmin = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? -fmax : 0.0);
             
@@ -1914,27 +2441,27 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelMainStep(const M
 }
 
 
+template<class TMatrix>
 void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelInitial
-(const MatrixX& M, const VectorX& b, VectorX& x, const int numIteration)
+(const TMatrix& M, const VectorX& b, VectorX& x, const ConstraintIsland& island, const int numIteration)
 {
     const int size = globalNumConstraintVectors + globalNumFrictionVectors;
 
-    const double rstep = 1.0 / (numIteration * size);
+    const double rstep = 1.0 / (numIteration * island.size());
     double r = 0.0;
 
+    const int numFrictionIndices = island.frictionIndices.size();
+
     for(int i=0; i < numIteration; ++i){
 
-        for(int j=0; j < globalNumContactNormalVectors; ++j){
+        for(auto& j : island.contactNormalIndices){
 
             double xx;
-            if(M(j,j)==numeric_limits<double>::max()){
+            if(getDiagonalElement(M, j)==numeric_limits<double>::max()){
                 xx=0.0;
             } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                xx = (-b(j) - sum) / M(j, j);
+                double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                xx = (-b(j) - sum) / getDiagonalElement(M, j);
             }
             if(xx < 0.0){
                 x(j) = 0.0;
@@ -1945,48 +2472,41 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelInitial
             mcpHi[j] = contactIndexToMu[j] * x(j);
         }
 
-        for(int j=globalNumContactNormalVectors; j < globalNumConstraintVectors; ++j){
+        for(auto& j : island.nonContactNormalIndices){
 
-            if(M(j,j)==numeric_limits<double>::max()){
+            if(getDiagonalElement(M, j)==numeric_limits<double>::max()){
                 x(j) = 0.0;
             } else {
-                double sum = -M(j, j) * x(j);
-                for(int k=0; k < size; ++k){
-                    sum += M(j, k) * x(k);
-                }
-                x(j) = r * (-b(j) - sum) / M(j, j);
+                double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                x(j) = r * (-b(j) - sum) / getDiagonalElement(M, j);
             }
             r += rstep;
         }
 
         if(ENABLE_TRUE_FRICTION_CONE){
 
-            int contactIndex = 0;
-            for(int j=globalNumConstraintVectors; j < size; ++j, ++contactIndex){
+            for(int k=0; k < numFrictionIndices; ++k){
+
+                int j = island.frictionIndices[k];
+                const int contactIndex = frictionIndexToContactIndex[j - globalNumConstraintVectors];
 
                 double fx0;
-                if(M(j,j)==numeric_limits<double>::max())
+                if(getDiagonalElement(M, j)==numeric_limits<double>::max())
                     fx0 = 0.0;
                 else{
-                    double sum = -M(j, j) * x(j);
-                    for(int k=0; k < size; ++k){
-                        sum += M(j, k) * x(k);
-                    }
-                    fx0 = (-b(j) - sum) / M(j, j);
+                    double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                    fx0 = (-b(j) - sum) / getDiagonalElement(M, j);
                 }
                 double& fx = x(j);
 
-                ++j;
+                j = island.frictionIndices[++k];
 
                 double fy0;
-                if(M(j,j)==numeric_limits<double>::max())
+                if(getDiagonalElement(M, j)==numeric_limits<double>::max())
                     fy0 = 0.0;
                 else{
-                    double sum = -M(j, j) * x(j);
-                    for(int k=0; k < size; ++k){
-                        sum += M(j, k) * x(k);
-                    }
-                    fy0 = (-b(j) - sum) / M(j, j);
+                    double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                    fy0 = (-b(j) - sum) / getDiagonalElement(M, j);
                 }
                 double& fy = x(j);
 
@@ -2007,21 +2527,17 @@ void ConstraintForceSolver::Impl::solveMCPByProjectedGaussSeidelInitial
 
         } else {
 
-            int frictionIndex = 0;
-            for(int j=globalNumConstraintVectors; j < size; ++j, ++frictionIndex){
+            for(auto& j : island.frictionIndices){
 
                 double xx;
-                if(M(j,j)==numeric_limits<double>::max())
+                if(getDiagonalElement(M, j)==numeric_limits<double>::max())
                     xx = 0.0;
                 else{
-                    double sum = -M(j, j) * x(j);
-                    for(int k=0; k < size; ++k){
-                        sum += M(j, k) * x(k);
-                    }
-                    xx = (-b(j) - sum) / M(j, j);
+                    double sum = calcRowProductWithoutDiagonal(M, x, j, size);
+                    xx = (-b(j) - sum) / getDiagonalElement(M, j);
                 }
 
-                const int contactIndex = frictionIndexToContactIndex[frictionIndex];
+                const int contactIndex = frictionIndexToContactIndex[j - globalNumConstraintVectors];
                 const double fmax = mcpHi[contactIndex];
                 const double fmin = (STATIC_FRICTION_BY_TWO_CONSTRAINTS ? -fmax : 0.0);
 
@@ -2340,6 +2856,30 @@ void ConstraintForceSolver::solve()
 }
 
 
+void ConstraintForceSolver::setStatisticsEnabled(bool on)
+{
+    impl->isStatisticsEnabled = on;
+}
+
+
+bool ConstraintForceSolver::isStatisticsEnabled() const
+{
+    return impl->isStatisticsEnabled;
+}
+
+
+const ConstraintForceSolver::Statistics& ConstraintForceSolver::statistics() const
+{
+    return impl->statistics;
+}
+
+
+void ConstraintForceSolver::clearStatistics()
+{
+    impl->statistics = Statistics();
+}
+
+
 void ConstraintForceSolver::clearExternalForces()
 {
     for(auto& body : impl->world.bodies()){
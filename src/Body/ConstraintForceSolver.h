@@ -59,6 +59,26 @@ public:
     void solve();
     void clearExternalForces();
 
+    /**
+       Statistics accumulated over the steps solved while the statistics are enabled.
+       The times are in seconds.
+    */
+    struct Statistics
+    {
+        int numSteps;
+        double collisionDetectionTime;
+        double lcpBuildingTime;
+        double lcpSolvingTime;
+        long numContacts;
+        long numConstraintIslands;
+        long numGaussSeidelIterations;
+    };
+
+    void setStatisticsEnabled(bool on);
+    bool isStatisticsEnabled() const;
+    const Statistics& statistics() const;
+    void clearStatistics();
+
     std::shared_ptr<CollisionLinkPairList> getCollisions();
 
     // experimental functions
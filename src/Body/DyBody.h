@@ -57,6 +57,7 @@ private:
     bool isTestForceBeingApplied;
     Vector3 dpf;
     Vector3 dptau;
+    std::vector<int> constrainedLinkPairIndices;
 
     void initialize(DyLink* rootLink, std::multimap<Link*, ForceSensor*>& forceSensorMap);
     void extractLinksInSubBody(
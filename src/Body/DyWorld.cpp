@@ -1,4 +1,5 @@
 #include "DyWorld.h"
+#include <cnoid/TaskScheduler>
 
 using namespace std;
 using namespace cnoid;
@@ -18,6 +19,8 @@ DyWorldBase::DyWorldBase()
     sensorsAreEnabled = false;
     isOldAccelSensorCalcMode = false;
     numRegisteredLinkPairs = 0;
+    numThreads_ = 0;
+    isParallelIntegrationEnabled = false;
 }
 
 
@@ -34,6 +37,7 @@ void DyWorldBase::clearBodies()
     subBodies_.clear();
     bodies_.clear();
     hasHighGainDynamics_ = false;
+    isParallelIntegrationEnabled = false;
 }
 
 
@@ -77,8 +81,16 @@ void DyWorldBase::setOldAccelSensorCalcMode(bool on)
 }
 
 
+void DyWorldBase::setNumThreads(int n)
+{
+    numThreads_ = n;
+}
+
+
 void DyWorldBase::initialize()
 {
+    isParallelIntegrationEnabled = (numThreads_ > 1 && bodies_.size() > 1);
+    
     for(auto& subBody : subBodies_){
         auto forwardDynamics = subBody->forwardDynamics();
         if(isEulerMethod){
@@ -105,8 +117,17 @@ void DyWorldBase::setVirtualJointForces()
 
 void DyWorldBase::calcNextState()
 {
-    for(auto& subBody : subBodies_){
-        subBody->forwardDynamics()->calcNextState();
+    if(isParallelIntegrationEnabled){
+        forEachBodyInParallel(
+            [](DyBody* body){
+                for(auto& subBody : body->subBodies()){
+                    subBody->forwardDynamics()->calcNextState();
+                }
+            });
+    } else {
+        for(auto& subBody : subBodies_){
+            subBody->forwardDynamics()->calcNextState();
+        }
     }
     currentTime_ += timeStep_;
 }
@@ -114,12 +135,40 @@ void DyWorldBase::calcNextState()
 
 void DyWorldBase::refreshState()
 {
-    for(auto& subBody : subBodies_){
-        subBody->forwardDynamics()->refreshState();
+    if(isParallelIntegrationEnabled){
+        forEachBodyInParallel(
+            [](DyBody* body){
+                for(auto& subBody : body->subBodies()){
+                    subBody->forwardDynamics()->refreshState();
+                }
+            });
+    } else {
+        for(auto& subBody : subBodies_){
+            subBody->forwardDynamics()->refreshState();
+        }
     }
 }
 
 
+/**
+   The bodies are taken by the worker threads of the shared task scheduler and the calling
+   thread one by one so that the load is balanced even if the bodies have different numbers of links.
+   The sub bodies of a body are not split into different threads because the sensor
+   simulation of the root sub body refers to the links of the other sub bodies.
+*/
+void DyWorldBase::forEachBodyInParallel(const std::function<void(DyBody* body)>& func)
+{
+    TaskScheduler::instance()->parallelFor(
+        0, bodies_.size(), 1,
+        [&](int begin, int end){
+            for(int i = begin; i < end; ++i){
+                func(bodies_[i]);
+            }
+        },
+        numThreads_);
+}
+
+
 int DyWorldBase::addBody(DyBody* body)
 {
     int index = bodies_.size();
@@ -5,6 +5,7 @@
 #include "ExtraJoint.h"
 #include <string>
 #include <map>
+#include <functional>
 #include "exportdecl.h"
 
 namespace cnoid {
@@ -70,6 +71,17 @@ public:
     */
     void setRungeKuttaMethod();
 
+    /**
+       \brief Set the number of threads used to integrate the bodies in parallel
+       \param n The number of threads including the calling thread. Zero or one disables the parallel integration.
+       \note The sub bodies of a body are always integrated in the same thread in their order,
+       so the result is identical to the sequential integration.
+       The constraint force solver also uses the threads to solve the independent contact islands.
+       This must be called before initialize() is called.
+    */
+    void setNumThreads(int n);
+    int numThreads() const { return numThreads_; }
+
     /**
        \brief initialize this world. This must be called after all bodies are registered.
     */
@@ -122,7 +134,11 @@ private:
 
     std::vector<ExtraJointPtr> extraJoints_;
 
-    void extractInternalBodies(Link* link);    
+    int numThreads_;
+    bool isParallelIntegrationEnabled;
+
+    void extractInternalBodies(Link* link);
+    void forEachBodyInParallel(const std::function<void(DyBody* body)>& func);
 };
 
 template <class TConstraintForceSolver> class DyWorld : public DyWorldBase
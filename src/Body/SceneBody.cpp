@@ -495,6 +495,9 @@ void SceneBody::cloneShapes(CloneMap& cloneMap)
 
 void SceneBody::updateLinkPositions(SgUpdateRef update)
 {
+    // The upper nodes are notified once instead of once per link
+    SgUpdateBatch updateBatch;
+
     // Main body
     impl->updateLinkPositions(body_, sceneLinks_, update);
 
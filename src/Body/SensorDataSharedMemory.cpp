@@ -0,0 +1,555 @@
+#include "SensorDataSharedMemory.h"
+#include <cnoid/Image>
+#include <cnoid/Format>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <new>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#endif
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+size_t alignedSize(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+constexpr size_t SlotAlignment = 64;
+
+static_assert(sizeof(Vector3f) == sizeof(float) * 3, "Vector3f must consist of three packed floats.");
+
+#ifndef _WIN32
+
+bool isObjectOfName(const string& name, const struct stat& status)
+{
+    bool isSame = false;
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd >= 0){
+        struct stat current;
+        isSame = (fstat(fd, &current) == 0 &&
+                  current.st_dev == status.st_dev && current.st_ino == status.st_ino);
+        ::close(fd);
+    }
+    return isSame;
+}
+
+
+/**
+   Removes the existing object of the name if it has been created by a writer process which
+   no longer exists. The object of a living writer and an object which is not created by
+   the writer are not removed.
+   \return true if the object has been removed
+*/
+bool removeObjectLeftByDeadWriter(const string& name)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0){
+        return false;
+    }
+    bool removed = false;
+    struct stat status;
+    const size_t headerSize = sizeof(SensorDataSharedMemoryHeader);
+    if(fstat(fd, &status) == 0 && status.st_size >= static_cast<off_t>(headerSize)){
+        void* memory = mmap(nullptr, headerSize, PROT_READ, MAP_SHARED, fd, 0);
+        if(memory != MAP_FAILED){
+            auto header = static_cast<const SensorDataSharedMemoryHeader*>(memory);
+            if(header->magic == SensorDataSharedMemoryHeader::Magic){
+                std::atomic_thread_fence(std::memory_order_acquire);
+                pid_t pid = header->writerProcessId;
+                if(pid > 0 && kill(pid, 0) != 0 && errno == ESRCH){
+                    // Check that the name has not been taken by another writer in the meantime
+                    if(isObjectOfName(name, status)){
+                        removed = (shm_unlink(name.c_str()) == 0);
+                    }
+                }
+            }
+            munmap(memory, headerSize);
+        }
+    }
+    ::close(fd);
+    return removed;
+}
+
+#endif
+
+}
+
+namespace cnoid {
+
+class SensorDataSharedMemoryWriter::Impl
+{
+public:
+    string name;
+    string errorMessage;
+    int fd;
+    void* memory;
+    size_t memorySize;
+    SensorDataSharedMemoryHeader* header;
+    unsigned char* slots;
+    uint32_t imageOffset;
+    uint32_t pointsOffset;
+    uint32_t rangeDataOffset;
+    size_t maxImageSize;
+    size_t maxNumPoints;
+    size_t maxNumRangeData;
+
+    Impl();
+    bool open(const string& name, int numSlots, size_t maxImageSize, size_t maxNumPoints, size_t maxNumRangeData);
+    void close();
+    bool write(double time, const Image* image, const vector<Vector3f>* points, const vector<double>* rangeData);
+};
+
+
+class SensorDataSharedMemoryReader::Impl
+{
+public:
+    string errorMessage;
+    int fd;
+    const void* memory;
+    size_t memorySize;
+    const SensorDataSharedMemoryHeader* header;
+    const unsigned char* slots;
+
+    Impl();
+    bool open(const string& name);
+    void close();
+};
+
+}
+
+
+SensorDataSharedMemoryWriter::SensorDataSharedMemoryWriter()
+{
+    impl = new Impl;
+}
+
+
+SensorDataSharedMemoryWriter::Impl::Impl()
+{
+    fd = -1;
+    memory = nullptr;
+    memorySize = 0;
+    header = nullptr;
+    slots = nullptr;
+}
+
+
+SensorDataSharedMemoryWriter::~SensorDataSharedMemoryWriter()
+{
+    impl->close();
+    delete impl;
+}
+
+
+bool SensorDataSharedMemoryWriter::open
+(const std::string& name, int numSlots, size_t maxImageSize, size_t maxNumPoints, size_t maxNumRangeData)
+{
+    return impl->open(name, numSlots, maxImageSize, maxNumPoints, maxNumRangeData);
+}
+
+
+bool SensorDataSharedMemoryWriter::Impl::open
+(const string& name, int numSlots, size_t maxImageSize, size_t maxNumPoints, size_t maxNumRangeData)
+{
+    close();
+    errorMessage.clear();
+
+    if(numSlots < 1){
+        numSlots = 1;
+    }
+    this->maxImageSize = maxImageSize;
+    this->maxNumPoints = maxNumPoints;
+    this->maxNumRangeData = maxNumRangeData;
+
+    size_t size = alignedSize(sizeof(SensorDataFrameHeader), SlotAlignment);
+    imageOffset = maxImageSize > 0 ? size : 0;
+    size = alignedSize(size + maxImageSize, 16);
+    pointsOffset = maxNumPoints > 0 ? size : 0;
+    size = alignedSize(size + maxNumPoints * sizeof(float) * 3, 16);
+    rangeDataOffset = maxNumRangeData > 0 ? size : 0;
+    size = alignedSize(size + maxNumRangeData * sizeof(double), SlotAlignment);
+    const size_t slotSize = size;
+
+    if(slotSize > std::numeric_limits<uint32_t>::max()){
+        errorMessage = formatR(_("The frame size of shared memory \"{0}\" is too large."), name);
+        return false;
+    }
+
+#ifdef _WIN32
+    errorMessage = formatR(_("Shared memory \"{0}\" cannot be created because the POSIX shared memory is not available."), name);
+    return false;
+#else
+    /*
+      The object is created exclusively so that a writer never takes over the object of another
+      writer. An existing object is only replaced when the writer process which created it no
+      longer exists. The readers of the replaced object must reopen the new one.
+    */
+    fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0 && errno == EEXIST){
+        if(removeObjectLeftByDeadWriter(name)){
+            fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        } else {
+            errno = EEXIST;
+        }
+    }
+    if(fd < 0){
+        if(errno == EEXIST){
+            errorMessage = formatR(_("Shared memory \"{0}\" cannot be created because it is used by another writer."), name);
+        } else {
+            errorMessage = formatR(_("Shared memory \"{0}\" cannot be created. {1}"), name, strerror(errno));
+        }
+        return false;
+    }
+    this->name = name;
+
+    memorySize = alignedSize(sizeof(SensorDataSharedMemoryHeader), SlotAlignment) + slotSize * numSlots;
+    if(ftruncate(fd, memorySize) != 0){
+        errorMessage = formatR(_("Shared memory \"{0}\" cannot be allocated. {1}"), name, strerror(errno));
+        close();
+        return false;
+    }
+    memory = mmap(nullptr, memorySize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED){
+        memory = nullptr;
+        errorMessage = formatR(_("Shared memory \"{0}\" cannot be mapped. {1}"), name, strerror(errno));
+        close();
+        return false;
+    }
+    std::memset(memory, 0, memorySize);
+
+    auto bytes = static_cast<unsigned char*>(memory);
+    slots = bytes + alignedSize(sizeof(SensorDataSharedMemoryHeader), SlotAlignment);
+    for(int i=0; i < numSlots; ++i){
+        auto frame = new(slots + slotSize * i) SensorDataFrameHeader;
+        frame->sequence.store(0, std::memory_order_relaxed);
+    }
+
+    header = new(memory) SensorDataSharedMemoryHeader;
+    header->version = SensorDataSharedMemoryHeader::Version;
+    header->numSlots = numSlots;
+    header->writerProcessId = getpid();
+    header->slotSize = slotSize;
+    header->frameCount.store(0, std::memory_order_relaxed);
+    // The magic number is written last so that a reader does not use the uninitialized header
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SensorDataSharedMemoryHeader::Magic;
+
+    return true;
+#endif
+}
+
+
+void SensorDataSharedMemoryWriter::close()
+{
+    impl->close();
+}
+
+
+void SensorDataSharedMemoryWriter::Impl::close()
+{
+#ifndef _WIN32
+    if(memory){
+        munmap(memory, memorySize);
+        memory = nullptr;
+    }
+    if(fd >= 0){
+        // The name may refer to the object of another writer if this object has been replaced
+        struct stat status;
+        if(fstat(fd, &status) == 0 && isObjectOfName(name, status)){
+            shm_unlink(name.c_str());
+        }
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    header = nullptr;
+    slots = nullptr;
+    name.clear();
+}
+
+
+bool SensorDataSharedMemoryWriter::isOpen() const
+{
+    return impl->header != nullptr;
+}
+
+
+const std::string& SensorDataSharedMemoryWriter::name() const
+{
+    return impl->name;
+}
+
+
+const std::string& SensorDataSharedMemoryWriter::errorMessage() const
+{
+    return impl->errorMessage;
+}
+
+
+bool SensorDataSharedMemoryWriter::write
+(double time, const Image* image, const std::vector<Vector3f>* points, const std::vector<double>* rangeData)
+{
+    return impl->write(time, image, points, rangeData);
+}
+
+
+bool SensorDataSharedMemoryWriter::Impl::write
+(double time, const Image* image, const vector<Vector3f>* points, const vector<double>* rangeData)
+{
+    if(!header){
+        return false;
+    }
+
+    size_t imageSize = 0;
+    if(image && !image->empty()){
+        imageSize = image->width() * image->height() * image->numComponents();
+        if(imageSize > maxImageSize){
+            return false;
+        }
+    }
+    if(points && points->size() > maxNumPoints){
+        return false;
+    }
+    if(rangeData && rangeData->size() > maxNumRangeData){
+        return false;
+    }
+
+    const uint64_t frameIndex = header->frameCount.load(std::memory_order_relaxed);
+    unsigned char* slot = slots + header->slotSize * (frameIndex % header->numSlots);
+    auto frame = reinterpret_cast<SensorDataFrameHeader*>(slot);
+
+    const uint64_t sequence = frame->sequence.load(std::memory_order_relaxed);
+    frame->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    frame->frameIndex = frameIndex;
+    frame->time = time;
+
+    if(imageSize > 0){
+        frame->imageWidth = image->width();
+        frame->imageHeight = image->height();
+        frame->numImageComponents = image->numComponents();
+        frame->imageOffset = imageOffset;
+        std::memcpy(slot + imageOffset, image->pixels(), imageSize);
+    } else {
+        frame->imageWidth = 0;
+        frame->imageHeight = 0;
+        frame->numImageComponents = 0;
+        frame->imageOffset = 0;
+    }
+
+    if(points && !points->empty()){
+        frame->pointsOffset = pointsOffset;
+        frame->numPoints = points->size();
+        std::memcpy(slot + pointsOffset, points->data(), points->size() * sizeof(Vector3f));
+    } else {
+        frame->pointsOffset = 0;
+        frame->numPoints = 0;
+    }
+
+    if(rangeData && !rangeData->empty()){
+        frame->rangeDataOffset = rangeDataOffset;
+        frame->numRangeData = rangeData->size();
+        std::memcpy(slot + rangeDataOffset, rangeData->data(), rangeData->size() * sizeof(double));
+    } else {
+        frame->rangeDataOffset = 0;
+        frame->numRangeData = 0;
+    }
+
+    frame->sequence.store(sequence + 2, std::memory_order_release);
+    header->frameCount.store(frameIndex + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+SensorDataSharedMemoryReader::SensorDataSharedMemoryReader()
+{
+    impl = new Impl;
+}
+
+
+SensorDataSharedMemoryReader::Impl::Impl()
+{
+    fd = -1;
+    memory = nullptr;
+    memorySize = 0;
+    header = nullptr;
+    slots = nullptr;
+}
+
+
+SensorDataSharedMemoryReader::~SensorDataSharedMemoryReader()
+{
+    impl->close();
+    delete impl;
+}
+
+
+bool SensorDataSharedMemoryReader::open(const std::string& name)
+{
+    return impl->open(name);
+}
+
+
+bool SensorDataSharedMemoryReader::Impl::open(const string& name)
+{
+    close();
+    errorMessage.clear();
+
+#ifdef _WIN32
+    errorMessage = formatR(_("Shared memory \"{0}\" cannot be opened because the POSIX shared memory is not available."), name);
+    return false;
+#else
+    fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0){
+        errorMessage = formatR(_("Shared memory \"{0}\" cannot be opened. {1}"), name, strerror(errno));
+        return false;
+    }
+    struct stat status;
+    if(fstat(fd, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(SensorDataSharedMemoryHeader)){
+        errorMessage = formatR(_("Shared memory \"{0}\" has not been initialized."), name);
+        close();
+        return false;
+    }
+    memorySize = status.st_size;
+    memory = mmap(nullptr, memorySize, PROT_READ, MAP_SHARED, fd, 0);
+    if(memory == MAP_FAILED){
+        memory = nullptr;
+        errorMessage = formatR(_("Shared memory \"{0}\" cannot be mapped. {1}"), name, strerror(errno));
+        close();
+        return false;
+    }
+
+    auto h = static_cast<const SensorDataSharedMemoryHeader*>(memory);
+    if(h->magic != SensorDataSharedMemoryHeader::Magic){
+        errorMessage = formatR(_("Shared memory \"{0}\" has not been initialized."), name);
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(h->version != SensorDataSharedMemoryHeader::Version){
+        errorMessage = formatR(_("The version of shared memory \"{0}\" is not supported."), name);
+        close();
+        return false;
+    }
+    const size_t slotOffset = alignedSize(sizeof(SensorDataSharedMemoryHeader), SlotAlignment);
+    if(slotOffset + h->slotSize * h->numSlots > memorySize){
+        errorMessage = formatR(_("Shared memory \"{0}\" is broken."), name);
+        close();
+        return false;
+    }
+    header = h;
+    slots = static_cast<const unsigned char*>(memory) + slotOffset;
+
+    return true;
+#endif
+}
+
+
+void SensorDataSharedMemoryReader::close()
+{
+    impl->close();
+}
+
+
+void SensorDataSharedMemoryReader::Impl::close()
+{
+#ifndef _WIN32
+    if(memory){
+        munmap(const_cast<void*>(memory), memorySize);
+        memory = nullptr;
+    }
+    if(fd >= 0){
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    header = nullptr;
+    slots = nullptr;
+}
+
+
+bool SensorDataSharedMemoryReader::isOpen() const
+{
+    return impl->header != nullptr;
+}
+
+
+const std::string& SensorDataSharedMemoryReader::errorMessage() const
+{
+    return impl->errorMessage;
+}
+
+
+uint64_t SensorDataSharedMemoryReader::frameCount() const
+{
+    if(!impl->header){
+        return 0;
+    }
+    return impl->header->frameCount.load(std::memory_order_acquire);
+}
+
+
+const SensorDataFrameHeader* SensorDataSharedMemoryReader::latestFrame(uint64_t& out_sequence) const
+{
+    auto header = impl->header;
+    if(!header){
+        return nullptr;
+    }
+    const uint64_t n = header->frameCount.load(std::memory_order_acquire);
+    if(n == 0){
+        return nullptr;
+    }
+    auto frame = reinterpret_cast<const SensorDataFrameHeader*>(
+        impl->slots + header->slotSize * ((n - 1) % header->numSlots));
+    out_sequence = frame->sequence.load(std::memory_order_acquire);
+    if(out_sequence & 1){
+        return nullptr;
+    }
+    return frame;
+}
+
+
+bool SensorDataSharedMemoryReader::isValid(const SensorDataFrameHeader* frame, uint64_t sequence) const
+{
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return frame->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+
+const unsigned char* SensorDataSharedMemoryReader::imagePixels(const SensorDataFrameHeader* frame)
+{
+    if(!frame->imageOffset){
+        return nullptr;
+    }
+    return reinterpret_cast<const unsigned char*>(frame) + frame->imageOffset;
+}
+
+
+const float* SensorDataSharedMemoryReader::points(const SensorDataFrameHeader* frame)
+{
+    if(!frame->pointsOffset){
+        return nullptr;
+    }
+    return reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(frame) + frame->pointsOffset);
+}
+
+
+const double* SensorDataSharedMemoryReader::rangeData(const SensorDataFrameHeader* frame)
+{
+    if(!frame->rangeDataOffset){
+        return nullptr;
+    }
+    return reinterpret_cast<const double*>(reinterpret_cast<const unsigned char*>(frame) + frame->rangeDataOffset);
+}
@@ -0,0 +1,148 @@
+#ifndef CNOID_BODY_SENSOR_DATA_SHARED_MEMORY_H
+#define CNOID_BODY_SENSOR_DATA_SHARED_MEMORY_H
+
+#include <cnoid/EigenTypes>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class Image;
+
+/**
+   The layout of a shared memory object where the frames of a vision sensor are published.
+   The object consists of this header followed by numSlots slots of slotSize bytes, and each
+   slot begins with a SensorDataFrameHeader. The frames are written into the slots in turn and
+   frameCount is incremented after each frame is written, so the latest frame is stored in
+   the slot of index (frameCount - 1) % numSlots.
+
+   Only the plain types and the lock-free atomic integers are used in the layout so that
+   the processes which do not link this library can also map the object.
+*/
+struct SensorDataSharedMemoryHeader
+{
+    static constexpr uint32_t Magic = 0x44534e43; // "CNSD"
+    static constexpr uint32_t Version = 1;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numSlots;
+    // The process ID of the writer, which is used to detect an object left by a dead writer
+    int32_t writerProcessId;
+    uint64_t slotSize;
+    std::atomic<uint64_t> frameCount;
+};
+
+/**
+   The header of a frame slot. The sequence counter works as a sequence lock. It is odd while
+   the frame is being written and it is incremented to an even value when the writing has been
+   completed. A reader must read the counter before and after accessing the frame data and
+   must discard the data when the counter is odd or it has been changed.
+
+   The data of each type is stored at the given offset from the beginning of the slot.
+   The offset of the data which is not included in the frame is zero.
+*/
+struct SensorDataFrameHeader
+{
+    std::atomic<uint64_t> sequence;
+    uint64_t frameIndex;
+    // The time when the data was captured by the sensor in the simulation
+    double time;
+    // The image stored as the rows of the pixels from the top
+    int32_t imageWidth;
+    int32_t imageHeight;
+    int32_t numImageComponents;
+    uint32_t imageOffset;
+    // The points of a range camera stored as the arrays of three floats
+    uint32_t pointsOffset;
+    uint32_t numPoints;
+    // The range data of a range sensor stored as the array of doubles
+    uint32_t rangeDataOffset;
+    uint32_t numRangeData;
+};
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "The shared memory of the sensor data requires the lock-free 64-bit atomic integers."
+#endif
+
+/**
+   This class creates a shared memory object of the POSIX shared memory and publishes the
+   frames of a vision sensor to it. Each frame is written to the shared memory only once and
+   the consumer processes on the same host can access the frame data by mapping the object
+   without any serialization.
+*/
+class CNOID_EXPORT SensorDataSharedMemoryWriter
+{
+public:
+    SensorDataSharedMemoryWriter();
+    ~SensorDataSharedMemoryWriter();
+
+    /**
+       \param name The name of the shared memory object, which begins with a slash
+       \param numSlots The number of the frame slots of the ring buffer
+       \param maxImageSize The maximum byte size of the image data
+       \param maxNumPoints The maximum number of the points
+       \param maxNumRangeData The maximum number of the range data elements
+    */
+    bool open(const std::string& name, int numSlots, size_t maxImageSize, size_t maxNumPoints, size_t maxNumRangeData);
+    void close();
+    bool isOpen() const;
+    const std::string& name() const;
+    const std::string& errorMessage() const;
+
+    //! The null pointers can be given to the data which is not included in the frame
+    bool write(double time, const Image* image, const std::vector<Vector3f>* points, const std::vector<double>* rangeData);
+
+private:
+    class Impl;
+    Impl* impl;
+};
+
+/**
+   This class maps a shared memory object created by SensorDataSharedMemoryWriter.
+   The frame data can be accessed directly in the mapped memory as follows.
+
+   \code
+   uint64_t sequence;
+   if(auto frame = reader.latestFrame(sequence)){
+       // Access the frame data
+       if(reader.isValid(frame, sequence)){
+           // The accessed data is consistent
+       }
+   }
+   \endcode
+*/
+class CNOID_EXPORT SensorDataSharedMemoryReader
+{
+public:
+    SensorDataSharedMemoryReader();
+    ~SensorDataSharedMemoryReader();
+
+    bool open(const std::string& name);
+    void close();
+    bool isOpen() const;
+    const std::string& errorMessage() const;
+
+    //! The number of the frames published so far
+    uint64_t frameCount() const;
+
+    //! \return nullptr if no frame has been published or the latest frame is being written.
+    const SensorDataFrameHeader* latestFrame(uint64_t& out_sequence) const;
+
+    bool isValid(const SensorDataFrameHeader* frame, uint64_t sequence) const;
+
+    static const unsigned char* imagePixels(const SensorDataFrameHeader* frame);
+    static const float* points(const SensorDataFrameHeader* frame);
+    static const double* rangeData(const SensorDataFrameHeader* frame);
+
+private:
+    class Impl;
+    Impl* impl;
+};
+
+}
+
+#endif
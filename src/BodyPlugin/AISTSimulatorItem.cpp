@@ -92,6 +92,7 @@ public:
     bool isKinematicWalkingEnabled;
     bool isOldAccelSensorMode;
     bool hasNonRootFreeJoints;
+    int numDynamicsThreads;
 
     stdx::optional<int> forcedBodyPositionFunctionId;
     std::mutex forcedBodyPositionMutex;
@@ -164,6 +165,7 @@ AISTSimulatorItem::Impl::Impl(AISTSimulatorItem* self)
     is2Dmode = false;
     isOldAccelSensorMode = false;
     hasNonRootFreeJoints = false;
+    numDynamicsThreads = 0;
 
     mv = MessageView::instance();
 }
@@ -195,6 +197,7 @@ AISTSimulatorItem::Impl::Impl(AISTSimulatorItem* self, const Impl& org)
     isKinematicWalkingEnabled = org.isKinematicWalkingEnabled;
     is2Dmode = org.is2Dmode;
     isOldAccelSensorMode = org.isOldAccelSensorMode;
+    numDynamicsThreads = org.numDynamicsThreads;
 
     mv = MessageView::instance();
 }
@@ -325,6 +328,18 @@ void AISTSimulatorItem::setKinematicWalkingEnabled(bool on)
 }
 
 
+void AISTSimulatorItem::setNumDynamicsThreads(int n)
+{
+    impl->numDynamicsThreads = n;
+}
+
+
+int AISTSimulatorItem::numDynamicsThreads() const
+{
+    return impl->numDynamicsThreads;
+}
+
+
 void AISTSimulatorItem::setConstraintForceOutputEnabled(bool /* on */)
 {
 
@@ -415,6 +430,7 @@ bool AISTSimulatorItem::Impl::initializeSimulation(const std::vector<SimulationB
     world.setGravityAcceleration(gravity);
     world.enableSensors(true);
     world.setOldAccelSensorCalcMode(isOldAccelSensorMode);
+    world.setNumThreads(numDynamicsThreads);
     world.setTimeStep(self->worldTimeStep());
     world.setCurrentTime(0.0);
 
@@ -724,6 +740,7 @@ void AISTSimulatorItem::Impl::doPutProperties(PutPropertyFunction& putProperty)
                 changeProperty(isKinematicWalkingEnabled));
     putProperty(_("2D mode"), is2Dmode, changeProperty(is2Dmode));
     putProperty(_("Old accel sensor mode"), isOldAccelSensorMode, changeProperty(isOldAccelSensorMode));
+    putProperty.min(0)(_("Dynamics threads"), numDynamicsThreads, changeProperty(numDynamicsThreads));
 }
 
 
@@ -750,6 +767,9 @@ bool AISTSimulatorItem::Impl::store(Archive& archive)
     archive.write("kinematicWalking", isKinematicWalkingEnabled);
     archive.write("2Dmode", is2Dmode);
     archive.write("oldAccelSensorMode", isOldAccelSensorMode);
+    if(numDynamicsThreads > 0){
+        archive.write("num_dynamics_threads", numDynamicsThreads);
+    }
     return true;
 }
 
@@ -786,5 +806,6 @@ bool AISTSimulatorItem::Impl::restore(const Archive& archive)
     archive.read("kinematicWalking", isKinematicWalkingEnabled);
     archive.read("2Dmode", is2Dmode);
     archive.read("oldAccelSensorMode", isOldAccelSensorMode);
+    archive.read("num_dynamics_threads", numDynamicsThreads);
     return true;
 }
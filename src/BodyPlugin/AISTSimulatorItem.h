@@ -49,6 +49,13 @@ public:
     void set2Dmode(bool on);
     void setKinematicWalkingEnabled(bool on);
 
+    /**
+       Set the number of threads used to integrate the bodies in parallel.
+       Zero or one disables the parallel integration, which is the default.
+    */
+    void setNumDynamicsThreads(int n);
+    int numDynamicsThreads() const;
+
     [[deprecated("This function does nothing. Set Link::LinkContactState to Link::sensingMode from a controller.")]]
     void setConstraintForceOutputEnabled(bool on);
 
@@ -21,6 +21,8 @@
 #include "BodyContactPointLogItem.h"
 #include "SubSimulatorItem.h"
 #include "GLVisionSimulatorItem.h"
+#include "RayCastVisionSimulatorItem.h"
+#include "SensorSharedMemoryPublisherItem.h"
 #include "SimulationScriptItem.h"
 #include "BodyMotionItem.h"
 #include "ZMPSeqItem.h"
@@ -120,6 +122,8 @@ bool BodyPlugin::initialize()
     BodyContactPointLogItem::initializeClass(this);
     SubSimulatorItem::initializeClass(this);
     GLVisionSimulatorItem::initializeClass(this);
+    RayCastVisionSimulatorItem::initializeClass(this);
+    SensorSharedMemoryPublisherItem::initializeClass(this);
     SimulationScriptItem::initializeClass(this);
     BodyMotionItem::initializeClass(this);
     BodyMotionEngine::initializeClass(this);
@@ -22,6 +22,7 @@
 #include <cnoid/EigenUtil>
 #include <cnoid/StringUtil>
 #include <cnoid/Tokenizer>
+#include <cnoid/TaskScheduler>
 #include <cnoid/Format>
 #include <cnoid/EigenArchive>
 #include <QThread>
@@ -29,6 +30,7 @@
 #include <QOpenGLContext>
 #include <QOffscreenSurface>
 #include <QOpenGLFramebufferObject>
+#include <QOpenGLBuffer>
 #include <mutex>
 #include <condition_variable>
 #include <queue>
@@ -46,6 +48,11 @@ constexpr bool PUT_DEBUG_MESSAGES = false;
 // This does not seem to be necessary
 constexpr bool USE_FLUSH_GL_FUNCTION = false;
 
+// The rows of a range camera image are unprojected by the tasks in the unit of this number of rows
+constexpr int NumRowsPerUnprojectionChunk = 32;
+constexpr int MaxNumUnprojectionThreads = 4;
+constexpr int UnprojectionBlockSize = 64;
+
 enum ScreenId {
     NO_SCREEN = FisheyeLensConverter::NO_SCREEN,
     FRONT_SCREEN = FisheyeLensConverter::FRONT_SCREEN,
@@ -141,6 +148,25 @@ public:
 
     bool hasUpdatedData;
     double depthError;
+
+    // The onset time of the frame being rendered and that of the data stored in the tmp buffers
+    double renderingOnsetTime;
+    double dataOnsetTime;
+
+    // Pixel buffer objects used as a ring buffer to read back the pixels asynchronously
+    struct ReadbackBuffer {
+        QOpenGLBuffer colorBuffer;
+        QOpenGLBuffer depthBuffer;
+        double onsetTime;
+        bool isPending;
+        ReadbackBuffer()
+            : colorBuffer(QOpenGLBuffer::PixelPackBuffer),
+              depthBuffer(QOpenGLBuffer::PixelPackBuffer),
+              onsetTime(0.0),
+              isPending(false) { }
+    };
+    vector<std::unique_ptr<ReadbackBuffer>> readbackBuffers;
+    int readbackBufferIndex;
     
     QOpenGLContext* glContext;
     QOffscreenSurface* offscreenSurface;
@@ -164,6 +190,13 @@ public:
     std::uniform_real_distribution<> detectionProbability;
     std::normal_distribution<> distanceErrorDistribution;
 
+    // Unprojection table of the range camera
+    Matrix4f unprojectionMatrix;
+    vector<float> unprojectionColumnTerms;
+    vector<float> unprojectionRowTerms;
+    vector<std::mt19937> unprojectionRandomNumbers;
+    vector<int> numRowPoints;
+
     SensorScreenRenderer(GLVisionSimulatorItem::Impl* simImpl, Device* device, Device* deviceForRendering);
     ~SensorScreenRenderer();
     bool initialize(SensorScenePtr scene, int bodyIndex);
@@ -177,10 +210,19 @@ public:
     void doneGLContextCurrent();
     void render(SensorScreenRenderer*& currentGLContextScreen);
     void finalizeRendering();
+    void initializeReadbackBuffers();
     void storeResultToTmpDataBuffer();
+    void storeResultToTmpDataBufferAsynchronously();
     bool getCameraImage(Image& image);
+    void copyFlippedCameraImage(const unsigned char* pixels, Image& image);
     bool getRangeCameraData(Image& image, vector<Vector3f>& points);
+    bool convertRangeCameraData(const unsigned char* colors, const float* depths, Image& image, vector<Vector3f>& points);
+    void updateRangeCameraUnprojectionTable();
+    bool unprojectRangeCameraRow(
+        int row, const float* depths, const unsigned char* colors, std::mt19937& randomNumber,
+        vector<Vector3f>& points, unsigned char* pixels);
     bool getRangeSensorData(vector<double>& rangeData);
+    bool convertRangeSensorData(const float* depths, vector<double>& rangeData);
     void putRangeSensorDataAsDebugMessages(
         int px, int py, double pitchAngle, double yawAngle, float depth, double z, double distance);
 };
@@ -272,6 +314,7 @@ public:
     bool areAdditionalLightsEnabled;
     double maxFrameRate;
     double maxLatency;
+    int numReadbackBuffers;
     CloneMap cloneMap;
     bool isAntiAliasingEnabled;
         
@@ -334,6 +377,7 @@ GLVisionSimulatorItem::Impl::Impl(GLVisionSimulatorItem* self)
     areAdditionalLightsEnabled = true;
     maxFrameRate = 1000.0;
     maxLatency = 1.0;
+    numReadbackBuffers = 1;
 
     threadMode.setSymbol(GLVisionSimulatorItem::SINGLE_THREAD_MODE, N_("Single"));
     threadMode.setSymbol(GLVisionSimulatorItem::SENSOR_THREAD_MODE, N_("Sensor"));
@@ -375,6 +419,7 @@ GLVisionSimulatorItem::Impl::Impl(GLVisionSimulatorItem* self, const Impl& org)
     areAdditionalLightsEnabled = org.areAdditionalLightsEnabled;
     maxFrameRate = org.maxFrameRate;
     maxLatency = org.maxLatency;
+    numReadbackBuffers = org.numReadbackBuffers;
     isAntiAliasingEnabled = org.isAntiAliasingEnabled;
 }
 
@@ -423,6 +468,12 @@ void GLVisionSimulatorItem::setMaxLatency(double latency)
 }
 
 
+void GLVisionSimulatorItem::setNumReadbackBuffers(int n)
+{
+    impl->setProperty(impl->numReadbackBuffers, std::max(1, std::min(n, 3)));
+}
+
+
 void GLVisionSimulatorItem::setVisionDataRecordingEnabled(bool on)
 {
     impl->setProperty(impl->isVisionDataRecordingEnabled, on);
@@ -865,6 +916,8 @@ bool SensorScreenRenderer::initialize(SensorScenePtr scene, int bodyIndex)
     }
 
     hasUpdatedData = false;
+    renderingOnsetTime = 0.0;
+    dataOnsetTime = 0.0;
 
     return true;
 }
@@ -900,12 +953,6 @@ SgCamera* SensorScreenRenderer::initializeCamera(int bodyIndex)
                 pixelHeight = cameraForRendering->resolutionY();
             }
         }
-        if(rangeCamera){
-            if(rangeCamera->errorDeviation() > 0.0){
-                distanceErrorDistribution.param(
-                    std::normal_distribution<>::param_type(0.0, rangeCamera->errorDeviation()));
-            }
-        }
     } else if(rangeSensor){
         auto sceneLink = sceneBody->sceneLink(rangeSensor->link()->index());
         if(sceneLink){
@@ -1058,11 +1105,44 @@ bool SensorScreenRenderer::initializeGL(SgCamera* sceneCamera)
         renderer->enableAdditionalLights(simImpl->areAdditionalLightsEnabled);
     }
 
+    initializeReadbackBuffers();
+
     doneGLContextCurrent();
     return true;
 }
 
 
+void SensorScreenRenderer::initializeReadbackBuffers()
+{
+    readbackBuffers.clear();
+    readbackBufferIndex = 0;
+
+    if(simImpl->numReadbackBuffers < 2){
+        return;
+    }
+    const bool readsColors = cameraForRendering && cameraForRendering->imageType() == Camera::COLOR_IMAGE;
+    const bool readsDepths = rangeCameraForRendering || rangeSensorForRendering;
+    
+    for(int i=0; i < simImpl->numReadbackBuffers; ++i){
+        auto buffer = new ReadbackBuffer;
+        if(readsColors){
+            buffer->colorBuffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+            buffer->colorBuffer.create();
+            buffer->colorBuffer.bind();
+            buffer->colorBuffer.allocate(pixelWidth * pixelHeight * 3);
+        }
+        if(readsDepths){
+            buffer->depthBuffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+            buffer->depthBuffer.create();
+            buffer->depthBuffer.bind();
+            buffer->depthBuffer.allocate(pixelWidth * pixelHeight * sizeof(float));
+        }
+        readbackBuffers.emplace_back(buffer);
+    }
+    QOpenGLBuffer::release(QOpenGLBuffer::PixelPackBuffer);
+}
+
+
 void SensorScreenRenderer::finalizeGL(bool doMakeCurrent)
 {
     if(glContext){
@@ -1073,6 +1153,7 @@ void SensorScreenRenderer::finalizeGL(bool doMakeCurrent)
             delete renderer;
             renderer = nullptr;
         }
+        readbackBuffers.clear();
         if(frameBuffer){
             frameBuffer->release();
             delete frameBuffer;
@@ -1255,6 +1336,9 @@ void SensorRenderer::updateSensorScene(bool updateSensorForRenderingThread)
     for(auto& scene : scenes){
         scene->updateScene(simImpl->currentTime);
     }
+    for(auto& screen : screens){
+        screen->renderingOnsetTime = onsetTime;
+    }
     if(updateSensorForRenderingThread){
         deviceForRendering->copyStateFrom(*device);
     }
@@ -1369,6 +1453,13 @@ void SensorScreenRenderer::finalizeRendering()
 
 void SensorScreenRenderer::storeResultToTmpDataBuffer()
 {
+    if(!readbackBuffers.empty()){
+        storeResultToTmpDataBufferAsynchronously();
+        return;
+    }
+
+    dataOnsetTime = renderingOnsetTime;
+
     if(cameraForRendering){
         if(!tmpImage){
             tmpImage = std::make_shared<Image>();
@@ -1386,6 +1477,79 @@ void SensorScreenRenderer::storeResultToTmpDataBuffer()
 }
 
 
+/**
+   The pixels of the current frame are transferred to a pixel buffer object without waiting
+   for the transfer to finish, and the pixels of the oldest frame in the ring buffer, which
+   have been transferred while the later frames were rendered, are converted to the data.
+   The data is delayed by the number of the buffers minus one frames.
+*/
+void SensorScreenRenderer::storeResultToTmpDataBufferAsynchronously()
+{
+    auto& current = *readbackBuffers[readbackBufferIndex];
+    if(current.colorBuffer.isCreated()){
+        current.colorBuffer.bind();
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    }
+    if(current.depthBuffer.isCreated()){
+        current.depthBuffer.bind();
+        glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+    }
+    current.onsetTime = renderingOnsetTime;
+    current.isPending = true;
+
+    readbackBufferIndex = (readbackBufferIndex + 1) % readbackBuffers.size();
+    auto& oldest = *readbackBuffers[readbackBufferIndex];
+
+    hasUpdatedData = false;
+
+    if(oldest.isPending){
+        const unsigned char* colors = nullptr;
+        const float* depths = nullptr;
+        bool mapped = true;
+        if(oldest.colorBuffer.isCreated()){
+            oldest.colorBuffer.bind();
+            colors = static_cast<const unsigned char*>(oldest.colorBuffer.map(QOpenGLBuffer::ReadOnly));
+            mapped = mapped && colors;
+        }
+        if(oldest.depthBuffer.isCreated()){
+            oldest.depthBuffer.bind();
+            depths = static_cast<const float*>(oldest.depthBuffer.map(QOpenGLBuffer::ReadOnly));
+            mapped = mapped && depths;
+        }
+        if(mapped){
+            if(cameraForRendering){
+                if(!tmpImage){
+                    tmpImage = std::make_shared<Image>();
+                }
+                if(rangeCameraForRendering){
+                    tmpPoints = std::make_shared<vector<Vector3f>>();
+                    hasUpdatedData = convertRangeCameraData(colors, depths, *tmpImage, *tmpPoints);
+                } else if(colors){
+                    copyFlippedCameraImage(colors, *tmpImage);
+                    hasUpdatedData = true;
+                }
+            } else if(rangeSensorForRendering){
+                tmpRangeData = std::make_shared<vector<double>>();
+                hasUpdatedData = convertRangeSensorData(depths, *tmpRangeData);
+            }
+            dataOnsetTime = oldest.onsetTime;
+        }
+        if(colors){
+            oldest.colorBuffer.bind();
+            oldest.colorBuffer.unmap();
+        }
+        if(depths){
+            oldest.depthBuffer.bind();
+            oldest.depthBuffer.unmap();
+        }
+        oldest.isPending = false;
+    }
+
+    QOpenGLBuffer::release(QOpenGLBuffer::PixelPackBuffer);
+}
+
+
 void GLVisionSimulatorItem::Impl::onPostDynamics()
 {
     if(useThreadsForSensors){
@@ -1530,7 +1694,7 @@ void SensorRenderer::copyVisionData()
     }
 
     if(hasUpdatedData){
-        double delay = simImpl->currentTime - onsetTime;
+        double delay = simImpl->currentTime - screens.front()->dataOnsetTime;
         if(camera){
             auto lensType = camera->lensType();
             if(lensType == Camera::NORMAL_LENS){
@@ -1607,58 +1771,239 @@ bool SensorScreenRenderer::getCameraImage(Image& image)
 }
 
 
-bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& points)
+//! The rows are copied in the reverse order so that the image does not have to be flipped after the copy.
+void SensorScreenRenderer::copyFlippedCameraImage(const unsigned char* pixels, Image& image)
 {
-    unsigned char* pixels = nullptr;
+    image.setSize(pixelWidth, pixelHeight, 3);
+    const int rowSize = pixelWidth * 3;
+    unsigned char* dest = image.pixels();
+    for(int y = pixelHeight - 1; y >= 0; --y){
+        std::copy(pixels + y * rowSize, pixels + (y + 1) * rowSize, dest);
+        dest += rowSize;
+    }
+}
+
 
+bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& points)
+{
     const bool extractColors = (cameraForRendering->imageType() == Camera::COLOR_IMAGE);
     if(extractColors){
         glPixelStorei(GL_PACK_ALIGNMENT, 1);
         colorBuf.resize(pixelWidth * pixelHeight * 3 * sizeof(unsigned char));
         glReadPixels(0, 0, pixelWidth, pixelHeight, GL_RGB, GL_UNSIGNED_BYTE, &colorBuf[0]);
+    }
+
+    depthBuf.resize(pixelWidth * pixelHeight * sizeof(float));
+    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
+
+    return convertRangeCameraData(extractColors ? &colorBuf[0] : nullptr, &depthBuf[0], image, points);
+}
+
+
+bool SensorScreenRenderer::convertRangeCameraData
+(const unsigned char* colors, const float* depths, Image& image, vector<Vector3f>& points)
+{
+    const bool extractColors = (colors != nullptr);
+    if(extractColors){
         if(rangeCameraForRendering->isOrganized()){
             image.setSize(pixelWidth, pixelHeight, 3);
         } else {
             image.setSize(pixelWidth * pixelHeight, 1, 3);
         }
-        pixels = image.pixels();
     }
 
-    depthBuf.resize(pixelWidth * pixelHeight * sizeof(float));
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
+    updateRangeCameraUnprojectionTable();
+
+    // Each row is written to its own region and the regions are packed after the unprojection
+    points.resize(pixelWidth * pixelHeight);
+    numRowPoints.resize(pixelHeight);
+
+    const int numChunks = unprojectionRandomNumbers.size();
+    vector<char> isChunkDense(numChunks, true);
+    TaskScheduler::instance()->parallelFor(
+        0, numChunks, 1,
+        [&](int chunkBegin, int chunkEnd){
+            for(int chunk = chunkBegin; chunk < chunkEnd; ++chunk){
+                const int rowBegin = chunk * NumRowsPerUnprojectionChunk;
+                const int rowEnd = std::min(rowBegin + NumRowsPerUnprojectionChunk, pixelHeight);
+                bool isDense = true;
+                for(int row = rowBegin; row < rowEnd; ++row){
+                    if(!unprojectRangeCameraRow(
+                           row, depths, colors, unprojectionRandomNumbers[chunk],
+                           points, extractColors ? image.pixels() : nullptr)){
+                        isDense = false;
+                    }
+                }
+                isChunkDense[chunk] = isDense;
+            }
+        },
+        MaxNumUnprojectionThreads);
+
+    isDense = std::find(isChunkDense.begin(), isChunkDense.end(), false) == isChunkDense.end();
+
+    int numPoints = 0;
+    for(int row=0; row < pixelHeight; ++row){
+        const int n = numRowPoints[row];
+        const int offset = row * pixelWidth;
+        if(offset != numPoints){
+            std::copy(points.begin() + offset, points.begin() + offset + n, points.begin() + numPoints);
+            if(extractColors){
+                unsigned char* pixels = image.pixels();
+                std::copy(pixels + offset * 3, pixels + (offset + n) * 3, pixels + numPoints * 3);
+            }
+        }
+        numPoints += n;
+    }
+    points.resize(numPoints);
+
+    if(extractColors && !rangeCameraForRendering->isOrganized()){
+        image.setSize(numPoints, 1, 3);
+    }
+
+    return true;
+}
+
+
+/**
+   The unprojection of the pixel (x, y) with the normalized depth z is P^-1 * (nx, ny, nz, 1),
+   where nx only depends on x and ny only depends on y. The terms of nx and ny are precomputed
+   per column and per row, so only the term of nz is computed for each pixel. The table is
+   updated when the projection matrix or the resolution is changed.
+*/
+void SensorScreenRenderer::updateRangeCameraUnprojectionTable()
+{
+    /*
+      A random number generator is given to each chunk of rows instead of each thread
+      so that the noise does not depend on the scheduling of the threads.
+    */
+    const int numChunks = (pixelHeight + NumRowsPerUnprojectionChunk - 1) / NumRowsPerUnprojectionChunk;
+    if(static_cast<int>(unprojectionRandomNumbers.size()) != numChunks){
+        unprojectionRandomNumbers.resize(numChunks);
+        for(int i=0; i < numChunks; ++i){
+            unprojectionRandomNumbers[i].seed(i);
+        }
+    }
 
     const Matrix4f Pinv = renderer->projectionMatrix().inverse().cast<float>();
+    if(Pinv == unprojectionMatrix &&
+       static_cast<int>(unprojectionColumnTerms.size()) == pixelWidth * 4 &&
+       static_cast<int>(unprojectionRowTerms.size()) == pixelHeight * 4){
+        return;
+    }
+    unprojectionMatrix = Pinv;
+
     const float fw = pixelWidth;
     const float fh = pixelHeight;
-    const int cx = pixelWidth / 2;
-    const int cy = pixelHeight / 2;
-    Matrix3f Ro;
-    bool hasRo = !rangeCameraForRendering->opticalFrameRotation().isIdentity();
-    if(hasRo){
-        Ro = rangeCameraForRendering->opticalFrameRotation().cast<float>();
+
+    // The terms are stored in the structure-of-arrays layout for the vectorization
+    unprojectionColumnTerms.resize(pixelWidth * 4);
+    for(int x=0; x < pixelWidth; ++x){
+        const float nx = 2.0f * x / fw - 1.0f;
+        for(int i=0; i < 4; ++i){
+            unprojectionColumnTerms[i * pixelWidth + x] = Pinv(i, 0) * nx;
+        }
+    }
+    unprojectionRowTerms.resize(pixelHeight * 4);
+    for(int y=0; y < pixelHeight; ++y){
+        const float ny = 2.0f * y / fh - 1.0f;
+        for(int i=0; i < 4; ++i){
+            unprojectionRowTerms[y * 4 + i] = Pinv(i, 1) * ny + Pinv(i, 3);
+        }
     }
+}
+
+
+/**
+   \param row The row index of the frame buffer, whose origin is the bottom left corner.
+   \return false if the row has any invalid point
+*/
+bool SensorScreenRenderer::unprojectRangeCameraRow
+(int row, const float* depthPixels, const unsigned char* colorPixels, std::mt19937& randomNumber,
+ vector<Vector3f>& points, unsigned char* pixels)
+{
+    const int w = pixelWidth;
+    const int outputRow = pixelHeight - 1 - row;
+    const float* depths = depthPixels + row * w;
+    const unsigned char* colors = pixels ? colorPixels + row * w * 3 : nullptr;
+    Vector3f* outputPoints = &points[outputRow * w];
+    unsigned char* outputPixels = pixels ? pixels + outputRow * w * 3 : nullptr;
+
+    const float detectionRate = rangeCameraForRendering->detectionRate();
+    const float errorDeviation = rangeCameraForRendering->errorDeviation();
     const bool isOrganized = rangeCameraForRendering->isOrganized();
-    Vector4f n;
-    n[3] = 1.0f;
-    points.clear();
-    points.reserve(pixelWidth * pixelHeight);
-    unsigned char* colorSrc = nullptr;
+    const bool hasRo = !rangeCameraForRendering->opticalFrameRotation().isIdentity();
+    const Matrix3f Ro = rangeCameraForRendering->opticalFrameRotation().cast<float>();
+    std::uniform_real_distribution<float> probability;
+    std::normal_distribution<float> distanceError(0.0f, std::max(errorDeviation, 1.0e-6f));
+
+    const float* cx = &unprojectionColumnTerms[0];
+    const float* cy = cx + w;
+    const float* cz = cy + w;
+    const float* cw = cz + w;
+    const float rx = unprojectionRowTerms[row * 4 + 0];
+    const float ry = unprojectionRowTerms[row * 4 + 1];
+    const float rz = unprojectionRowTerms[row * 4 + 2];
+    const float rw = unprojectionRowTerms[row * 4 + 3];
+    const float kx = unprojectionMatrix(0, 2);
+    const float ky = unprojectionMatrix(1, 2);
+    const float kz = unprojectionMatrix(2, 2);
+    const float kw = unprojectionMatrix(3, 2);
+
+    const int cx0 = pixelWidth / 2;
+    const int cy0 = pixelHeight / 2;
+    bool isDense = true;
+    int n = 0;
 
-    const double detectionRate = rangeCameraForRendering->detectionRate();
-    const double errorDeviation = rangeCameraForRendering->errorDeviation();
+    /*
+      The pixels are processed in the unit of a block whose intermediate values are stored in
+      the local arrays. The arrays do not alias the other buffers, so the loops without branches
+      can be vectorized by the compiler.
+    */
+    float px[UnprojectionBlockSize];
+    float py[UnprojectionBlockSize];
+    float pz[UnprojectionBlockSize];
+    float detections[UnprojectionBlockSize];
+    float errors[UnprojectionBlockSize];
+
+    for(int blockBegin = 0; blockBegin < w; blockBegin += UnprojectionBlockSize){
+        const int m = std::min(UnprojectionBlockSize, w - blockBegin);
+        const float* d = depths + blockBegin;
+
+        // The random numbers of the block are generated at once
+        if(detectionRate < 1.0f){
+            for(int i=0; i < m; ++i){
+                detections[i] = probability(randomNumber);
+            }
+        }
+        if(errorDeviation > 0.0f){
+            for(int i=0; i < m; ++i){
+                errors[i] = distanceError(randomNumber);
+            }
+        }
 
-    isDense = true;
-    
-    for(int y = pixelHeight - 1; y >= 0; --y){
-        int srcpos = y * pixelWidth;
-        if(extractColors){
-            colorSrc = &colorBuf[0] + y * pixelWidth * 3;
+        for(int i=0; i < m; ++i){
+            const int x = blockBegin + i;
+            const float nz = 2.0f * d[i] - 1.0f;
+            const float iw = 1.0f / (cw[x] + rw + kw * nz);
+            px[i] = (cx[x] + rx + kx * nz) * iw;
+            py[i] = (cy[x] + ry + ky * nz) * iw;
+            pz[i] = (cz[x] + rz + kz * nz) * iw;
+        }
+        if(errorDeviation > 0.0f){
+            for(int i=0; i < m; ++i){
+                const float l = std::sqrt(px[i] * px[i] + py[i] * py[i] + pz[i] * pz[i]);
+                const float s = (l + errors[i]) / l;
+                px[i] *= s;
+                py[i] *= s;
+                pz[i] *= s;
+            }
         }
-        for(int x=0; x < pixelWidth; ++x){
-            float z = depthBuf[srcpos + x];
 
-            if(detectionRate < 1.0){
-                if(detectionProbability(randomNumber) > detectionRate){
+        for(int i=0; i < m; ++i){
+            const int x = blockBegin + i;
+            float z = d[i];
+            if(detectionRate < 1.0f){
+                if(detections[i] > detectionRate){
                     if(!isOrganized){
                         continue;
                     } else {
@@ -1666,76 +2011,59 @@ bool SensorScreenRenderer::getRangeCameraData(Image& image, vector<Vector3f>& po
                     }
                 }
             }
-
+            Vector3f p;
             if(z > 0.0f && z < 1.0f){
-                n.x() = 2.0f * x / fw - 1.0f;
-                n.y() = 2.0f * y / fh - 1.0f;
-                n.z() = 2.0f * z - 1.0f;
-                const Vector4f o = Pinv * n;
-                const float& w = o[3];
-                Vector3f p(o[0] / w, o[1] / w, o[2] / w);
-
-                if(errorDeviation > 0.0){
-                    double d = p.norm();
-                    double r = (d + distanceErrorDistribution(randomNumber)) / d;
-                    p *= r;
-                }
-
-                if(hasRo){
-                    points.push_back(Ro * p);
-                } else {
-                    points.push_back(p);
-                }
-                if(pixels){
-                    pixels[0] = colorSrc[0];
-                    pixels[1] = colorSrc[1];
-                    pixels[2] = colorSrc[2];
-                    pixels += 3;
-                }
+                p << px[i], py[i], pz[i];
             } else if(isOrganized){
-                Vector3f p;
                 if(z <= 0.0f){
                     p.z() = numeric_limits<float>::infinity();
                 } else {
                     p.z() = -numeric_limits<float>::infinity();
                 }
-                if(x == cx){
+                if(x == cx0){
                     p.x() = 0.0;
                 } else {
-                    p.x() = (x - cx) * numeric_limits<float>::infinity();
+                    p.x() = (x - cx0) * numeric_limits<float>::infinity();
                 }
-                if(y == cy){
+                if(row == cy0){
                     p.y() = 0.0;
                 } else {
-                    p.y() = (y - cy) * numeric_limits<float>::infinity();
-                }
-                if(pixels){
-                    pixels[0] = colorSrc[0];
-                    pixels[1] = colorSrc[1];
-                    pixels[2] = colorSrc[2];
-                    pixels += 3;
+                    p.y() = (row - cy0) * numeric_limits<float>::infinity();
                 }
                 isDense = false;
-                if(hasRo){
-                    points.push_back(Ro * p);
-                } else {
-                    points.push_back(p);
-                }
+            } else {
+                continue;
             }
-            
-            colorSrc += 3;
+            if(hasRo){
+                outputPoints[n] = Ro * p;
+            } else {
+                outputPoints[n] = p;
+            }
+            if(outputPixels){
+                outputPixels[n * 3 + 0] = colors[x * 3 + 0];
+                outputPixels[n * 3 + 1] = colors[x * 3 + 1];
+                outputPixels[n * 3 + 2] = colors[x * 3 + 2];
+            }
+            ++n;
         }
     }
 
-    if(extractColors && !rangeCameraForRendering->isOrganized()){
-        image.setSize((pixels - image.pixels()) / 3, 1, 3);
-    }
+    numRowPoints[outputRow] = n;
 
-    return true;
+    return isDense;
 }
 
 
 bool SensorScreenRenderer::getRangeSensorData(vector<double>& rangeData)
+{
+    depthBuf.resize(pixelWidth * pixelHeight * sizeof(float));
+    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
+
+    return convertRangeSensorData(&depthBuf[0], rangeData);
+}
+
+
+bool SensorScreenRenderer::convertRangeSensorData(const float* depths, vector<double>& rangeData)
 {
     const double yawRange = rangeSensorForRendering->yawRange();
     const double yawStep = rangeSensorForRendering->yawStep();
@@ -1755,9 +2083,6 @@ bool SensorScreenRenderer::getRangeSensorData(vector<double>& rangeData)
     const double detectionRate = rangeSensorForRendering->detectionRate();
     const double errorDeviation = rangeSensorForRendering->errorDeviation();
 
-    depthBuf.resize(pixelWidth * pixelHeight * sizeof(float));
-    glReadPixels(0, 0, pixelWidth, pixelHeight, GL_DEPTH_COMPONENT, GL_FLOAT, &depthBuf[0]);
-
     rangeData.reserve(numUniqueYawSamples * numPitchSamples);
 
     for(int pitch=0; pitch < numPitchSamples; ++pitch){
@@ -1792,7 +2117,7 @@ bool SensorScreenRenderer::getRangeSensorData(vector<double>& rangeData)
                 px = nearbyint(r * (fw - 1.0));
             }
             //! \todo add the option to do the interpolation between the adjacent two pixel depths
-            const float depth = depthBuf[srcpos + px];
+            const float depth = depths[srcpos + px];
             if(depth <= 0.0f || depth >= 1.0f){
                 rangeData.push_back(std::numeric_limits<double>::infinity());
             } else {                
@@ -1916,6 +2241,8 @@ void GLVisionSimulatorItem::Impl::doPutProperties(PutPropertyFunction& putProper
                 [this](const string& names){ return updateNames(names, sensorNameListString, sensorNames); });
     putProperty(_("Max frame rate"), maxFrameRate, changeProperty(maxFrameRate));
     putProperty(_("Max latency [s]"), maxLatency, changeProperty(maxLatency));
+    putProperty.min(1).max(3)(_("Readback buffers"), numReadbackBuffers, changeProperty(numReadbackBuffers));
+    putProperty.reset();
     putProperty(_("Record vision data"), isVisionDataRecordingEnabled, changeProperty(isVisionDataRecordingEnabled));
     putProperty(_("Thread mode"), threadMode, [this](int index){ return threadMode.select(index); });
     putProperty(_("Best effort"), isBestEffortModeProperty, changeProperty(isBestEffortModeProperty));
@@ -1955,6 +2282,7 @@ bool GLVisionSimulatorItem::Impl::store(Archive& archive)
     writeElements(archive, "target_sensors", sensorNames, true);
     archive.write("max_frame_rate", maxFrameRate);
     archive.write("max_latency", maxLatency);
+    archive.write("readback_buffers", numReadbackBuffers);
     archive.write("record_vision_data", isVisionDataRecordingEnabled);
     archive.write("thread_mode", threadMode.selectedSymbol());
     archive.write("best_effort", isBestEffortModeProperty);
@@ -1986,6 +2314,10 @@ bool GLVisionSimulatorItem::Impl::restore(const Archive& archive)
 
     archive.read({ "max_frame_rate", "maxFrameRate" }, maxFrameRate);
     archive.read({ "max_latency", "maxLatency" }, maxLatency);
+    int n;
+    if(archive.read("readback_buffers", n)){
+        self->setNumReadbackBuffers(n);
+    }
     archive.read({ "record_vision_data", "recordVisionData" }, isVisionDataRecordingEnabled);
     archive.read({ "best_effort", "bestEffort" }, isBestEffortModeProperty);
     archive.read({ "all_scene_objects", "allSceneObjects" }, shootAllSceneObjects);
@@ -22,6 +22,13 @@ public:
     void setTargetSensors(const std::string& sensorNames);
     void setMaxFrameRate(double rate);
     void setMaxLatency(double latency);
+
+    /**
+       \param n The number of the pixel buffer objects used to read back the rendered pixels.
+       One means the synchronous readback. Two or three enable the asynchronous readback,
+       which delays the data by n - 1 frames.
+    */
+    void setNumReadbackBuffers(int n);
     void setVisionDataRecordingEnabled(bool on);
     void setThreadMode(int mode);
     void setBestEffortMode(bool on);
@@ -20,6 +20,7 @@
 #include <cnoid/BodyCollisionDetector>
 #include <cnoid/AISTCollisionDetector>
 #include <cnoid/IdPair>
+#include <cnoid/TaskScheduler>
 #include <cnoid/Format>
 #include <QButtonGroup>
 #include <QDialogButtonBox>
@@ -34,10 +35,32 @@ using namespace cnoid;
 
 namespace {
 
-bool USE_DUPLICATED_BODY = false;
-
 KinematicFaultChecker* checkerInstance = nullptr;
 
+// The minimum number of frames checked by a worker thread
+constexpr int minNumFramesPerThread = 1000;
+
+enum FaultType { PositionFault, VelocityFault, CollisionFault };
+
+struct Fault
+{
+    FaultType type;
+    int frame;
+    // The joint id for the position and velocity faults, or the link indices for a collision
+    int index0;
+    int index1;
+    double value;
+};
+
+struct FrameRangeTask
+{
+    BodyPtr body;
+    unique_ptr<BodyCollisionDetector> bodyCollisionDetector;
+    int beginningFrame;
+    int endingFrame;
+    vector<Fault> faults;
+};
+
 #if defined(_MSC_VER) && _MSC_VER < 1800
 inline long lround(double x) {
     return static_cast<long>((x > 0.0) ? floor(x + 0.5) : ceil(x -0.5));
@@ -72,8 +95,7 @@ public:
     int numFaults;
     vector<int> lastPosFaultFrames;
     vector<int> lastVelFaultFrames;
-    typedef IdPair<CollisionDetector::GeometryHandle> GeometryPair;
-    typedef std::map<GeometryPair, int> LastCollisionFrameMap;
+    typedef std::map<IdPair<int>, int> LastCollisionFrameMap;
     LastCollisionFrameMap lastCollisionFrames;
 
     double frameRate;
@@ -81,6 +103,18 @@ public:
     double translationMargin;
     double velocityLimitRatio;
 
+    // The following variables are shared by the tasks as read-only data
+    shared_ptr<const MultiValueSeq> qseq;
+    shared_ptr<const MultiSE3Seq> pseq;
+    vector<bool> linkSelection;
+    bool checkPosition;
+    bool checkVelocity;
+    bool checkCollision;
+    int numJoints;
+    int numLinks;
+    int beginningFrame;
+    int endingFrame;
+
     Impl();
     bool store(Archive& archive);
     void restore(const Archive& archive);
@@ -89,9 +123,10 @@ public:
         BodyItem* bodyItem, BodyMotionItem* motionItem,
         bool checkPosition, bool checkVelocity, bool checkCollision,
         vector<bool> linkSelection, double beginningTime, double endingTime);
-    void putJointPositionFault(int frame, Link* joint);
-    void putJointVelocityFault(int frame, Link* joint);
-    void putSelfCollision(Body* body, int frame, const CollisionPair& collisionPair);
+    void checkFaultsInFrameRange(FrameRangeTask& task);
+    void putJointPositionFault(int frame, Link* joint, double q);
+    void putJointVelocityFault(int frame, Link* joint, double dq);
+    void putSelfCollision(int frame, Link* link0, Link* link1);
 };
 
 }
@@ -346,43 +381,65 @@ int KinematicFaultChecker::Impl::checkFaults
     auto body = bodyItem->body();
     auto motion = motionItem->motion();
     motion->updateLinkPosSeqAndJointPosSeqWithBodyStateSeq();
-    auto qseq = motion->jointPosSeq();;
-    auto pseq = motion->linkPosSeq();
+    qseq = motion->jointPosSeq();
+    pseq = motion->linkPosSeq();
     
     if((!checkPosition && !checkVelocity && !checkCollision) || body->isStaticModel() || !qseq->getNumFrames()){
         return numFaults;
     }
 
-    BodyState orgKinematicState;
-    
-    if(USE_DUPLICATED_BODY){
-        body = body->clone();
-    } else {
-        bodyItem->storeKinematicState(orgKinematicState);
-    }
-
-    BodyCollisionDetector bodyCollisionDetector;
-    WorldItem* worldItem = bodyItem->findOwnerItem<WorldItem>();
-    if(worldItem){
-        bodyCollisionDetector.setCollisionDetector(worldItem->collisionDetector()->clone());
-    } else {
-        bodyCollisionDetector.setCollisionDetector(new AISTCollisionDetector);
-    }
-
-    bodyCollisionDetector.addBody(body, true);
-    bodyCollisionDetector.makeReady();
+    this->checkPosition = checkPosition;
+    this->checkVelocity = checkVelocity;
+    this->checkCollision = checkCollision;
+    this->linkSelection = linkSelection;
 
-    const int numJoints = std::min(body->numJoints(), qseq->numParts());
-    const int numLinks = std::min(body->numLinks(), pseq->numParts());
+    numJoints = std::min(body->numJoints(), qseq->numParts());
+    numLinks = std::min(body->numLinks(), pseq->numParts());
 
     frameRate = motion->frameRate();
-    double stepRatio2 = 2.0 / frameRate;
     angleMargin = radian(angleMarginSpin.value());
     translationMargin = translationMarginSpin.value();
     velocityLimitRatio = velocityLimitRatioSpin.value() / 100.0;
 
-    int beginningFrame = std::max(0, (int)(beginningTime * frameRate));
-    int endingFrame = std::min((motion->numFrames() - 1), (int)lround(endingTime * frameRate));
+    beginningFrame = std::max(0, (int)(beginningTime * frameRate));
+    endingFrame = std::min((motion->numFrames() - 1), (int)lround(endingTime * frameRate));
+
+    /*
+      The frame range is divided into the sub ranges checked by the tasks of the task scheduler.
+      Each task has its own body clone and collision detector, and the faults detected
+      by the tasks are put in the frame order after all the tasks finish.
+    */
+    const int numFrames = endingFrame - beginningFrame + 1;
+    auto scheduler = TaskScheduler::instance();
+    int numThreads = scheduler->numThreads() + 1;
+    numThreads = std::max(1, std::min(numThreads, numFrames / minNumFramesPerThread));
+
+    WorldItem* worldItem = bodyItem->findOwnerItem<WorldItem>();
+    vector<FrameRangeTask> tasks(numThreads);
+    int frame = beginningFrame;
+    for(int i=0; i < numThreads; ++i){
+        auto& task = tasks[i];
+        task.body = body->clone();
+        if(checkCollision){
+            task.bodyCollisionDetector = make_unique<BodyCollisionDetector>();
+            if(worldItem){
+                task.bodyCollisionDetector->setCollisionDetector(worldItem->collisionDetector()->clone());
+            } else {
+                task.bodyCollisionDetector->setCollisionDetector(new AISTCollisionDetector);
+            }
+        }
+        task.beginningFrame = frame;
+        frame += numFrames / numThreads + ((i < numFrames % numThreads) ? 1 : 0);
+        task.endingFrame = frame - 1;
+    }
+
+    scheduler->parallelFor(
+        0, numThreads, 1,
+        [&](int begin, int end){
+            for(int i = begin; i < end; ++i){
+                checkFaultsInFrameRange(tasks[i]);
+            }
+        });
 
     lastPosFaultFrames.clear();
     lastPosFaultFrames.resize(numJoints, std::numeric_limits<int>::min());
@@ -390,13 +447,49 @@ int KinematicFaultChecker::Impl::checkFaults
     lastVelFaultFrames.resize(numJoints, std::numeric_limits<int>::min());
     lastCollisionFrames.clear();
 
-    if(checkCollision){
+    for(auto& task : tasks){
+        for(auto& fault : task.faults){
+            switch(fault.type){
+            case PositionFault:
+                putJointPositionFault(fault.frame, body->joint(fault.index0), fault.value);
+                break;
+            case VelocityFault:
+                putJointVelocityFault(fault.frame, body->joint(fault.index0), fault.value);
+                break;
+            case CollisionFault:
+                putSelfCollision(fault.frame, body->link(fault.index0), body->link(fault.index1));
+                break;
+            }
+        }
+    }
+
+    qseq.reset();
+    pseq.reset();
+
+    return numFaults;
+}
+
+
+/**
+   This function is executed in parallel by the task scheduler. The faults are only stored in the task,
+   and the messages are output by the main thread.
+*/
+void KinematicFaultChecker::Impl::checkFaultsInFrameRange(FrameRangeTask& task)
+{
+    Body* body = task.body;
+    auto& faults = task.faults;
+    const double stepRatio2 = 2.0 / frameRate;
+    
+    BodyCollisionDetector* bodyCollisionDetector = task.bodyCollisionDetector.get();
+    if(bodyCollisionDetector){
+        bodyCollisionDetector->addBody(body, true);
+        bodyCollisionDetector->makeReady();
         Link* root = body->rootLink();
         root->p().setZero();
         root->R().setIdentity();
     }
         
-    for(int frame = beginningFrame; frame <= endingFrame; ++frame){
+    for(int frame = task.beginningFrame; frame <= task.endingFrame; ++frame){
 
         int prevFrame = (frame == beginningFrame) ? beginningFrame : frame - 1;
         int nextFrame = (frame == endingFrame) ? endingFrame : frame + 1;
@@ -414,20 +507,20 @@ int KinematicFaultChecker::Impl::checkFaults
                         fault = (q > (joint->q_upper() - translationMargin) || q < (joint->q_lower() + translationMargin));
                     }
                     if(fault){
-                        putJointPositionFault(frame, joint);
+                        faults.push_back({ PositionFault, frame, joint->jointId(), -1, q });
                     }
                 }
                 if(checkVelocity){
                     double dq = (qseq->at(nextFrame, i) - qseq->at(prevFrame, i)) / stepRatio2;
                     joint->dq() = dq;
                     if(dq > (joint->dq_upper() * velocityLimitRatio) || dq < (joint->dq_lower() * velocityLimitRatio)){
-                        putJointVelocityFault(frame, joint);
+                        faults.push_back({ VelocityFault, frame, joint->jointId(), -1, dq });
                     }
                 }
             }
         }
 
-        if(checkCollision){
+        if(bodyCollisionDetector){
 
             Link* link = body->link(0);
             if(!pseq->empty())
@@ -454,34 +547,29 @@ int KinematicFaultChecker::Impl::checkFaults
                 }
             }
 
-            bodyCollisionDetector.updatePositions();
+            bodyCollisionDetector->updatePositions();
 
-            bodyCollisionDetector.detectCollisions(
+            bodyCollisionDetector->detectCollisions(
                 [&](const CollisionPair& collisionPair){
-                    putSelfCollision(body, frame, collisionPair);
+                    auto link0 = static_cast<Link*>(collisionPair.object(0));
+                    auto link1 = static_cast<Link*>(collisionPair.object(1));
+                    faults.push_back({ CollisionFault, frame, link0->index(), link1->index(), 0.0 });
                 });
         }
     }
-
-    if(!USE_DUPLICATED_BODY){
-        bodyItem->restoreKinematicState(orgKinematicState);
-    }
-
-    return numFaults;
 }
 
 
-void KinematicFaultChecker::Impl::putJointPositionFault(int frame, Link* joint)
+void KinematicFaultChecker::Impl::putJointPositionFault(int frame, Link* joint, double q)
 {
     if(frame > lastPosFaultFrames[joint->jointId()] + 1){
-        double q, l, u, m;
+        double l, u, m;
         if(joint->isRevoluteJoint()){
-            q = degree(joint->q());
+            q = degree(q);
             l = degree(joint->q_lower());
             u = degree(joint->q_upper());
             m = degree(angleMargin);
         } else {
-            q = joint->q();
             l = joint->q_lower();
             u = joint->q_upper();
             m = translationMargin;
@@ -501,16 +589,15 @@ void KinematicFaultChecker::Impl::putJointPositionFault(int frame, Link* joint)
 }
 
 
-void KinematicFaultChecker::Impl::putJointVelocityFault(int frame, Link* joint)
+void KinematicFaultChecker::Impl::putJointVelocityFault(int frame, Link* joint, double dq)
 {
     if(frame > lastVelFaultFrames[joint->jointId()] + 1){
-        double dq, l, u;
+        double l, u;
         if(joint->isRevoluteJoint()){
-            dq = degree(joint->dq());
+            dq = degree(dq);
             l = degree(joint->dq_lower());
             u = degree(joint->dq_upper());
         } else {
-            dq = joint->dq();
             l = joint->dq_lower();
             u = joint->dq_upper();
         }
@@ -527,14 +614,14 @@ void KinematicFaultChecker::Impl::putJointVelocityFault(int frame, Link* joint)
 }
 
 
-void KinematicFaultChecker::Impl::putSelfCollision(Body* body, int frame, const CollisionPair& collisionPair)
+void KinematicFaultChecker::Impl::putSelfCollision(int frame, Link* link0, Link* link1)
 {
     bool putMessage = false;
-    GeometryPair gPair(collisionPair.geometries());
-    auto p = lastCollisionFrames.find(gPair);
+    IdPair<int> linkPair(link0->index(), link1->index());
+    auto p = lastCollisionFrames.find(linkPair);
     if(p == lastCollisionFrames.end()){
         putMessage = true;
-        lastCollisionFrames[gPair] = frame;
+        lastCollisionFrames[linkPair] = frame;
     } else {
         if(frame > p->second + 1){
             putMessage = true;
@@ -543,8 +630,6 @@ void KinematicFaultChecker::Impl::putSelfCollision(Body* body, int frame, const
     }
 
     if(putMessage){
-        Link* link0 = static_cast<Link*>(collisionPair.object(0));
-        Link* link1 = static_cast<Link*>(collisionPair.object(1));
         os << formatR(_("{0:7.3f} [s]: Collision between {1} and {2}"),
                       (frame / frameRate), link0->name(), link1->name()) << endl;
         numFaults++;
@@ -0,0 +1,1389 @@
+#include "RayCastVisionSimulatorItem.h"
+#include "SimulatorItem.h"
+#include "WorldItem.h"
+#include "BodyItem.h"
+#include <cnoid/ItemManager>
+#include <cnoid/MessageView>
+#include <cnoid/PutPropertyFunction>
+#include <cnoid/Archive>
+#include <cnoid/ValueTreeUtil>
+#include <cnoid/RenderableItem>
+#include <cnoid/Body>
+#include <cnoid/RangeCamera>
+#include <cnoid/RangeSensor>
+#include <cnoid/MeshExtractor>
+#include <cnoid/SceneDrawables>
+#include <cnoid/Image>
+#include <cnoid/EigenUtil>
+#include <cnoid/StringUtil>
+#include <cnoid/Tokenizer>
+#include <cnoid/TaskScheduler>
+#include <cnoid/Format>
+#include <atomic>
+#include <set>
+#include <unordered_map>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+// The number of the triangles tested at once by the ray-triangle intersection kernel
+constexpr int TriangleBlockSize = 4;
+
+// The minimum number of the rays cast by a job of the worker threads
+constexpr int MinNumRaysPerJob = 256;
+
+constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+string getNameListString(const vector<string>& names)
+{
+    string nameList;
+    if(!names.empty()){
+        size_t n = names.size() - 1;
+        for(size_t i=0; i < n; ++i){
+            nameList += names[i];
+            nameList += ", ";
+        }
+        nameList += names.back();
+    }
+    return nameList;
+}
+
+bool updateNames(const string& nameListString, string& out_newNameListString, vector<string>& out_names)
+{
+    out_names.clear();
+    for(auto& token : Tokenizer<CharSeparator<char>>(nameListString, CharSeparator<char>(","))){
+        auto name = trimmed(token);
+        if(!name.empty()){
+            out_names.push_back(name);
+        }
+    }
+    out_newNameListString = nameListString;
+    return true;
+}
+
+
+struct BvhNode
+{
+    Vector3f min;
+    Vector3f max;
+    // The index of the first primitive for a leaf node, or the index of the second child for an inner node.
+    // The first child of an inner node is always placed just after the node.
+    int index;
+    // The number of the primitives for a leaf node. Zero for an inner node.
+    int count;
+};
+
+
+/**
+   Bounding volume hierarchy built by splitting the primitives at the median of the longest axis.
+   The primitive indices of the leaf nodes are stored in the order vector.
+*/
+class BvhBuilder
+{
+public:
+    vector<BvhNode>& nodes;
+    vector<int>& order;
+    const vector<Vector3f>& mins;
+    const vector<Vector3f>& maxs;
+    vector<Vector3f> centers;
+    int maxLeafSize;
+
+    BvhBuilder(vector<BvhNode>& nodes, vector<int>& order,
+               const vector<Vector3f>& mins, const vector<Vector3f>& maxs, int maxLeafSize)
+        : nodes(nodes), order(order), mins(mins), maxs(maxs), maxLeafSize(maxLeafSize)
+    {
+        const int n = mins.size();
+        centers.resize(n);
+        order.resize(n);
+        for(int i=0; i < n; ++i){
+            centers[i] = (mins[i] + maxs[i]) * 0.5f;
+            order[i] = i;
+        }
+        nodes.clear();
+        if(n > 0){
+            nodes.reserve(2 * (n / std::max(1, maxLeafSize - 1)) + 1);
+            build(0, n);
+        }
+    }
+
+    int build(int begin, int end)
+    {
+        const int nodeIndex = nodes.size();
+        nodes.emplace_back();
+
+        Vector3f min = mins[order[begin]];
+        Vector3f max = maxs[order[begin]];
+        Vector3f cmin = centers[order[begin]];
+        Vector3f cmax = cmin;
+        for(int i = begin + 1; i < end; ++i){
+            const int p = order[i];
+            min = min.cwiseMin(mins[p]);
+            max = max.cwiseMax(maxs[p]);
+            cmin = cmin.cwiseMin(centers[p]);
+            cmax = cmax.cwiseMax(centers[p]);
+        }
+        nodes[nodeIndex].min = min;
+        nodes[nodeIndex].max = max;
+
+        if(end - begin <= maxLeafSize){
+            nodes[nodeIndex].index = begin;
+            nodes[nodeIndex].count = end - begin;
+        } else {
+            int axis;
+            (cmax - cmin).maxCoeff(&axis);
+            const int mid = (begin + end) / 2;
+            std::nth_element(
+                order.begin() + begin, order.begin() + mid, order.begin() + end,
+                [this, axis](int a, int b){ return centers[a][axis] < centers[b][axis]; });
+            build(begin, mid);
+            const int secondChild = build(mid, end);
+            nodes[nodeIndex].index = secondChild;
+            nodes[nodeIndex].count = 0;
+        }
+        return nodeIndex;
+    }
+};
+
+
+struct Ray
+{
+    Vector3f origin;
+    Vector3f direction;
+    Vector3f invDirection;
+
+    void set(const Vector3f& o, const Vector3f& d){
+        origin = o;
+        direction = d;
+        invDirection = d.cwiseInverse();
+    }
+};
+
+
+bool intersectBox(const BvhNode& node, const Ray& ray, float tmin, float tmax, float& out_tnear)
+{
+    for(int i=0; i < 3; ++i){
+        float t0 = (node.min[i] - ray.origin[i]) * ray.invDirection[i];
+        float t1 = (node.max[i] - ray.origin[i]) * ray.invDirection[i];
+        if(t0 > t1){
+            std::swap(t0, t1);
+        }
+        // The comparisons are written so that NaN values do not shrink the range
+        tmin = t0 > tmin ? t0 : tmin;
+        tmax = t1 < tmax ? t1 : tmax;
+        if(tmin > tmax){
+            return false;
+        }
+    }
+    out_tnear = tmin;
+    return true;
+}
+
+
+/**
+   Triangles stored in the structure-of-arrays layout so that the intersection test of
+   the triangles in a block can be vectorized by the compiler. The unused slots are filled
+   with degenerate triangles, which are never hit.
+*/
+struct TriangleBlock
+{
+    alignas(16) float v0[3][TriangleBlockSize];
+    alignas(16) float e1[3][TriangleBlockSize];
+    alignas(16) float e2[3][TriangleBlockSize];
+    unsigned char colors[TriangleBlockSize][3];
+};
+
+
+int intersectTriangleBlock(const TriangleBlock& block, const Ray& ray, float tmin, float& io_tmax)
+{
+    alignas(16) float distances[TriangleBlockSize];
+
+    const float dx = ray.direction.x();
+    const float dy = ray.direction.y();
+    const float dz = ray.direction.z();
+    const float tmax = io_tmax;
+
+    // Möller-Trumbore algorithm without branches
+    for(int i=0; i < TriangleBlockSize; ++i){
+        const float e1x = block.e1[0][i];
+        const float e1y = block.e1[1][i];
+        const float e1z = block.e1[2][i];
+        const float e2x = block.e2[0][i];
+        const float e2y = block.e2[1][i];
+        const float e2z = block.e2[2][i];
+        const float px = dy * e2z - dz * e2y;
+        const float py = dz * e2x - dx * e2z;
+        const float pz = dx * e2y - dy * e2x;
+        const float det = e1x * px + e1y * py + e1z * pz;
+        const float invDet = 1.0f / det;
+        const float sx = ray.origin.x() - block.v0[0][i];
+        const float sy = ray.origin.y() - block.v0[1][i];
+        const float sz = ray.origin.z() - block.v0[2][i];
+        const float u = (sx * px + sy * py + sz * pz) * invDet;
+        const float qx = sy * e1z - sz * e1y;
+        const float qy = sz * e1x - sx * e1z;
+        const float qz = sx * e1y - sy * e1x;
+        const float v = (dx * qx + dy * qy + dz * qz) * invDet;
+        const float t = (e2x * qx + e2y * qy + e2z * qz) * invDet;
+        const bool isHit =
+            (std::abs(det) > 1.0e-12f) & (u >= 0.0f) & (v >= 0.0f) & (u + v <= 1.0f) & (t > tmin) & (t < tmax);
+        distances[i] = isHit ? t : Infinity;
+    }
+
+    int hitIndex = -1;
+    for(int i=0; i < TriangleBlockSize; ++i){
+        if(distances[i] < io_tmax){
+            io_tmax = distances[i];
+            hitIndex = i;
+        }
+    }
+    return hitIndex;
+}
+
+
+struct RayHit
+{
+    float distance;
+    const TriangleBlock* block;
+    int index;
+    // The ray direction in the coordinate of the hit mesh
+    Vector3f localDirection;
+
+    // Color shaded by a light located at the ray origin
+    void getColor(unsigned char* out_color) const {
+        const Vector3f n(
+            block->e1[1][index] * block->e2[2][index] - block->e1[2][index] * block->e2[1][index],
+            block->e1[2][index] * block->e2[0][index] - block->e1[0][index] * block->e2[2][index],
+            block->e1[0][index] * block->e2[1][index] - block->e1[1][index] * block->e2[0][index]);
+        const float cosTheta = std::abs(n.dot(localDirection)) / (n.norm() * localDirection.norm());
+        const float intensity = 0.2f + 0.8f * cosTheta;
+        for(int i=0; i < 3; ++i){
+            out_color[i] = static_cast<unsigned char>(block->colors[index][i] * intensity);
+        }
+    }
+};
+
+
+class RayCastMesh : public Referenced
+{
+public:
+    vector<BvhNode> nodes;
+    // The leaf nodes refer to the blocks
+    vector<TriangleBlock> blocks;
+
+    struct Triangle {
+        Vector3f vertices[3];
+        unsigned char color[3];
+    };
+
+    void build(const vector<Triangle>& triangles);
+    bool intersect(const Ray& ray, float tmin, float& io_tmax, RayHit& out_hit) const;
+};
+
+typedef ref_ptr<RayCastMesh> RayCastMeshPtr;
+
+
+void RayCastMesh::build(const vector<Triangle>& triangles)
+{
+    const int n = triangles.size();
+    vector<Vector3f> mins(n);
+    vector<Vector3f> maxs(n);
+    for(int i=0; i < n; ++i){
+        auto& v = triangles[i].vertices;
+        mins[i] = v[0].cwiseMin(v[1]).cwiseMin(v[2]);
+        maxs[i] = v[0].cwiseMax(v[1]).cwiseMax(v[2]);
+    }
+    vector<int> order;
+    BvhBuilder(nodes, order, mins, maxs, TriangleBlockSize);
+
+    blocks.clear();
+    for(auto& node : nodes){
+        if(node.count > 0){
+            blocks.emplace_back();
+            auto& block = blocks.back();
+            for(int i=0; i < TriangleBlockSize; ++i){
+                if(i < node.count){
+                    auto& triangle = triangles[order[node.index + i]];
+                    auto& v = triangle.vertices;
+                    const Vector3f e1 = v[1] - v[0];
+                    const Vector3f e2 = v[2] - v[0];
+                    for(int j=0; j < 3; ++j){
+                        block.v0[j][i] = v[0][j];
+                        block.e1[j][i] = e1[j];
+                        block.e2[j][i] = e2[j];
+                        block.colors[i][j] = triangle.color[j];
+                    }
+                } else {
+                    for(int j=0; j < 3; ++j){
+                        block.v0[j][i] = 0.0f;
+                        block.e1[j][i] = 0.0f;
+                        block.e2[j][i] = 0.0f;
+                        block.colors[i][j] = 0;
+                    }
+                }
+            }
+            node.index = blocks.size() - 1;
+            node.count = 1;
+        }
+    }
+}
+
+
+bool RayCastMesh::intersect(const Ray& ray, float tmin, float& io_tmax, RayHit& out_hit) const
+{
+    struct StackEntry { int node; float tnear; };
+    StackEntry stack[64];
+    int stackSize = 0;
+    bool isHit = false;
+
+    float tnear;
+    if(nodes.empty() || !intersectBox(nodes[0], ray, tmin, io_tmax, tnear)){
+        return false;
+    }
+    stack[stackSize++] = { 0, tnear };
+
+    while(stackSize > 0){
+        const StackEntry entry = stack[--stackSize];
+        if(entry.tnear > io_tmax){
+            continue;
+        }
+        auto& node = nodes[entry.node];
+        if(node.count > 0){
+            auto& block = blocks[node.index];
+            int index = intersectTriangleBlock(block, ray, tmin, io_tmax);
+            if(index >= 0){
+                out_hit.distance = io_tmax;
+                out_hit.block = &block;
+                out_hit.index = index;
+                out_hit.localDirection = ray.direction;
+                isHit = true;
+            }
+        } else {
+            const int child1 = entry.node + 1;
+            const int child2 = node.index;
+            float t1, t2;
+            bool isHit1 = intersectBox(nodes[child1], ray, tmin, io_tmax, t1);
+            bool isHit2 = intersectBox(nodes[child2], ray, tmin, io_tmax, t2);
+            // Push the farther child first so that the nearer child is visited first
+            if(isHit1 && isHit2){
+                if(t1 < t2){
+                    stack[stackSize++] = { child2, t2 };
+                    stack[stackSize++] = { child1, t1 };
+                } else {
+                    stack[stackSize++] = { child1, t1 };
+                    stack[stackSize++] = { child2, t2 };
+                }
+            } else if(isHit1){
+                stack[stackSize++] = { child1, t1 };
+            } else if(isHit2){
+                stack[stackSize++] = { child2, t2 };
+            }
+        }
+    }
+
+    return isHit;
+}
+
+
+struct MeshInstance
+{
+    RayCastMeshPtr mesh;
+    // The mesh is fixed to the world frame when the link is null
+    Link* link;
+};
+
+
+/**
+   Positions of the mesh instances at the time when the scanning is started and the hierarchy
+   of their bounding boxes in the world frame. This is shared by the sensors which start
+   scanning at the same time, and only read by the worker threads.
+*/
+class SceneSnapshot
+{
+public:
+    const vector<MeshInstance>& instances;
+    vector<Isometry3f> inversePositions;
+    vector<BvhNode> nodes;
+    vector<int> order;
+
+    SceneSnapshot(const vector<MeshInstance>& instances);
+    bool intersect(const Ray& ray, float tmin, float tmax, RayHit& out_hit) const;
+};
+
+
+SceneSnapshot::SceneSnapshot(const vector<MeshInstance>& instances)
+    : instances(instances)
+{
+    const int n = instances.size();
+    inversePositions.resize(n);
+    vector<Vector3f> mins(n);
+    vector<Vector3f> maxs(n);
+
+    for(int i=0; i < n; ++i){
+        auto& instance = instances[i];
+        auto& root = instance.mesh->nodes.front();
+        if(!instance.link){
+            inversePositions[i].setIdentity();
+            mins[i] = root.min;
+            maxs[i] = root.max;
+        } else {
+            const Isometry3f T = instance.link->T().cast<float>();
+            inversePositions[i] = T.inverse();
+            const Vector3f c = T * ((root.min + root.max) * 0.5f);
+            const Vector3f e = T.linear().cwiseAbs() * ((root.max - root.min) * 0.5f);
+            mins[i] = c - e;
+            maxs[i] = c + e;
+        }
+    }
+
+    BvhBuilder(nodes, order, mins, maxs, 2);
+}
+
+
+bool SceneSnapshot::intersect(const Ray& ray, float tmin, float tmax, RayHit& out_hit) const
+{
+    int stack[64];
+    int stackSize = 0;
+    bool isHit = false;
+    Ray localRay;
+
+    if(!nodes.empty()){
+        stack[stackSize++] = 0;
+    }
+    while(stackSize > 0){
+        auto& node = nodes[stack[--stackSize]];
+        float tnear;
+        if(!intersectBox(node, ray, tmin, tmax, tnear)){
+            continue;
+        }
+        if(node.count == 0){
+            stack[stackSize++] = node.index;
+            stack[stackSize++] = &node - &nodes.front() + 1;
+        } else {
+            for(int i=0; i < node.count; ++i){
+                const int instanceIndex = order[node.index + i];
+                auto& T = inversePositions[instanceIndex];
+                localRay.set(T * ray.origin, T.linear() * ray.direction);
+                if(instances[instanceIndex].mesh->intersect(localRay, tmin, tmax, out_hit)){
+                    isHit = true;
+                }
+            }
+        }
+    }
+
+    return isHit;
+}
+
+typedef std::shared_ptr<SceneSnapshot> SceneSnapshotPtr;
+
+
+class RayCastSensor : public Referenced
+{
+public:
+    RayCastVisionSimulatorItem::Impl* simImpl;
+    SimulationBody* simBody;
+    DevicePtr device;
+    RangeCameraPtr rangeCamera;
+    RangeSensorPtr rangeSensor;
+    double elapsedTime;
+    double cycleTime;
+    double latency;
+    double onsetTime;
+    bool wasDeviceOn;
+    bool isScanning; // only updated and referred to in the simulation thread
+    bool needToClearVisionDataByTurningOff;
+
+    // Directions of the rays in the sensor frame in the order of the output data
+    vector<Vector3f> rayDirections;
+    int width;
+    int height;
+    float minDistance;
+    float maxDistance;
+    bool isOrganized;
+    bool extractColors;
+
+    // The following variables are set when the scanning is started and read by the scanning tasks
+    SceneSnapshotPtr snapshot;
+    Isometry3f T_sensor;
+    double detectionRate;
+    double errorDeviation;
+    int scanCounter;
+
+    struct Job {
+        int begin;
+        int end;
+        vector<Vector3f> points;
+        vector<unsigned char> colors;
+        bool isDense;
+    };
+    vector<Job> jobs;
+    // The jobs are taken by at most numTasks tasks of the task scheduler
+    int numTasks;
+    std::atomic<int> nextJobIndex;
+    TaskScheduler::TaskGroup taskGroup;
+    std::shared_ptr<RangeSensor::RangeData> rangeData;
+
+    RayCastSensor(RayCastVisionSimulatorItem::Impl* simImpl, Device* device, SimulationBody* simBody);
+    bool initialize(int numThreads);
+    void initializeRangeSensorRays();
+    bool initializeRangeCameraRays();
+    void startScanning(SceneSnapshotPtr& snapshot);
+    void processJobs();
+    void scan(int jobIndex);
+    void scanRangeSensor(Job& job, std::mt19937& randomNumber);
+    void scanRangeCamera(Job& job, std::mt19937& randomNumber);
+    void clearVisionData();
+    void copyVisionData();
+};
+
+typedef ref_ptr<RayCastSensor> RayCastSensorPtr;
+
+}
+
+namespace cnoid {
+
+class RayCastVisionSimulatorItem::Impl
+{
+public:
+    RayCastVisionSimulatorItem* self;
+    ostream& os;
+    SimulatorItem* simulatorItem;
+    double worldTimeStep;
+    double currentTime;
+    vector<RayCastSensorPtr> sensors;
+    vector<RayCastSensor*> sensorsInScanning;
+    vector<RayCastSensor*> sensorsToTurnOff;
+    vector<MeshInstance> meshInstances;
+    bool isBestEffortMode;
+
+    vector<string> bodyNames;
+    string bodyNameListString;
+    vector<string> sensorNames;
+    string sensorNameListString;
+    bool isVisionDataRecordingEnabled;
+    bool isBestEffortModeProperty;
+    bool shootAllSceneObjects;
+    double maxFrameRate;
+    double maxLatency;
+    int numThreads;
+
+    Impl(RayCastVisionSimulatorItem* self);
+    Impl(RayCastVisionSimulatorItem* self, const Impl& org);
+    bool initializeSimulation(SimulatorItem* simulatorItem);
+    void createMeshInstances(const vector<SimulationBody*>& simBodies);
+    RayCastMeshPtr createMesh(SgNode* node, MeshExtractor& meshExtractor);
+    void onPreDynamics();
+    void onPostDynamics();
+    bool waitForScanningToFinish(RayCastSensor* sensor);
+    void finalizeSimulation();
+    void doPutProperties(PutPropertyFunction& putProperty);
+    bool store(Archive& archive);
+    bool restore(const Archive& archive);
+
+    template<typename Type> void setProperty(Type& variable, const Type& value){
+        if(value != variable){
+            variable = value;
+            self->notifyUpdate();
+        }
+    }
+};
+
+}
+
+
+void RayCastVisionSimulatorItem::initializeClass(ExtensionManager* ext)
+{
+    ext->itemManager().registerClass<RayCastVisionSimulatorItem, SubSimulatorItem>(N_("RayCastVisionSimulatorItem"));
+    ext->itemManager().addCreationPanel<RayCastVisionSimulatorItem>();
+}
+
+
+RayCastVisionSimulatorItem::RayCastVisionSimulatorItem()
+{
+    impl = new Impl(this);
+    setName("RayCastVisionSimulator");
+}
+
+
+RayCastVisionSimulatorItem::Impl::Impl(RayCastVisionSimulatorItem* self)
+    : self(self),
+      os(MessageView::instance()->cout())
+{
+    simulatorItem = nullptr;
+    isVisionDataRecordingEnabled = false;
+    isBestEffortModeProperty = true;
+    shootAllSceneObjects = true;
+    maxFrameRate = 1000.0;
+    maxLatency = 1.0;
+    numThreads = 0;
+}
+
+
+RayCastVisionSimulatorItem::RayCastVisionSimulatorItem(const RayCastVisionSimulatorItem& org)
+    : SubSimulatorItem(org)
+{
+    impl = new Impl(this, *org.impl);
+}
+
+
+RayCastVisionSimulatorItem::Impl::Impl(RayCastVisionSimulatorItem* self, const Impl& org)
+    : self(self),
+      os(MessageView::instance()->cout()),
+      bodyNames(org.bodyNames),
+      sensorNames(org.sensorNames)
+{
+    simulatorItem = nullptr;
+    bodyNameListString = getNameListString(bodyNames);
+    sensorNameListString = getNameListString(sensorNames);
+    isVisionDataRecordingEnabled = org.isVisionDataRecordingEnabled;
+    isBestEffortModeProperty = org.isBestEffortModeProperty;
+    shootAllSceneObjects = org.shootAllSceneObjects;
+    maxFrameRate = org.maxFrameRate;
+    maxLatency = org.maxLatency;
+    numThreads = org.numThreads;
+}
+
+
+Item* RayCastVisionSimulatorItem::doCloneItem(CloneMap* /* cloneMap */) const
+{
+    return new RayCastVisionSimulatorItem(*this);
+}
+
+
+RayCastVisionSimulatorItem::~RayCastVisionSimulatorItem()
+{
+    delete impl;
+}
+
+
+void RayCastVisionSimulatorItem::setTargetBodies(const std::string& names)
+{
+    updateNames(names, impl->bodyNameListString, impl->bodyNames);
+    notifyUpdate();
+}
+
+
+void RayCastVisionSimulatorItem::setTargetSensors(const std::string& names)
+{
+    updateNames(names, impl->sensorNameListString, impl->sensorNames);
+    notifyUpdate();
+}
+
+
+void RayCastVisionSimulatorItem::setMaxFrameRate(double rate)
+{
+    impl->setProperty(impl->maxFrameRate, rate);
+}
+
+
+void RayCastVisionSimulatorItem::setMaxLatency(double latency)
+{
+    impl->setProperty(impl->maxLatency, latency);
+}
+
+
+void RayCastVisionSimulatorItem::setVisionDataRecordingEnabled(bool on)
+{
+    impl->setProperty(impl->isVisionDataRecordingEnabled, on);
+}
+
+
+void RayCastVisionSimulatorItem::setBestEffortMode(bool on)
+{
+    impl->setProperty(impl->isBestEffortModeProperty, on);
+}
+
+
+void RayCastVisionSimulatorItem::setAllSceneObjectsEnabled(bool on)
+{
+    impl->setProperty(impl->shootAllSceneObjects, on);
+}
+
+
+void RayCastVisionSimulatorItem::setNumThreads(int n)
+{
+    impl->setProperty(impl->numThreads, std::max(0, n));
+}
+
+
+bool RayCastVisionSimulatorItem::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    return impl->initializeSimulation(simulatorItem);
+}
+
+
+bool RayCastVisionSimulatorItem::Impl::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    this->simulatorItem = simulatorItem;
+    worldTimeStep = simulatorItem->worldTimeStep();
+    currentTime = 0;
+    sensors.clear();
+    sensorsInScanning.clear();
+    sensorsToTurnOff.clear();
+    isBestEffortMode = isBestEffortModeProperty;
+
+    std::set<string> bodyNameSet(bodyNames.begin(), bodyNames.end());
+    std::set<string> sensorNameSet(sensorNames.begin(), sensorNames.end());
+
+    const vector<SimulationBody*>& simBodies = simulatorItem->simulationBodies();
+    for(auto& simBody : simBodies){
+        Body* body = simBody->body();
+        if(bodyNameSet.empty() || bodyNameSet.find(body->name()) != bodyNameSet.end()){
+            for(int i=0; i < body->numDevices(); ++i){
+                Device* device = body->device(i);
+                if(dynamic_cast<RangeCamera*>(device) || dynamic_cast<RangeSensor*>(device)){
+                    if(sensorNameSet.empty() || sensorNameSet.find(device->name()) != sensorNameSet.end()){
+                        os << formatR(_("{0} detected vision sensor \"{1}\" of {2} as a target.\n"),
+                                      self->displayName(), device->name(), body->name());
+                        sensors.push_back(new RayCastSensor(this, device, simBody));
+                    }
+                }
+            }
+        }
+    }
+
+    if(sensors.empty()){
+        os << formatR(_("{} has no target sensors"), self->displayName()) << endl;
+        return false;
+    }
+
+    int n = numThreads;
+    if(n <= 0){
+        n = TaskScheduler::instance()->numThreads() + 1;
+    }
+
+    auto p = sensors.begin();
+    while(p != sensors.end()){
+        auto sensor = p->get();
+        if(sensor->initialize(n)){
+            ++p;
+        } else {
+            os << formatR(_("{0}: Target sensor \"{1}\" cannot be initialized.\n"),
+                          self->displayName(), sensor->device->name());
+            p = sensors.erase(p);
+        }
+    }
+    os.flush();
+
+    if(sensors.empty()){
+        return false;
+    }
+
+    createMeshInstances(simBodies);
+
+    simulatorItem->addPreDynamicsFunction([this](){ onPreDynamics(); });
+    simulatorItem->addPostDynamicsFunction([this](){ onPostDynamics(); });
+
+    return true;
+}
+
+
+/**
+   The meshes are built in the local coordinate of each link so that they can be shared
+   during the simulation, and the same shape node is converted only once.
+*/
+void RayCastVisionSimulatorItem::Impl::createMeshInstances(const vector<SimulationBody*>& simBodies)
+{
+    meshInstances.clear();
+    MeshExtractor meshExtractor;
+    std::unordered_map<SgNode*, RayCastMeshPtr> meshMap;
+
+    for(auto& simBody : simBodies){
+        for(auto& link : simBody->body()->links()){
+            if(auto shape = link->visualShape()){
+                RayCastMeshPtr mesh;
+                auto inserted = meshMap.emplace(shape, nullptr);
+                if(inserted.second){
+                    inserted.first->second = createMesh(shape, meshExtractor);
+                }
+                mesh = inserted.first->second;
+                if(mesh){
+                    meshInstances.push_back({ mesh, link });
+                }
+            }
+        }
+    }
+
+    if(shootAllSceneObjects){
+        if(auto worldItem = self->findOwnerItem<WorldItem>()){
+            for(auto& item : worldItem->descendantItems()){
+                auto renderable = dynamic_cast<RenderableItem*>(item.get());
+                if(renderable && !dynamic_cast<BodyItem*>(item.get())){
+                    if(auto node = renderable->getScene()){
+                        if(!node->hasAttribute(SgObject::MetaScene)){
+                            if(auto mesh = createMesh(node, meshExtractor)){
+                                meshInstances.push_back({ mesh, nullptr });
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+RayCastMeshPtr RayCastVisionSimulatorItem::Impl::createMesh(SgNode* node, MeshExtractor& meshExtractor)
+{
+    vector<RayCastMesh::Triangle> triangles;
+
+    meshExtractor.extract(
+        node,
+        [&](SgMesh* mesh){
+            auto vertices = mesh->vertices();
+            const int numTriangles = mesh->numTriangles();
+            if(!vertices || numTriangles == 0){
+                return;
+            }
+            Vector3f color(1.0f, 1.0f, 1.0f);
+            if(auto material = meshExtractor.currentShape()->material()){
+                color = material->diffuseColor();
+            }
+            RayCastMesh::Triangle triangle;
+            for(int i=0; i < 3; ++i){
+                triangle.color[i] = static_cast<unsigned char>(std::max(0.0f, std::min(255.0f, color[i] * 255.0f)));
+            }
+            const Affine3f T = meshExtractor.currentTransform().cast<float>();
+            triangles.reserve(triangles.size() + numTriangles);
+            for(int i=0; i < numTriangles; ++i){
+                auto indices = mesh->triangle(i);
+                for(int j=0; j < 3; ++j){
+                    triangle.vertices[j] = T * (*vertices)[indices[j]];
+                }
+                triangles.push_back(triangle);
+            }
+        });
+
+    if(triangles.empty()){
+        return nullptr;
+    }
+
+    RayCastMeshPtr mesh = new RayCastMesh;
+    mesh->build(triangles);
+    return mesh;
+}
+
+
+RayCastSensor::RayCastSensor(RayCastVisionSimulatorItem::Impl* simImpl, Device* device, SimulationBody* simBody)
+    : simImpl(simImpl),
+      simBody(simBody),
+      device(device)
+{
+    rangeCamera = dynamic_cast<RangeCamera*>(device);
+    rangeSensor = dynamic_cast<RangeSensor*>(device);
+}
+
+
+bool RayCastSensor::initialize(int numThreads)
+{
+    double frameRate;
+
+    if(rangeCamera){
+        if(!initializeRangeCameraRays()){
+            return false;
+        }
+        frameRate = rangeCamera->frameRate();
+        if(simImpl->isVisionDataRecordingEnabled){
+            rangeCamera->setImageStateClonable(true);
+        }
+    } else {
+        initializeRangeSensorRays();
+        frameRate = rangeSensor->scanRate();
+        if(simImpl->isVisionDataRecordingEnabled){
+            rangeSensor->setRangeDataStateClonable(true);
+        }
+    }
+
+    const int numRays = rayDirections.size();
+    const int numJobs = std::max(1, std::min(numThreads * 4, numRays / MinNumRaysPerJob));
+    jobs.resize(numJobs);
+    for(int i=0; i < numJobs; ++i){
+        jobs[i].begin = static_cast<int64_t>(numRays) * i / numJobs;
+        jobs[i].end = static_cast<int64_t>(numRays) * (i + 1) / numJobs;
+    }
+    numTasks = std::min(numThreads, numJobs);
+
+    cycleTime = 1.0 / std::max(0.1, std::min(frameRate, simImpl->maxFrameRate));
+    elapsedTime = 0.0;
+    latency = std::min(cycleTime, simImpl->maxLatency);
+    onsetTime = 0.0;
+    wasDeviceOn = false;
+    isScanning = false;
+    needToClearVisionDataByTurningOff = false;
+    scanCounter = 0;
+
+    return true;
+}
+
+
+/**
+   The yaw angle is the rotation around the Y axis and the pitch angle is the elevation from
+   the XZ plane of the optical frame, whose Z axis is opposite to the front direction.
+   The data order is the same as that of GLVisionSimulatorItem.
+*/
+void RayCastSensor::initializeRangeSensorRays()
+{
+    const double yawRange = rangeSensor->yawRange();
+    const double yawStep = rangeSensor->yawStep();
+    const int numYawSamples = rangeSensor->numYawSamples();
+    const double pitchRange = rangeSensor->pitchRange();
+    const double pitchStep = rangeSensor->pitchStep();
+    const int numPitchSamples = rangeSensor->numPitchSamples();
+    // The mount rotation is applied by T_sensor when the rays are cast
+    const Matrix3 R = rangeSensor->opticalFrameRotation();
+
+    rayDirections.clear();
+    rayDirections.reserve(numYawSamples * numPitchSamples);
+    for(int pitch=0; pitch < numPitchSamples; ++pitch){
+        const double pitchAngle = pitch * pitchStep - pitchRange / 2.0;
+        for(int yaw=0; yaw < numYawSamples; ++yaw){
+            const double yawAngle = yaw * yawStep - yawRange / 2.0;
+            const Vector3 d(-cos(pitchAngle) * sin(yawAngle), sin(pitchAngle), -cos(pitchAngle) * cos(yawAngle));
+            rayDirections.push_back((R * d).cast<float>());
+        }
+    }
+    width = numYawSamples;
+    height = numPitchSamples;
+    minDistance = rangeSensor->minDistance();
+    maxDistance = rangeSensor->maxDistance();
+    isOrganized = true;
+    extractColors = false;
+}
+
+
+/**
+   The rays pass through the pixel centers of the perspective projection whose field of view
+   is applied to the shorter side of the image, which is the same as SgPerspectiveCamera.
+   The Z components of the directions in the optical frame are -1, so the ray parameter
+   is equal to the depth.
+*/
+bool RayCastSensor::initializeRangeCameraRays()
+{
+    if(rangeCamera->lensType() != Camera::NORMAL_LENS){
+        return false;
+    }
+    width = rangeCamera->resolutionX();
+    height = rangeCamera->resolutionY();
+    if(width <= 0 || height <= 0){
+        return false;
+    }
+
+    const double t = tan(rangeCamera->fieldOfView() / 2.0);
+    double tanHalfWidth, tanHalfHeight;
+    if(width >= height){
+        tanHalfHeight = t;
+        tanHalfWidth = t * width / height;
+    } else {
+        tanHalfWidth = t;
+        tanHalfHeight = t * height / width;
+    }
+    const Matrix3 Ro = rangeCamera->opticalFrameRotation();
+
+    rayDirections.clear();
+    rayDirections.reserve(width * height);
+    for(int y=0; y < height; ++y){
+        const double ny = 1.0 - (2.0 * y + 1.0) / height;
+        for(int x=0; x < width; ++x){
+            const double nx = (2.0 * x + 1.0) / width - 1.0;
+            rayDirections.push_back((Ro * Vector3(nx * tanHalfWidth, ny * tanHalfHeight, -1.0)).cast<float>());
+        }
+    }
+    minDistance = rangeCamera->nearClipDistance();
+    maxDistance = rangeCamera->farClipDistance();
+    isOrganized = rangeCamera->isOrganized();
+    extractColors = (rangeCamera->imageType() == Camera::COLOR_IMAGE);
+
+    return true;
+}
+
+
+void RayCastVisionSimulatorItem::Impl::onPreDynamics()
+{
+    currentTime = simulatorItem->currentTime();
+
+    SceneSnapshotPtr snapshot;
+
+    for(auto& sensor : sensors){
+        bool isOn = sensor->device->on();
+        if(isOn){
+            if(!sensor->wasDeviceOn){
+                if(sensor->needToClearVisionDataByTurningOff){
+                    sensorsToTurnOff.erase(
+                        std::find(sensorsToTurnOff.begin(), sensorsToTurnOff.end(), sensor));
+                    sensor->needToClearVisionDataByTurningOff = false;
+                }
+                sensor->elapsedTime = sensor->cycleTime;
+            }
+            if(sensor->elapsedTime >= sensor->cycleTime){
+                if(!sensor->isScanning){
+                    if(!snapshot){
+                        snapshot = std::make_shared<SceneSnapshot>(meshInstances);
+                    }
+                    sensor->onsetTime = currentTime;
+                    sensor->isScanning = true;
+                    sensor->startScanning(snapshot);
+                    sensor->elapsedTime -= sensor->cycleTime;
+                    sensorsInScanning.push_back(sensor);
+                }
+            }
+        } else {
+            if(sensor->wasDeviceOn){
+                sensor->needToClearVisionDataByTurningOff = true;
+                sensorsToTurnOff.push_back(sensor);
+            }
+        }
+        sensor->elapsedTime += worldTimeStep;
+        sensor->wasDeviceOn = isOn;
+    }
+}
+
+
+void RayCastSensor::startScanning(SceneSnapshotPtr& snapshot)
+{
+    this->snapshot = snapshot;
+    T_sensor = (device->link()->T() * device->T_local()).cast<float>();
+
+    if(rangeCamera){
+        detectionRate = rangeCamera->detectionRate();
+        errorDeviation = rangeCamera->errorDeviation();
+    } else {
+        detectionRate = rangeSensor->detectionRate();
+        errorDeviation = rangeSensor->errorDeviation();
+        rangeData = std::make_shared<RangeSensor::RangeData>(rayDirections.size());
+    }
+    ++scanCounter;
+
+    /*
+      The tasks are executed by the worker threads of the task scheduler while the simulation
+      thread proceeds, and the simulation thread also executes them when it waits for them.
+    */
+    nextJobIndex = 0;
+    auto scheduler = TaskScheduler::instance();
+    for(int i=0; i < numTasks; ++i){
+        scheduler->submit(taskGroup, [](void* data){ static_cast<RayCastSensor*>(data)->processJobs(); }, this);
+    }
+}
+
+
+void RayCastSensor::processJobs()
+{
+    const int numJobs = jobs.size();
+    int jobIndex;
+    while((jobIndex = nextJobIndex++) < numJobs){
+        scan(jobIndex);
+    }
+}
+
+
+void RayCastSensor::scan(int jobIndex)
+{
+    // The random numbers do not depend on the order of the jobs processed by the threads
+    std::seed_seq seed{ scanCounter, jobIndex };
+    std::mt19937 randomNumber(seed);
+
+    auto& job = jobs[jobIndex];
+    if(rangeCamera){
+        scanRangeCamera(job, randomNumber);
+    } else {
+        scanRangeSensor(job, randomNumber);
+    }
+}
+
+
+void RayCastSensor::scanRangeSensor(Job& job, std::mt19937& randomNumber)
+{
+    std::uniform_real_distribution<> detectionProbability;
+    std::normal_distribution<> distanceErrorDistribution(0.0, std::max(errorDeviation, 1.0e-12));
+    auto& data = *rangeData;
+    const Matrix3f R = T_sensor.linear();
+    Ray ray;
+    RayHit hit;
+
+    for(int i = job.begin; i < job.end; ++i){
+        if(detectionRate < 1.0){
+            if(detectionProbability(randomNumber) > detectionRate){
+                data[i] = std::numeric_limits<double>::infinity();
+                continue;
+            }
+        }
+        ray.set(T_sensor.translation(), R * rayDirections[i]);
+        if(!snapshot->intersect(ray, minDistance, maxDistance, hit)){
+            data[i] = std::numeric_limits<double>::infinity();
+        } else {
+            double distance = hit.distance;
+            if(errorDeviation > 0.0){
+                distance += distanceErrorDistribution(randomNumber);
+            }
+            data[i] = distance;
+        }
+    }
+}
+
+
+void RayCastSensor::scanRangeCamera(Job& job, std::mt19937& randomNumber)
+{
+    std::uniform_real_distribution<> detectionProbability;
+    std::normal_distribution<> distanceErrorDistribution(0.0, std::max(errorDeviation, 1.0e-12));
+    const Matrix3f R = T_sensor.linear();
+    const int cx = width / 2;
+    const int cy = height / 2;
+    Ray ray;
+    RayHit hit;
+
+    job.points.clear();
+    job.colors.clear();
+    job.isDense = true;
+
+    for(int i = job.begin; i < job.end; ++i){
+        const Vector3f& d = rayDirections[i];
+        bool isHit = false;
+        bool isNearClipped = false;
+        if(detectionRate >= 1.0 || detectionProbability(randomNumber) <= detectionRate){
+            ray.set(T_sensor.translation(), R * d);
+            // The hits nearer than the near clip distance are detected to encode them like GLVisionSimulatorItem
+            isHit = snapshot->intersect(ray, 0.0f, maxDistance, hit);
+            if(isHit && hit.distance < minDistance){
+                isHit = false;
+                isNearClipped = true;
+            }
+        }
+        if(isHit){
+            Vector3f p = d * hit.distance;
+            if(errorDeviation > 0.0){
+                const double l = p.norm();
+                p *= (l + distanceErrorDistribution(randomNumber)) / l;
+            }
+            job.points.push_back(p);
+            if(extractColors){
+                unsigned char color[3];
+                hit.getColor(color);
+                job.colors.insert(job.colors.end(), color, color + 3);
+            }
+        } else if(isOrganized){
+            // Same as GLVisionSimulatorItem, where the z value is positive infinity for the points
+            // clipped by the near clip plane and negative infinity for the others
+            const int x = i % width;
+            const int y = height - 1 - i / width;
+            Vector3f p;
+            p.z() = isNearClipped ? numeric_limits<float>::infinity() : -numeric_limits<float>::infinity();
+            p.x() = (x == cx) ? 0.0f : (x - cx) * numeric_limits<float>::infinity();
+            p.y() = (y == cy) ? 0.0f : (y - cy) * numeric_limits<float>::infinity();
+            job.points.push_back(rangeCamera->opticalFrameRotation().cast<float>() * p);
+            if(extractColors){
+                job.colors.insert(job.colors.end(), 3, 0);
+            }
+            job.isDense = false;
+        }
+    }
+}
+
+
+void RayCastVisionSimulatorItem::Impl::onPostDynamics()
+{
+    auto iter = sensorsInScanning.begin();
+    while(iter != sensorsInScanning.end()){
+        auto sensor = *iter;
+        if(sensor->elapsedTime >= sensor->latency){
+            if(waitForScanningToFinish(sensor)){
+                if(!sensor->needToClearVisionDataByTurningOff){
+                    sensor->copyVisionData();
+                }
+                sensor->snapshot.reset();
+                sensor->isScanning = false;
+            }
+        }
+        if(sensor->isScanning){
+            ++iter;
+        } else {
+            iter = sensorsInScanning.erase(iter);
+        }
+    }
+
+    if(!sensorsToTurnOff.empty()){
+        auto iter = sensorsToTurnOff.begin();
+        while(iter != sensorsToTurnOff.end()){
+            auto sensor = *iter;
+            if(sensor->isScanning){
+                ++iter;
+            } else {
+                sensor->clearVisionData();
+                iter = sensorsToTurnOff.erase(iter);
+            }
+        }
+    }
+}
+
+
+bool RayCastVisionSimulatorItem::Impl::waitForScanningToFinish(RayCastSensor* sensor)
+{
+    if(!sensor->taskGroup.isFinished()){
+        if(isBestEffortMode){
+            if(sensor->elapsedTime > sensor->cycleTime){
+                sensor->elapsedTime = sensor->cycleTime;
+            }
+            return false;
+        }
+        TaskScheduler::instance()->wait(sensor->taskGroup);
+    }
+    return true;
+}
+
+
+void RayCastSensor::clearVisionData()
+{
+    if(rangeCamera){
+        rangeCamera->clearImage();
+        rangeCamera->clearPoints();
+    } else if(rangeSensor){
+        rangeSensor->clearRangeData();
+    }
+
+    if(simImpl->isVisionDataRecordingEnabled){
+        device->notifyStateChange();
+    } else {
+        simBody->notifyUnrecordedDeviceStateChange(device);
+    }
+
+    needToClearVisionDataByTurningOff = false;
+}
+
+
+void RayCastSensor::copyVisionData()
+{
+    double delay = simImpl->currentTime - onsetTime;
+
+    if(rangeCamera){
+        size_t numPoints = 0;
+        bool isDense = true;
+        for(auto& job : jobs){
+            numPoints += job.points.size();
+            isDense = isDense && job.isDense;
+        }
+        auto points = std::make_shared<RangeCamera::PointData>();
+        points->reserve(numPoints);
+        for(auto& job : jobs){
+            points->insert(points->end(), job.points.begin(), job.points.end());
+        }
+        rangeCamera->setPoints(points);
+        rangeCamera->setDense(isDense);
+
+        if(extractColors){
+            auto image = std::make_shared<Image>();
+            if(isOrganized){
+                image->setSize(width, height, 3);
+            } else {
+                image->setSize(numPoints, 1, 3);
+            }
+            if(numPoints > 0){
+                unsigned char* pixels = image->pixels();
+                for(auto& job : jobs){
+                    pixels = std::copy(job.colors.begin(), job.colors.end(), pixels);
+                }
+            }
+            rangeCamera->setImage(image);
+        }
+        rangeCamera->setDelay(delay);
+
+    } else if(rangeSensor){
+        rangeSensor->setRangeData(rangeData);
+        rangeSensor->setDelay(delay);
+    }
+
+    if(simImpl->isVisionDataRecordingEnabled){
+        device->notifyStateChange();
+    } else {
+        simBody->notifyUnrecordedDeviceStateChange(device);
+    }
+}
+
+
+void RayCastVisionSimulatorItem::finalizeSimulation()
+{
+    impl->finalizeSimulation();
+}
+
+
+void RayCastVisionSimulatorItem::Impl::finalizeSimulation()
+{
+    // The submitted tasks refer to the sensors, so they must be finished
+    for(auto& sensor : sensorsInScanning){
+        TaskScheduler::instance()->wait(sensor->taskGroup);
+    }
+
+    sensorsInScanning.clear();
+    sensorsToTurnOff.clear();
+    sensors.clear();
+    meshInstances.clear();
+}
+
+
+void RayCastVisionSimulatorItem::doPutProperties(PutPropertyFunction& putProperty)
+{
+    SubSimulatorItem::doPutProperties(putProperty);
+    impl->doPutProperties(putProperty);
+}
+
+
+void RayCastVisionSimulatorItem::Impl::doPutProperties(PutPropertyFunction& putProperty)
+{
+    putProperty(_("Target bodies"), bodyNameListString,
+                [this](const string& names){ return updateNames(names, bodyNameListString, bodyNames); });
+    putProperty(_("Target sensors"), sensorNameListString,
+                [this](const string& names){ return updateNames(names, sensorNameListString, sensorNames); });
+    putProperty(_("Max frame rate"), maxFrameRate, changeProperty(maxFrameRate));
+    putProperty(_("Max latency [s]"), maxLatency, changeProperty(maxLatency));
+    putProperty(_("Record vision data"), isVisionDataRecordingEnabled, changeProperty(isVisionDataRecordingEnabled));
+    putProperty(_("Best effort"), isBestEffortModeProperty, changeProperty(isBestEffortModeProperty));
+    putProperty(_("All scene objects"), shootAllSceneObjects, changeProperty(shootAllSceneObjects));
+    putProperty.min(0)(_("Number of threads"), numThreads, changeProperty(numThreads));
+}
+
+
+bool RayCastVisionSimulatorItem::store(Archive& archive)
+{
+    SubSimulatorItem::store(archive);
+    return impl->store(archive);
+}
+
+
+bool RayCastVisionSimulatorItem::Impl::store(Archive& archive)
+{
+    writeElements(archive, "target_bodies", bodyNames, true);
+    writeElements(archive, "target_sensors", sensorNames, true);
+    archive.write("max_frame_rate", maxFrameRate);
+    archive.write("max_latency", maxLatency);
+    archive.write("record_vision_data", isVisionDataRecordingEnabled);
+    archive.write("best_effort", isBestEffortModeProperty);
+    archive.write("all_scene_objects", shootAllSceneObjects);
+    archive.write("num_threads", numThreads);
+    return true;
+}
+
+
+bool RayCastVisionSimulatorItem::restore(const Archive& archive)
+{
+    SubSimulatorItem::restore(archive);
+    return impl->restore(archive);
+}
+
+
+bool RayCastVisionSimulatorItem::Impl::restore(const Archive& archive)
+{
+    readElements(archive, "target_bodies", bodyNames);
+    bodyNameListString = getNameListString(bodyNames);
+    readElements(archive, "target_sensors", sensorNames);
+    sensorNameListString = getNameListString(sensorNames);
+
+    archive.read("max_frame_rate", maxFrameRate);
+    archive.read("max_latency", maxLatency);
+    archive.read("record_vision_data", isVisionDataRecordingEnabled);
+    archive.read("best_effort", isBestEffortModeProperty);
+    archive.read("all_scene_objects", shootAllSceneObjects);
+    archive.read("num_threads", numThreads);
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef CNOID_BODY_PLUGIN_RAY_CAST_VISION_SIMULATOR_ITEM_H
+#define CNOID_BODY_PLUGIN_RAY_CAST_VISION_SIMULATOR_ITEM_H
+
+#include "SubSimulatorItem.h"
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   This item simulates range sensors and range cameras by casting rays against the
+   triangle meshes of the world on the CPU. Unlike GLVisionSimulatorItem, it does not
+   require any OpenGL context, so it can be used in a headless environment.
+*/
+class CNOID_EXPORT RayCastVisionSimulatorItem : public SubSimulatorItem
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+
+    RayCastVisionSimulatorItem();
+    RayCastVisionSimulatorItem(const RayCastVisionSimulatorItem& org);
+    ~RayCastVisionSimulatorItem();
+
+    void setTargetBodies(const std::string& bodyNames);
+    void setTargetSensors(const std::string& sensorNames);
+    void setMaxFrameRate(double rate);
+    void setMaxLatency(double latency);
+    void setVisionDataRecordingEnabled(bool on);
+    void setBestEffortMode(bool on);
+    void setAllSceneObjectsEnabled(bool on);
+
+    //! \param n The number of the ray casting threads. Zero means the number of the hardware threads.
+    void setNumThreads(int n);
+
+    virtual bool initializeSimulation(SimulatorItem* simulatorItem) override;
+    virtual void finalizeSimulation() override;
+
+    class Impl;
+
+protected:
+    virtual Item* doCloneItem(CloneMap* cloneMap) const override;
+    virtual void doPutProperties(PutPropertyFunction& putProperty) override;
+    virtual bool store(Archive& archive) override;
+    virtual bool restore(const Archive& archive) override;
+
+private:
+    Impl* impl;
+};
+
+typedef ref_ptr<RayCastVisionSimulatorItem> RayCastVisionSimulatorItemPtr;
+
+}
+
+#endif
@@ -0,0 +1,445 @@
+#include "SensorSharedMemoryPublisherItem.h"
+#include "SimulatorItem.h"
+#include <cnoid/ItemManager>
+#include <cnoid/MessageView>
+#include <cnoid/PutPropertyFunction>
+#include <cnoid/Archive>
+#include <cnoid/ValueTreeUtil>
+#include <cnoid/Body>
+#include <cnoid/RangeCamera>
+#include <cnoid/RangeSensor>
+#include <cnoid/SensorDataSharedMemory>
+#include <cnoid/StringUtil>
+#include <cnoid/Tokenizer>
+#include <cnoid/Format>
+#include <memory>
+#include <cctype>
+#include <set>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+string getNameListString(const vector<string>& names)
+{
+    string nameList;
+    if(!names.empty()){
+        size_t n = names.size() - 1;
+        for(size_t i=0; i < n; ++i){
+            nameList += names[i];
+            nameList += ", ";
+        }
+        nameList += names.back();
+    }
+    return nameList;
+}
+
+bool updateNames(const string& nameListString, string& out_newNameListString, vector<string>& out_names)
+{
+    out_names.clear();
+    for(auto& token : Tokenizer<CharSeparator<char>>(nameListString, CharSeparator<char>(","))){
+        auto name = trimmed(token);
+        if(!name.empty()){
+            out_names.push_back(name);
+        }
+    }
+    out_newNameListString = nameListString;
+    return true;
+}
+
+// The characters which cannot be used in the name of a shared memory object are replaced
+void appendNameElement(string& name, const string& element)
+{
+    for(auto c : element){
+        if(isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.'){
+            name += c;
+        } else {
+            name += '_';
+        }
+    }
+}
+
+/**
+   The weak pointers are used to detect the update of the data without increasing the use count,
+   which would make the device copy the data when it is modified in place. The owner-based
+   comparison is not affected by the reuse of the memory address of the released data.
+*/
+template<class DataType, class SharedDataType>
+bool checkUpdate(std::weak_ptr<DataType>& lastData, const SharedDataType& data)
+{
+    if(!lastData.owner_before(data) && !data.owner_before(lastData)){
+        return false;
+    }
+    lastData = data;
+    return true;
+}
+
+
+class SensorPublisher
+{
+public:
+    Device* device;
+    Camera* camera;
+    RangeCamera* rangeCamera;
+    RangeSensor* rangeSensor;
+    SensorDataSharedMemoryWriter writer;
+    std::weak_ptr<const Image> lastImage;
+    std::weak_ptr<const RangeCamera::PointData> lastPoints;
+    std::weak_ptr<RangeSensor::RangeData> lastRangeData;
+    bool isWriteFailureReported;
+
+    SensorPublisher(Device* device)
+        : device(device)
+    {
+        camera = dynamic_cast<Camera*>(device);
+        rangeCamera = dynamic_cast<RangeCamera*>(device);
+        rangeSensor = dynamic_cast<RangeSensor*>(device);
+        isWriteFailureReported = false;
+    }
+
+    bool open(const string& name, int numSlots);
+    bool publish(double time);
+};
+
+}
+
+namespace cnoid {
+
+class SensorSharedMemoryPublisherItem::Impl
+{
+public:
+    SensorSharedMemoryPublisherItem* self;
+    ostream& os;
+    SimulatorItem* simulatorItem;
+    vector<unique_ptr<SensorPublisher>> publishers;
+
+    vector<string> bodyNames;
+    string bodyNameListString;
+    vector<string> sensorNames;
+    string sensorNameListString;
+    string namePrefix;
+    int numFrameSlots;
+
+    Impl(SensorSharedMemoryPublisherItem* self);
+    Impl(SensorSharedMemoryPublisherItem* self, const Impl& org);
+    bool initializeSimulation(SimulatorItem* simulatorItem);
+    void onPostDynamics();
+    void finalizeSimulation();
+    void doPutProperties(PutPropertyFunction& putProperty);
+    bool store(Archive& archive);
+    bool restore(const Archive& archive);
+
+    template<typename Type> void setProperty(Type& variable, const Type& value){
+        if(value != variable){
+            variable = value;
+            self->notifyUpdate();
+        }
+    }
+};
+
+}
+
+
+void SensorSharedMemoryPublisherItem::initializeClass(ExtensionManager* ext)
+{
+    ext->itemManager().registerClass<SensorSharedMemoryPublisherItem, SubSimulatorItem>(
+        N_("SensorSharedMemoryPublisherItem"));
+    ext->itemManager().addCreationPanel<SensorSharedMemoryPublisherItem>();
+}
+
+
+SensorSharedMemoryPublisherItem::SensorSharedMemoryPublisherItem()
+{
+    impl = new Impl(this);
+    setName("SensorSharedMemoryPublisher");
+}
+
+
+SensorSharedMemoryPublisherItem::Impl::Impl(SensorSharedMemoryPublisherItem* self)
+    : self(self),
+      os(MessageView::instance()->cout())
+{
+    simulatorItem = nullptr;
+    namePrefix = "/cnoid";
+    numFrameSlots = 3;
+}
+
+
+SensorSharedMemoryPublisherItem::SensorSharedMemoryPublisherItem(const SensorSharedMemoryPublisherItem& org)
+    : SubSimulatorItem(org)
+{
+    impl = new Impl(this, *org.impl);
+}
+
+
+SensorSharedMemoryPublisherItem::Impl::Impl(SensorSharedMemoryPublisherItem* self, const Impl& org)
+    : self(self),
+      os(MessageView::instance()->cout()),
+      bodyNames(org.bodyNames),
+      sensorNames(org.sensorNames)
+{
+    simulatorItem = nullptr;
+    bodyNameListString = getNameListString(bodyNames);
+    sensorNameListString = getNameListString(sensorNames);
+    namePrefix = org.namePrefix;
+    numFrameSlots = org.numFrameSlots;
+}
+
+
+Item* SensorSharedMemoryPublisherItem::doCloneItem(CloneMap* /* cloneMap */) const
+{
+    return new SensorSharedMemoryPublisherItem(*this);
+}
+
+
+SensorSharedMemoryPublisherItem::~SensorSharedMemoryPublisherItem()
+{
+    delete impl;
+}
+
+
+void SensorSharedMemoryPublisherItem::setTargetBodies(const std::string& names)
+{
+    updateNames(names, impl->bodyNameListString, impl->bodyNames);
+    notifyUpdate();
+}
+
+
+void SensorSharedMemoryPublisherItem::setTargetSensors(const std::string& names)
+{
+    updateNames(names, impl->sensorNameListString, impl->sensorNames);
+    notifyUpdate();
+}
+
+
+void SensorSharedMemoryPublisherItem::setNamePrefix(const std::string& prefix)
+{
+    impl->setProperty(impl->namePrefix, prefix);
+}
+
+
+void SensorSharedMemoryPublisherItem::setNumFrameSlots(int n)
+{
+    impl->setProperty(impl->numFrameSlots, std::max(1, n));
+}
+
+
+bool SensorSharedMemoryPublisherItem::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    return impl->initializeSimulation(simulatorItem);
+}
+
+
+bool SensorSharedMemoryPublisherItem::Impl::initializeSimulation(SimulatorItem* simulatorItem)
+{
+    this->simulatorItem = simulatorItem;
+    publishers.clear();
+
+    std::set<string> bodyNameSet(bodyNames.begin(), bodyNames.end());
+    std::set<string> sensorNameSet(sensorNames.begin(), sensorNames.end());
+    std::set<string> sharedMemoryNameSet;
+
+    string prefix("/");
+    appendNameElement(prefix, (!namePrefix.empty() && namePrefix[0] == '/') ? namePrefix.substr(1) : namePrefix);
+
+    for(auto& simBody : simulatorItem->simulationBodies()){
+        Body* body = simBody->body();
+        if(!bodyNameSet.empty() && bodyNameSet.find(body->name()) == bodyNameSet.end()){
+            continue;
+        }
+        for(int i=0; i < body->numDevices(); ++i){
+            Device* device = body->device(i);
+            if(!dynamic_cast<Camera*>(device) && !dynamic_cast<RangeSensor*>(device)){
+                continue;
+            }
+            if(!sensorNameSet.empty() && sensorNameSet.find(device->name()) == sensorNameSet.end()){
+                continue;
+            }
+            string name = prefix + "_";
+            appendNameElement(name, body->name());
+            name += "_";
+            appendNameElement(name, device->name());
+
+            // Different names may be converted to the same name by replacing the invalid characters
+            if(!sharedMemoryNameSet.insert(name).second){
+                os << formatR(_("{0}: The data of sensor \"{1}\" of {2} is not published because shared memory \"{3}\" is already used by another sensor.\n"),
+                              self->displayName(), device->name(), body->name(), name);
+                continue;
+            }
+
+            unique_ptr<SensorPublisher> publisher(new SensorPublisher(device));
+            if(publisher->open(name, numFrameSlots)){
+                os << formatR(_("{0}: The data of sensor \"{1}\" of {2} is published to shared memory \"{3}\".\n"),
+                              self->displayName(), device->name(), body->name(), name);
+                publishers.push_back(std::move(publisher));
+            } else {
+                os << formatR(_("{0}: {1}\n"), self->displayName(), publisher->writer.errorMessage());
+            }
+        }
+    }
+    os.flush();
+
+    if(publishers.empty()){
+        os << formatR(_("{} has no target sensors"), self->displayName()) << endl;
+        return false;
+    }
+
+    simulatorItem->addPostDynamicsFunction([this](){ onPostDynamics(); });
+
+    return true;
+}
+
+
+bool SensorPublisher::open(const string& name, int numSlots)
+{
+    size_t maxImageSize = 0;
+    size_t maxNumPoints = 0;
+    size_t maxNumRangeData = 0;
+
+    if(camera){
+        const size_t numPixels = camera->resolutionX() * camera->resolutionY();
+        if(camera->imageType() != Camera::NO_IMAGE){
+            maxImageSize = numPixels * 3;
+        }
+        if(rangeCamera){
+            maxNumPoints = numPixels;
+        }
+    } else if(rangeSensor){
+        maxNumRangeData = rangeSensor->numYawSamples() * rangeSensor->numPitchSamples();
+    }
+
+    return writer.open(name, numSlots, maxImageSize, maxNumPoints, maxNumRangeData);
+}
+
+
+void SensorSharedMemoryPublisherItem::Impl::onPostDynamics()
+{
+    const double time = simulatorItem->currentTime();
+    for(auto& publisher : publishers){
+        if(!publisher->publish(time) && !publisher->isWriteFailureReported){
+            // The failure is reported only once because it usually occurs in every frame
+            os << formatR(_("{0}: The data of sensor \"{1}\" cannot be written to shared memory \"{2}\" "
+                            "because it exceeds the frame size of the shared memory.\n"),
+                          self->displayName(), publisher->device->name(), publisher->writer.name());
+            publisher->isWriteFailureReported = true;
+        }
+    }
+}
+
+
+/**
+   The data set to the device by a vision simulator is written to the shared memory once.
+   The data is not published when neither the image nor the points nor the range data have
+   been replaced since the last publication, or when the device does not have any data yet.
+   The time of a frame is the time when the data was captured, which precedes the time when
+   the data is set to the device by the delay of the sensor.
+
+   \return false if the data cannot be written
+*/
+bool SensorPublisher::publish(double time)
+{
+    const Image* image = nullptr;
+    const RangeCamera::PointData* points = nullptr;
+    const RangeSensor::RangeData* rangeData = nullptr;
+    bool updated = false;
+
+    if(camera){
+        auto sharedImage = camera->sharedImage();
+        if(checkUpdate(lastImage, sharedImage)){
+            updated = true;
+        }
+        image = sharedImage.get();
+        if(rangeCamera){
+            auto sharedPoints = rangeCamera->sharedPoints();
+            if(checkUpdate(lastPoints, sharedPoints)){
+                updated = true;
+            }
+            points = sharedPoints.get();
+        }
+    } else if(rangeSensor){
+        auto sharedRangeData = rangeSensor->sharedRangeData();
+        if(checkUpdate(lastRangeData, sharedRangeData)){
+            updated = true;
+        }
+        rangeData = sharedRangeData.get();
+    }
+
+    if(updated){
+        const bool hasData =
+            (image && !image->empty()) || (points && !points->empty()) || (rangeData && !rangeData->empty());
+        if(hasData){
+            const double delay = camera ? camera->delay() : rangeSensor->delay();
+            return writer.write(time - delay, image, points, rangeData);
+        }
+    }
+    return true;
+}
+
+
+void SensorSharedMemoryPublisherItem::finalizeSimulation()
+{
+    impl->finalizeSimulation();
+}
+
+
+void SensorSharedMemoryPublisherItem::Impl::finalizeSimulation()
+{
+    publishers.clear();
+}
+
+
+void SensorSharedMemoryPublisherItem::doPutProperties(PutPropertyFunction& putProperty)
+{
+    SubSimulatorItem::doPutProperties(putProperty);
+    impl->doPutProperties(putProperty);
+}
+
+
+void SensorSharedMemoryPublisherItem::Impl::doPutProperties(PutPropertyFunction& putProperty)
+{
+    putProperty(_("Target bodies"), bodyNameListString,
+                [this](const string& names){ return updateNames(names, bodyNameListString, bodyNames); });
+    putProperty(_("Target sensors"), sensorNameListString,
+                [this](const string& names){ return updateNames(names, sensorNameListString, sensorNames); });
+    putProperty(_("Name prefix"), namePrefix, changeProperty(namePrefix));
+    putProperty.min(1)(_("Frame slots"), numFrameSlots, changeProperty(numFrameSlots));
+}
+
+
+bool SensorSharedMemoryPublisherItem::store(Archive& archive)
+{
+    SubSimulatorItem::store(archive);
+    return impl->store(archive);
+}
+
+
+bool SensorSharedMemoryPublisherItem::Impl::store(Archive& archive)
+{
+    writeElements(archive, "target_bodies", bodyNames, true);
+    writeElements(archive, "target_sensors", sensorNames, true);
+    archive.write("name_prefix", namePrefix, DOUBLE_QUOTED);
+    archive.write("num_frame_slots", numFrameSlots);
+    return true;
+}
+
+
+bool SensorSharedMemoryPublisherItem::restore(const Archive& archive)
+{
+    SubSimulatorItem::restore(archive);
+    return impl->restore(archive);
+}
+
+
+bool SensorSharedMemoryPublisherItem::Impl::restore(const Archive& archive)
+{
+    readElements(archive, "target_bodies", bodyNames);
+    bodyNameListString = getNameListString(bodyNames);
+    readElements(archive, "target_sensors", sensorNames);
+    sensorNameListString = getNameListString(sensorNames);
+
+    archive.read("name_prefix", namePrefix);
+    archive.read("num_frame_slots", numFrameSlots);
+    return true;
+}
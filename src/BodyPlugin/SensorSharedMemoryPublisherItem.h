@@ -0,0 +1,48 @@
+#ifndef CNOID_BODY_PLUGIN_SENSOR_SHARED_MEMORY_PUBLISHER_ITEM_H
+#define CNOID_BODY_PLUGIN_SENSOR_SHARED_MEMORY_PUBLISHER_ITEM_H
+
+#include "SubSimulatorItem.h"
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   This item publishes the data of the cameras, range cameras and range sensors in the
+   simulation to the POSIX shared memory objects so that the processes on the same host can
+   access the data without any serialization. The object of each sensor is named
+   "<prefix>_<body name>_<sensor name>" and its layout is defined in SensorDataSharedMemory.h.
+*/
+class CNOID_EXPORT SensorSharedMemoryPublisherItem : public SubSimulatorItem
+{
+public:
+    static void initializeClass(ExtensionManager* ext);
+
+    SensorSharedMemoryPublisherItem();
+    SensorSharedMemoryPublisherItem(const SensorSharedMemoryPublisherItem& org);
+    ~SensorSharedMemoryPublisherItem();
+
+    void setTargetBodies(const std::string& bodyNames);
+    void setTargetSensors(const std::string& sensorNames);
+    void setNamePrefix(const std::string& prefix);
+    void setNumFrameSlots(int n);
+
+    virtual bool initializeSimulation(SimulatorItem* simulatorItem) override;
+    virtual void finalizeSimulation() override;
+
+    class Impl;
+
+protected:
+    virtual Item* doCloneItem(CloneMap* cloneMap) const override;
+    virtual void doPutProperties(PutPropertyFunction& putProperty) override;
+    virtual bool store(Archive& archive) override;
+    virtual bool restore(const Archive& archive) override;
+
+private:
+    Impl* impl;
+};
+
+typedef ref_ptr<SensorSharedMemoryPublisherItem> SensorSharedMemoryPublisherItemPtr;
+
+}
+
+#endif
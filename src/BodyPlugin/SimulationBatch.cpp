@@ -0,0 +1,166 @@
+#include "SimulationBatch.h"
+#include "SimulatorItem.h"
+#include "WorldItem.h"
+#include <cnoid/BodyState>
+#include <cnoid/TaskScheduler>
+#include <cnoid/MessageView>
+#include <cnoid/Format>
+#include "gettext.h"
+
+using namespace std;
+using namespace cnoid;
+
+namespace cnoid {
+
+class SimulationBatch::Impl
+{
+public:
+    WorldItemPtr worldItem;
+    vector<SimulatorItemPtr> simulatorItems;
+
+    bool initialize(SimulatorItem* prototype, int numSimulations);
+    void finalize();
+    void step(int numFrames);
+};
+
+}
+
+
+SimulationBatch::SimulationBatch()
+{
+    impl = new Impl;
+}
+
+
+SimulationBatch::~SimulationBatch()
+{
+    impl->finalize();
+    delete impl;
+}
+
+
+bool SimulationBatch::initialize(SimulatorItem* prototype, int numSimulations)
+{
+    return impl->initialize(prototype, numSimulations);
+}
+
+
+bool SimulationBatch::Impl::initialize(SimulatorItem* prototype, int numSimulations)
+{
+    finalize();
+
+    worldItem = prototype->worldItem();
+    if(!worldItem){
+        MessageView::instance()->putln(
+            formatR(_("{} must be in a WorldItem to do simulation."), prototype->displayName()),
+            MessageView::Error);
+        return false;
+    }
+
+    // The initialization is done sequentially because it accesses the original body items
+    simulatorItems.reserve(numSimulations);
+    for(int i=0; i < numSimulations; ++i){
+        SimulatorItemPtr simulatorItem = static_cast<SimulatorItem*>(prototype->clone());
+        if(!simulatorItem->initializeHeadlessSimulation(worldItem)){
+            MessageView::instance()->putln(
+                formatR(_("Simulation {0} of the batch by {1} cannot be initialized."),
+                        i, prototype->displayName()),
+                MessageView::Error);
+            finalize();
+            return false;
+        }
+        simulatorItems.push_back(simulatorItem);
+    }
+
+    return true;
+}
+
+
+void SimulationBatch::finalize()
+{
+    impl->finalize();
+}
+
+
+void SimulationBatch::Impl::finalize()
+{
+    for(auto& simulatorItem : simulatorItems){
+        simulatorItem->finalizeHeadlessSimulation();
+    }
+    simulatorItems.clear();
+    worldItem.reset();
+}
+
+
+int SimulationBatch::numSimulations() const
+{
+    return impl->simulatorItems.size();
+}
+
+
+SimulatorItem* SimulationBatch::simulatorItem(int index) const
+{
+    return impl->simulatorItems[index];
+}
+
+
+void SimulationBatch::step(int numFrames)
+{
+    impl->step(numFrames);
+}
+
+
+void SimulationBatch::Impl::step(int numFrames)
+{
+    TaskScheduler::instance()->parallelFor(
+        0, simulatorItems.size(), 1,
+        [&](int begin, int end){
+            for(int i = begin; i < end; ++i){
+                auto simulatorItem = simulatorItems[i].get();
+                for(int j=0; j < numFrames; ++j){
+                    simulatorItem->stepHeadlessSimulation();
+                }
+            }
+        });
+}
+
+
+bool SimulationBatch::reset(int index)
+{
+    return impl->simulatorItems[index]->initializeHeadlessSimulation(impl->worldItem);
+}
+
+
+bool SimulationBatch::resetAll()
+{
+    bool result = true;
+    for(auto& simulatorItem : impl->simulatorItems){
+        if(!simulatorItem->initializeHeadlessSimulation(impl->worldItem)){
+            result = false;
+        }
+    }
+    return result;
+}
+
+
+int SimulationBatch::currentFrame(int index) const
+{
+    return impl->simulatorItems[index]->currentFrame();
+}
+
+
+double SimulationBatch::currentTime(int index) const
+{
+    return impl->simulatorItems[index]->currentTime();
+}
+
+
+void SimulationBatch::getBodyStates(int index, std::vector<BodyState>& out_states) const
+{
+    auto& simBodies = impl->simulatorItems[index]->simulationBodies();
+    const int n = simBodies.size();
+    out_states.resize(n);
+    for(int i=0; i < n; ++i){
+        out_states[i].storeStateOfBody(simBodies[i]->body());
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef CNOID_BODY_PLUGIN_SIMULATION_BATCH_H
+#define CNOID_BODY_PLUGIN_SIMULATION_BATCH_H
+
+#include <cnoid/Referenced>
+#include <vector>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+class SimulatorItem;
+class BodyState;
+
+/**
+   This class runs the simulations of a world with the clones of a simulator item in the world.
+   The simulations are independent of each other and they are stepped in parallel by the task
+   scheduler. Each simulation is done in the headless mode of SimulatorItem, so the controller
+   items, the recording and the GUI updates are not used in the simulations. The bodies can be
+   controlled by the functions added with SimulatorItem::addPreDynamicsFunction of each clone.
+
+   The mesh data of the bodies is shared by all the simulations, but the collision models are
+   not shared. Each simulation builds the models in its own collision detector because the
+   models also keep the state of the detector instance.
+*/
+class CNOID_EXPORT SimulationBatch : public Referenced
+{
+public:
+    SimulationBatch();
+    ~SimulationBatch();
+
+    /**
+       \param prototype The simulator item in the world to simulate
+       \return false if any of the simulations cannot be initialized
+    */
+    bool initialize(SimulatorItem* prototype, int numSimulations);
+    void finalize();
+
+    int numSimulations() const;
+    SimulatorItem* simulatorItem(int index) const;
+
+    //! All the simulations are stepped by the specified number of frames in parallel.
+    void step(int numFrames = 1);
+
+    //! The simulation is restarted from the initial states of the body items.
+    bool reset(int index);
+    bool resetAll();
+
+    int currentFrame(int index) const;
+    double currentTime(int index) const;
+
+    //! The states are stored in the order of SimulatorItem::simulationBodies.
+    void getBodyStates(int index, std::vector<BodyState>& out_states) const;
+
+private:
+    class Impl;
+    Impl* impl;
+};
+
+typedef ref_ptr<SimulationBatch> SimulationBatchPtr;
+
+}
+
+#endif
@@ -37,8 +37,13 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <set>
 #include <deque>
+#ifdef __linux__
+#include <pthread.h>
+#endif
 #include "gettext.h"
 
 using namespace std;
@@ -49,6 +54,10 @@ namespace {
 enum { RESOLUTION_TIMESTEP, RESOLUTION_FRAMERATE, RESOLUTION_TIMEBAR, N_TEMPORARL_RESOLUTION_TYPES };
 
 const char* realtimeSyncModeSymbols[] = { "off", "compensatory", "conservative" };
+const char* controllerThreadSyncModeSymbols[] = { "blocking", "spin" };
+
+// The time for which a thread polls the controller thread state before sleeping in the spin mode
+constexpr std::chrono::microseconds ControllerThreadSpinWaitTime(200);
 static const char* timeRangeModeSymbols[] = { "unlimited", "specified", "timebar" };
 
 typedef map<weak_ref_ptr<BodyItem>, SimulationBodyPtr> BodyItemToSimBodyMap;
@@ -107,10 +116,14 @@ public:
     std::thread controlThread;
     std::condition_variable controlCondition;
     std::mutex controlMutex;
-    bool isExitingControlLoopRequested;
-    bool isControlRequested;
-    bool isControlFinished;
+    std::atomic<bool> isExitingControlLoopRequested;
+    // The control is requested by incrementing the request counter, and the controller thread
+    // sets the finish counter to the request counter when it finishes the control.
+    std::atomic<unsigned int> controlRequestCounter;
+    std::atomic<unsigned int> controlFinishCounter;
+    std::atomic<int> numSleepingControlThreads;
     bool isControlToBeContinued;
+    bool isSpinWaitEnabled;
 
     std::mutex logMutex;
     ReferencedPtr lastLogFrameObject;
@@ -143,7 +156,12 @@ public:
     virtual bool setNoDelayMode(bool on) override;
     virtual bool isSimulationFromInitialState() const override;
 
+    void startControlThread(int cpuIndex);
+    void requestControlInThread();
     bool waitForControlInThreadToFinish();
+    void exitControlThread();
+    template<class Predicate> void waitForControlThreadState(Predicate isReady);
+    void notifyControlThreadStateChange();
     void concurrentControlLoop();    
 };
 
@@ -192,9 +210,33 @@ public:
     bool areShapesCloned;
     bool doRecord;
 
-    // This buf always has the first element to keep unchanged states
-    BodyStateSeq bodyStateBuf;
+    /*
+      The states are buffered into bodyStateBuf by the simulation thread, and the buffer is
+      swapped with flushingBodyStateBuf when the records are flushed in the main thread.
+      Each buf always has the first element to keep unchanged states.
+    */
+    BodyStateSeq bodyStateBufs[2];
+    BodyStateSeq* bodyStateBuf;
+    BodyStateSeq* flushingBodyStateBuf;
     int currentBodyStateBufIndex;
+    int flushingBodyStateBufIndex;
+
+    /*
+      The states discarded from the buffers and the records are recycled via the pools
+      so that the data storage of a state is reused without the heap allocation.
+      Each pool is paired with the buffer and swapped together with it.
+    */
+    vector<BodyState> bodyStatePools[2];
+    vector<BodyState>* bodyStatePool;
+    vector<BodyState>* flushingBodyStatePool;
+
+    /*
+      The cloned device states are reused in the order they were recorded
+      when the states are no longer referenced by the records.
+    */
+    vector<std::deque<DeviceStatePtr>> deviceStatePools;
+    size_t maxNumPooledDeviceStates;
+    
     int numLinksToRecord;
     int numJointsToRecord;
     int numDevicesToRecord;
@@ -225,6 +267,10 @@ public:
     void bufferBodyKinematicState(Body* body, BodyStateBlock& stateBlock);
     void bufferBodyDeviceState(Body* body, BodyStateBlock& stateBlock, BodyStateBlock& prevStateBlock);
     void bufferBodyDeviceState(Body* body, BodyStateBlock& stateBlock);
+    DeviceState* cloneDeviceState(Device* device, int index);
+    void recycleBodyState(vector<BodyState>& pool, BodyState& state);
+    void recycleBufferedFrames(int begin);
+    void swapRecordBuffers();
     void flushRecords();
     void flushRecordsToBodyMotionItems();
     void flushRecordsToLastStateBuffers();
@@ -257,6 +303,8 @@ public:
     double worldTimeStep_;
     int frameAtLastBufferWriting;
     int numBufferedFrames;
+    int frameAtLastFlushing;
+    int numFlushingFrames;
     Timer flushTimer;
     Signal<void()> sigLogFlushRequested;
 
@@ -276,6 +324,7 @@ public:
 
     shared_ptr<CollisionSeq> collisionSeq;
     deque<shared_ptr<CollisionLinkPairList>> collisionPairsBuf;
+    deque<shared_ptr<CollisionLinkPairList>> flushingCollisionPairsBuf;
 
     Selection recordingMode;
     Selection timeRangeMode;
@@ -289,9 +338,12 @@ public:
     bool isActiveControlTimeRangeMode;
     bool useControllerThreads;
     bool useControllerThreadsProperty;
+    Selection controllerThreadSyncMode;
+    bool isControllerThreadCpuPinningEnabled;
     bool isAllLinkPositionOutputMode;
     bool isDeviceStateOutputEnabled;
     bool isDoingSimulationLoop;
+    bool isDoingHeadlessSimulation;
     volatile bool stopRequested;
     volatile bool pauseRequested;
     bool isCollisionDataRecordingEnabled;
@@ -357,6 +409,9 @@ public:
     void resetSimulatorItemForControllerItem(ControllerItem* controllerItem);
     bool startSimulation(bool doReset);
     bool initializeSimulation(bool doReset);
+    bool initializeHeadlessSimulation(WorldItem* worldItem, bool doReset);
+    void stepHeadlessSimulation();
+    void finalizeHeadlessSimulation();
     virtual void run() override;
     void onSimulationLoopStarted();
     void updateSimBodyLists();
@@ -365,6 +420,7 @@ public:
     void bufferCollisionRecords();
     void startFlushTimer();
     void flushRecords();
+    void swapRecordBuffers();
     int flushMainRecords();
     void stopSimulation(bool isForced, bool doSync);
     void pauseSimulation();
@@ -709,6 +765,12 @@ SimulationBody::Impl::Impl(SimulationBody* self, Body* body)
     isActive = false;
     isDynamic = false;
     doRecord = false;
+    bodyStateBuf = &bodyStateBufs[0];
+    flushingBodyStateBuf = &bodyStateBufs[1];
+    bodyStatePool = &bodyStatePools[0];
+    flushingBodyStatePool = &bodyStatePools[1];
+    currentBodyStateBufIndex = 0;
+    flushingBodyStateBufIndex = 0;
 }
 
 
@@ -755,7 +817,6 @@ bool SimulationBody::Impl::initialize(SimulatorItem* simulatorItem, BodyItem* bo
 {
     simImpl = simulatorItem->impl;
     this->bodyItem = bodyItem;
-    continuousUpdateEntries.push_back(bodyItem->startContinuousUpdate());
     deviceStateConnections.disconnect();
     controllerInfos.clear();
     recordItemPrefix = simImpl->self->name() + "-" + bodyItem->name();
@@ -764,7 +825,14 @@ bool SimulationBody::Impl::initialize(SimulatorItem* simulatorItem, BodyItem* bo
     body_->initializeState();
 
     isDynamic = !body_->isStaticModel();
-    extractAssociatedItems();
+
+    if(simImpl->isDoingHeadlessSimulation){
+        // The body item is shared with other simulations and it must not be updated
+        parentOfRecordItems = bodyItem;
+    } else {
+        continuousUpdateEntries.push_back(bodyItem->startContinuousUpdate());
+        extractAssociatedItems();
+    }
 
     isActive = isDynamic || (body_->numDevices() > 0);
     
@@ -882,7 +950,12 @@ void SimulationBody::initializeRecordBuffers()
 void SimulationBody::Impl::initializeRecordBuffers()
 {
     currentBodyStateBufIndex = 0;
-    bodyStateBuf.clear();
+    flushingBodyStateBufIndex = 0;
+    bodyStateBuf->clear();
+    flushingBodyStateBuf->clear();
+    bodyStatePool->clear();
+    flushingBodyStatePool->clear();
+    deviceStatePools.clear();
     bodyMotionEngine.reset();
     lastStateBuf.clear();
     hasLastState = false;
@@ -906,6 +979,7 @@ void SimulationBody::Impl::initializeRecordBuffers()
         const DeviceList<>& devices = body_->devices();
         numDevicesToRecord = devices.size();
         deviceStateChangeFlag.resize(numDevicesToRecord, true); // set all the bits to store the initial states
+        deviceStatePools.resize(numDevicesToRecord);
         for(size_t i=0; i < devices.size(); ++i){
             deviceStateConnections.add(
                 devices[i]->sigStateChanged().connect(
@@ -917,15 +991,28 @@ void SimulationBody::Impl::initializeRecordBuffers()
         }
     }
 
+    if(!simImpl->isRecordingEnabled){
+        maxNumPooledDeviceStates = 1000;
+    } else if(simImpl->isRingBufferMode){
+        // The states are released when they are popped from the ring buffer of the records
+        maxNumPooledDeviceStates = std::min(simImpl->ringBufferSize, 1000000) + 1000;
+    } else {
+        // The states are never released in the full recording mode
+        maxNumPooledDeviceStates = 0;
+    }
+
     if(numLinksToRecord || numJointsToRecord || numDevicesToRecord){
         doRecord = true;
-        bodyStateBuf.setNumLinkPositionsHint(numLinksToRecord);
-        bodyStateBuf.setNumJointDisplacementsHint(numJointsToRecord);
-        bodyStateBuf.setNumDeviceStatesHint(numDevicesToRecord);
-        bodyStateBuf.setFrameRate(simImpl->worldFrameRate);
-        // This buf always has the first element to keep unchanged device states
-        bodyStateBuf.appendAllocatedFrame();
+        for(auto& buf : bodyStateBufs){
+            buf.setNumLinkPositionsHint(numLinksToRecord);
+            buf.setNumJointDisplacementsHint(numJointsToRecord);
+            buf.setNumDeviceStatesHint(numDevicesToRecord);
+            buf.setFrameRate(simImpl->worldFrameRate);
+            // This buf always has the first element to keep unchanged device states
+            buf.appendAllocatedFrame();
+        }
         currentBodyStateBufIndex = 1;
+        flushingBodyStateBufIndex = 1;
     } else {
         doRecord = false;
     }
@@ -1009,13 +1096,18 @@ void SimulationBody::Impl::bufferRecords()
 
         if(!simImpl->needToBufferAllFrames){
             if(currentBodyStateBufIndex >= 2){
-                bodyStateBuf[0] = std::move(bodyStateBuf[1]);
-                bodyStateBuf.popBack();
+                std::swap((*bodyStateBuf)[0], (*bodyStateBuf)[1]);
+                recycleBodyState(*bodyStatePool, (*bodyStateBuf)[1]);
+                bodyStateBuf->popBack();
                 currentBodyStateBufIndex = 1;
             }
         }
 
-        auto& state = bodyStateBuf.append();
+        auto& state = bodyStateBuf->append();
+        if(!bodyStatePool->empty()){
+            state = std::move(bodyStatePool->back());
+            bodyStatePool->pop_back();
+        }
         
         if(!body_->existence()){
             state.clear();
@@ -1039,7 +1131,7 @@ void SimulationBody::Impl::bufferRecords()
 
             if(numDevicesToRecord){
                 const int prevIndex = std::max(0, currentBodyStateBufIndex - 1);
-                auto& prevState = bodyStateBuf.frame(prevIndex);
+                auto& prevState = bodyStateBuf->frame(prevIndex);
                 auto prevStateBlock = prevState.firstBlock();
                 auto block = state.firstBlock();
                 bufferBodyDeviceState(body_, block, prevStateBlock);
@@ -1080,7 +1172,7 @@ void SimulationBody::Impl::bufferBodyDeviceState(Body* body, BodyStateBlock& sta
 {
     for(int i=0; i < numDevicesToRecord; ++i){
         if(deviceStateChangeFlag[i]){
-            stateBlock.setDeviceState(i, body->device(i)->cloneState());
+            stateBlock.setDeviceState(i, cloneDeviceState(body->device(i), i));
             deviceStateChangeFlag[i] = false;
         } else {
             stateBlock.setDeviceState(i, prevStateBlock.deviceState(i));
@@ -1092,12 +1184,77 @@ void SimulationBody::Impl::bufferBodyDeviceState(Body* body, BodyStateBlock& sta
 void SimulationBody::Impl::bufferBodyDeviceState(Body* body, BodyStateBlock& stateBlock)
 {
     for(int i=0; i < numDevicesToRecord; ++i){
-        stateBlock.setDeviceState(i, body->device(i)->cloneState());
+        stateBlock.setDeviceState(i, cloneDeviceState(body->device(i), i));
         deviceStateChangeFlag[i] = false;
     }
 }
 
 
+DeviceState* SimulationBody::Impl::cloneDeviceState(Device* device, int index)
+{
+    auto& pool = deviceStatePools[index];
+
+    // The oldest state is available if it is only referenced by the pool
+    if(!pool.empty() && pool.front()->refCount() == 1){
+        DeviceStatePtr state = pool.front();
+        pool.pop_front();
+        state->copyStateFrom(*device);
+        pool.push_back(state);
+        return state;
+    }
+
+    DeviceState* state = device->cloneState();
+    if(pool.size() < maxNumPooledDeviceStates){
+        pool.push_back(state);
+    }
+    return state;
+}
+
+
+void SimulationBody::Impl::recycleBodyState(vector<BodyState>& pool, BodyState& state)
+{
+    // Release the device states so that they can be reused by the device state pools
+    state.clear();
+    pool.push_back(std::move(state));
+}
+
+
+/**
+   This function is called by the main thread to put the frames from the specified index
+   of the flushing buffer into the pool, and shrinks the buffer to the first element.
+   The frames before the index must have been moved to the records.
+*/
+void SimulationBody::Impl::recycleBufferedFrames(int begin)
+{
+    const int n = flushingBodyStateBuf->numFrames();
+    for(int i = begin; i < n; ++i){
+        recycleBodyState(*flushingBodyStatePool, flushingBodyStateBuf->frame(i));
+    }
+    flushingBodyStateBuf->resize(1);
+}
+
+
+/**
+   This function is called by the main thread with the record buffer mutex locked, and it
+   only swaps the buffers so that the simulation thread is not blocked by the flushing.
+*/
+void SimulationBody::Impl::swapRecordBuffers()
+{
+    if(!doRecord || bodyStateBuf->numFrames() <= 1){
+        return;
+    }
+    std::swap(bodyStateBuf, flushingBodyStateBuf);
+    std::swap(bodyStatePool, flushingBodyStatePool);
+    flushingBodyStateBufIndex = currentBodyStateBufIndex;
+
+    // The new buffer has usually been shrunk to the first element by the last flushing
+    bodyStateBuf->resize(1);
+    const int lastFrameIndex = std::max(0, flushingBodyStateBufIndex - 1);
+    bodyStateBuf->front() = flushingBodyStateBuf->frame(lastFrameIndex);
+    currentBodyStateBufIndex = 1;
+}
+
+
 void SimulationBody::flushRecords()
 {
     impl->flushRecords();
@@ -1120,35 +1277,35 @@ void SimulationBody::Impl::flushRecordsToBodyMotionItems()
     bool offsetChanged = false;
 
     // Step 1 (Use the move copy)
-    int lastFrameIndex = currentBodyStateBufIndex - 1;
+    int lastFrameIndex = flushingBodyStateBufIndex - 1;
     // The follwoing loop begins with the second element to skip the first element that retains the unchanged device states
     for(int i=1; i < lastFrameIndex; ++i){
         bodyStateRecord->append();
         if(bodyStateRecord->numFrames() > ringBufferSize){
+            recycleBodyState(*flushingBodyStatePool, bodyStateRecord->front());
             bodyStateRecord->popFront();
             offsetChanged = true;
         }
-        bodyStateRecord->back() = std::move(bodyStateBuf.frame(i));
+        bodyStateRecord->back() = std::move(flushingBodyStateBuf->frame(i));
     }
 
     // Step 2 (Copy the last frame with the device states retained)
     if(lastFrameIndex >= 1){
         bodyStateRecord->append();
         if(bodyStateRecord->numFrames() > ringBufferSize){
+            recycleBodyState(*flushingBodyStatePool, bodyStateRecord->front());
             bodyStateRecord->popFront();
             offsetChanged = true;
         }
-        auto& lastState = bodyStateBuf.frame(lastFrameIndex);
-        bodyStateRecord->back() = lastState;
-        bodyStateBuf.front().assign(std::move(lastState), true, false);
+        bodyStateRecord->back() = std::move(flushingBodyStateBuf->frame(lastFrameIndex));
     }
 
     // This buf always has the first element to keep unchanged device states
-    bodyStateBuf.resize(1);
-    currentBodyStateBufIndex = 1;
+    recycleBufferedFrames(std::max(1, lastFrameIndex + 1));
+    flushingBodyStateBufIndex = 1;
 
     if(offsetChanged){
-        const int nextFrame = simImpl->currentFrame + 1;
+        const int nextFrame = simImpl->frameAtLastFlushing + 1;
         int offset = nextFrame - ringBufferSize;
         bodyStateRecord->setOffsetTimeFrame(offset);
     }
@@ -1158,19 +1315,17 @@ void SimulationBody::Impl::flushRecordsToBodyMotionItems()
 // This function is called in the no-recording mode.
 void SimulationBody::Impl::flushRecordsToLastStateBuffers()
 {
-    if(currentBodyStateBufIndex <= 1){
+    if(flushingBodyStateBufIndex <= 1){
         hasLastState = false;
 
     } else {
-        int lastFrameIndex = currentBodyStateBufIndex - 1;
-        auto& lastState = bodyStateBuf.frame(lastFrameIndex);
-        lastStateBuf = lastState;
-        bodyStateBuf.front().assign(std::move(lastState), true, false);
+        int lastFrameIndex = flushingBodyStateBufIndex - 1;
+        std::swap(lastStateBuf, flushingBodyStateBuf->frame(lastFrameIndex));
         hasLastState = true;
 
         // This buf always has the first element to keep unchanged device states
-        bodyStateBuf.resize(1);
-        currentBodyStateBufIndex = 1;
+        recycleBufferedFrames(1);
+        flushingBodyStateBufIndex = 1;
     }
 }
 
@@ -1190,9 +1345,9 @@ void SimulationBody::Impl::flushRecordsToWorldLogFile(int bufferFrame)
 
     log->beginBodyStateOutput();
 
-    if(bufferFrame < bodyStateBuf.numFrames()){
+    if(bufferFrame + 1 < flushingBodyStateBuf->numFrames()){
         // Skip the front frame that retains the unchanged device states
-        auto& state = bodyStateBuf.frame(bufferFrame + 1);
+        auto& state = flushingBodyStateBuf->frame(bufferFrame + 1);
         if(numLinksToRecord){
             log->outputLinkPositions(state.linkPositionData(), numLinksToRecord);
         }
@@ -1234,6 +1389,7 @@ SimulatorItem::Impl::Impl(SimulatorItem* self)
       recordingMode(NumRecordingModes, CNOID_GETTEXT_DOMAIN_NAME),
       timeRangeMode(NumTimeRangeModes, CNOID_GETTEXT_DOMAIN_NAME),
       realtimeSyncMode(NumRealtimeSyncModes, CNOID_GETTEXT_DOMAIN_NAME),
+      controllerThreadSyncMode(NumControllerThreadSyncModes, CNOID_GETTEXT_DOMAIN_NAME),
       mv(MessageView::instance())
 {
     worldItem = nullptr;
@@ -1249,6 +1405,8 @@ SimulatorItem::Impl::Impl(SimulatorItem* self)
     worldFrameRate = 1.0;
     worldTimeStep_ = 1.0;
     frameAtLastBufferWriting = 0;
+    frameAtLastFlushing = 0;
+    numFlushingFrames = 0;
     flushTimer.sigTimeout().connect([&](){ flushRecords(); });
 
     recordingMode.setSymbol(FullRecording, N_("full"));
@@ -1266,12 +1424,18 @@ SimulatorItem::Impl::Impl(SimulatorItem* self)
     realtimeSyncMode.setSymbol(ConservativeRealtimeSync, N_("On (Conservative)"));
     realtimeSyncMode.select(CompensatoryRealtimeSync);
 
+    controllerThreadSyncMode.setSymbol(BlockingControllerThreadSync, N_("Blocking"));
+    controllerThreadSyncMode.setSymbol(SpinControllerThreadSync, N_("Spin"));
+    controllerThreadSyncMode.select(BlockingControllerThreadSync);
+
     timeLength = 300.0; // 5 min.
     useControllerThreadsProperty = true;
+    isControllerThreadCpuPinningEnabled = false;
     isActiveControlTimeRangeMode = false;
     isAllLinkPositionOutputMode = true;
     isDeviceStateOutputEnabled = true;
     isDoingSimulationLoop = false;
+    isDoingHeadlessSimulation = false;
     isCollisionDataRecordingEnabled = false;
     isSceneViewEditModeBlockedDuringSimulation = false;
     isSimulationFromInitialState = false;
@@ -1300,6 +1464,8 @@ SimulatorItem::Impl::Impl(SimulatorItem* self, const Impl& org)
 
     timeLength = org.timeLength;
     useControllerThreadsProperty = org.useControllerThreadsProperty;
+    controllerThreadSyncMode = org.controllerThreadSyncMode;
+    isControllerThreadCpuPinningEnabled = org.isControllerThreadCpuPinningEnabled;
     isActiveControlTimeRangeMode = org.isActiveControlTimeRangeMode;
     isAllLinkPositionOutputMode = org.isAllLinkPositionOutputMode;
     isDeviceStateOutputEnabled = org.isDeviceStateOutputEnabled;
@@ -1312,6 +1478,9 @@ SimulatorItem::Impl::Impl(SimulatorItem* self, const Impl& org)
 SimulatorItem::~SimulatorItem()
 {
     impl->stopSimulation(true, true);
+    if(impl->isDoingHeadlessSimulation){
+        impl->clearSimulation();
+    }
     delete impl;
 }
 
@@ -1424,6 +1593,30 @@ void SimulatorItem::setRealtimeSyncMode(bool on)
 }
 
 
+void SimulatorItem::setControllerThreadSyncMode(int mode)
+{
+    impl->controllerThreadSyncMode.select(mode);
+}
+
+
+int SimulatorItem::controllerThreadSyncMode() const
+{
+    return impl->controllerThreadSyncMode.which();
+}
+
+
+void SimulatorItem::setControllerThreadCpuPinningEnabled(bool on)
+{
+    impl->isControllerThreadCpuPinningEnabled = on;
+}
+
+
+bool SimulatorItem::isControllerThreadCpuPinningEnabled() const
+{
+    return impl->isControllerThreadCpuPinningEnabled;
+}
+
+
 void SimulatorItem::setDeviceStateOutputEnabled(bool on)
 {
     impl->isDeviceStateOutputEnabled = on;
@@ -1666,6 +1859,14 @@ bool SimulatorItem::startSimulation(bool doReset)
 
 bool SimulatorItem::Impl::startSimulation(bool doReset)
 {
+    if(isDoingHeadlessSimulation){
+        mv->putln(
+            formatR(_("{0} cannot start the simulation because it is doing a headless simulation."),
+                    self->displayName()),
+            MessageView::Error);
+        return false;
+    }
+
     // Check if there is another active simulation in the same world
     for(auto& simulatorItem : worldItem->descendantItems<SimulatorItem>()){
         if(simulatorItem->isRunning()){
@@ -1863,6 +2064,8 @@ bool SimulatorItem::Impl::initializeSimulation(bool doReset)
     // Initialize recording
     numBufferedFrames = 0;
     frameAtLastBufferWriting = 0;
+    numFlushingFrames = 0;
+    frameAtLastFlushing = 0;
     for(auto& simBody : activeSimBodies){
         if(simBody->body()){
             simBody->impl->initializeRecording();
@@ -1872,6 +2075,7 @@ bool SimulatorItem::Impl::initializeSimulation(bool doReset)
     doRecordCollisionData = (isRecordingEnabled && isCollisionDataRecordingEnabled);
     if(doRecordCollisionData){
         collisionPairsBuf.clear();
+        flushingCollisionPairsBuf.clear();
         string collisionSeqName = self->name() + "-collisions";
         auto collisionSeqItem = worldItem->findChildItem<CollisionSeqItem>(collisionSeqName);
         if(collisionSeqItem){
@@ -1951,12 +2155,17 @@ bool SimulatorItem::Impl::initializeSimulation(bool doReset)
 
     useControllerThreads = useControllerThreadsProperty;
     if(useControllerThreads){
+        const int numCpus = std::thread::hardware_concurrency();
+        int cpuIndex = 0;
         for(auto& info : activeControllerInfos){
-            info->isExitingControlLoopRequested = false;
-            info->isControlRequested = false;
-            info->isControlFinished = false;
-            info->isControlToBeContinued = false;
-            info->controlThread = std::thread([info](){ info->concurrentControlLoop(); });
+            info->isSpinWaitEnabled = controllerThreadSyncMode.is(SpinControllerThreadSync);
+            if(isControllerThreadCpuPinningEnabled && numCpus > 1){
+                // The first core is left for the simulation thread
+                info->startControlThread(cpuIndex % (numCpus - 1) + 1);
+                ++cpuIndex;
+            } else {
+                info->startControlThread(-1);
+            }
         }
     }
 
@@ -2010,6 +2219,143 @@ bool SimulatorItem::Impl::initializeSimulation(bool doReset)
 }
 
 
+bool SimulatorItem::initializeHeadlessSimulation(WorldItem* worldItem, bool doReset)
+{
+    return impl->initializeHeadlessSimulation(worldItem, doReset);
+}
+
+
+bool SimulatorItem::Impl::initializeHeadlessSimulation(WorldItem* worldItem, bool doReset)
+{
+    if(isDoingSimulationLoop){
+        return false;
+    }
+    if(isDoingHeadlessSimulation){
+        finalizeHeadlessSimulation();
+    }
+    if(!this->worldItem){
+        // The item is not in the item tree
+        this->worldItem = worldItem;
+    }
+    if(!this->worldItem){
+        return false;
+    }
+
+    cloneMap.clear();
+    // The meshes are not modified in the simulation
+    SgObject::setNonNodeCloning(cloneMap, false);
+
+    currentFrame = 0;
+    currentTime_ = 0.0;
+    worldTimeStep_ = self->worldTimeStep();
+    worldFrameRate = 1.0 / worldTimeStep_;
+    maxFrame = std::numeric_limits<int>::max();
+    isRecordingEnabled = false;
+    isRingBufferMode = false;
+    needToBufferAllFrames = false;
+    doRecordCollisionData = false;
+    doStopSimulationWhenNoActiveControllers = false;
+    useControllerThreads = false;
+
+    clearSimulation();
+
+    isDoingHeadlessSimulation = true;
+
+    BodyState initialState;
+    for(auto& bodyItem : this->worldItem->descendantItems<BodyItem>()){
+        auto orgBody = bodyItem->body();
+        SimulationBodyPtr simBody = self->createSimulationBody(orgBody, cloneMap);
+        if(!simBody){
+            simBody = self->createSimulationBody(orgBody);
+        }
+        if(!simBody || !simBody->body()){
+            mv->putln(formatR(_("The clone of {0} for the simulation cannot be created."), orgBody->name()),
+                      MessageView::Warning);
+            continue;
+        }
+        if(doReset){
+            bodyItem->getInitialState(initialState);
+            initialState.restoreStateToBody(simBody->body());
+        }
+        simBodyMap[bodyItem] = simBody;
+        if(!simBody->initialize(self, bodyItem)){
+            simBodyMap.erase(bodyItem);
+        } else {
+            allSimBodies.push_back(simBody);
+            simBodiesWithBody.push_back(simBody);
+        }
+    }
+
+    extForceFunctionId = stdx::nullopt;
+    virtualElasticStringFunctionId = stdx::nullopt;
+
+    cloneMap.replacePendingObjects();
+
+    if(!self->initializeSimulation(simBodiesWithBody)){
+        clearSimulation();
+        isDoingHeadlessSimulation = false;
+        return false;
+    }
+
+    for(auto& simBody : allSimBodies){
+        if(simBody->impl->isActive){
+            activeSimBodies.push_back(simBody);
+        }
+    }
+
+    if(!self->completeInitializationOfSimulation()){
+        clearSimulation();
+        isDoingHeadlessSimulation = false;
+        return false;
+    }
+
+    return true;
+}
+
+
+void SimulatorItem::stepHeadlessSimulation()
+{
+    impl->stepHeadlessSimulation();
+}
+
+
+void SimulatorItem::Impl::stepHeadlessSimulation()
+{
+    preDynamicsFunctions.call();
+    midDynamicsFunctions.call();
+    self->stepSimulation(activeSimBodies);
+    postDynamicsFunctions.call();
+
+    ++currentFrame;
+    currentTime_ = currentFrame / worldFrameRate;
+}
+
+
+void SimulatorItem::finalizeHeadlessSimulation()
+{
+    impl->finalizeHeadlessSimulation();
+}
+
+
+void SimulatorItem::Impl::finalizeHeadlessSimulation()
+{
+    if(isDoingHeadlessSimulation){
+        self->finalizeSimulation();
+        clearSimulation();
+        isDoingHeadlessSimulation = false;
+        if(!self->isConnectedToRoot()){
+            worldItem = nullptr;
+        }
+    }
+}
+
+
+bool SimulatorItem::isDoingHeadlessSimulation() const
+{
+    return impl->isDoingHeadlessSimulation;
+}
+
+
 CloneMap& SimulatorItem::cloneMap()
 {
     return impl->cloneMap;
@@ -2167,12 +2513,7 @@ void SimulatorItem::Impl::run()
 
     if(useControllerThreads){
         for(auto& info : activeControllerInfos){
-            {
-                std::lock_guard<std::mutex> lock(info->controlMutex);
-                info->isExitingControlLoopRequested = true;
-            }
-            info->controlCondition.notify_all();
-            info->controlThread.join();
+            info->exitControlThread();
         }
     }
 
@@ -2210,11 +2551,7 @@ bool SimulatorItem::Impl::stepSimulationMain()
                 hasNoDelayModeControllers = true;
             }
             info->controllerItem->input();
-            {
-                std::lock_guard<std::mutex> lock(info->controlMutex);                
-                info->isControlRequested = true;
-            }
-            info->controlCondition.notify_all();
+            info->requestControlInThread();
         }
         if(hasNoDelayModeControllers){
             // Todo: Process the controller that finishes control earlier first to
@@ -2263,47 +2600,109 @@ bool SimulatorItem::Impl::stepSimulationMain()
 }
 
 
-bool ControllerInfo::waitForControlInThreadToFinish()
+void ControllerInfo::startControlThread(int cpuIndex)
 {
-    std::unique_lock<std::mutex> lock(controlMutex);
-    while(!isControlFinished){
-        controlCondition.wait(lock);
+    isExitingControlLoopRequested = false;
+    controlRequestCounter = 0;
+    controlFinishCounter = 0;
+    numSleepingControlThreads = 0;
+    isControlToBeContinued = false;
+
+    controlThread = std::thread([this](){ concurrentControlLoop(); });
+
+    if(cpuIndex >= 0){
+#ifdef __linux__
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpuIndex, &cpuSet);
+        if(pthread_setaffinity_np(controlThread.native_handle(), sizeof(cpu_set_t), &cpuSet) != 0){
+            simImpl->mv->putln(
+                formatR(_("The thread of {0} cannot be pinned to CPU {1}."), controllerItem->displayName(), cpuIndex),
+                MessageView::Warning);
+        }
+#endif
     }
-    isControlFinished = false;
+}
+
+
+void ControllerInfo::requestControlInThread()
+{
+    ++controlRequestCounter;
+    notifyControlThreadStateChange();
+}
+
+
+bool ControllerInfo::waitForControlInThreadToFinish()
+{
+    waitForControlThreadState([&](){ return controlFinishCounter == controlRequestCounter; });
     return isControlToBeContinued;
 }
 
 
-void ControllerInfo::concurrentControlLoop()
+void ControllerInfo::exitControlThread()
 {
-    while(true){
-        {
-            std::unique_lock<std::mutex> lock(controlMutex);
-            while(true){
-                if(isExitingControlLoopRequested){
-                    goto exitConcurrentControlLoop;
-                }
-                if(isControlRequested){
-                    isControlRequested = false;
-                    isControlToBeContinued = false;
+    isExitingControlLoopRequested = true;
+    notifyControlThreadStateChange();
+    controlThread.join();
+}
+
+
+/**
+   The state is polled for a while in the spin mode before sleeping on the condition variable.
+   The sleeping threads are counted so that the notifying thread can skip locking the mutex
+   when no thread is sleeping.
+*/
+template<class Predicate>
+void ControllerInfo::waitForControlThreadState(Predicate isReady)
+{
+    if(isSpinWaitEnabled){
+        auto deadline = std::chrono::steady_clock::now() + ControllerThreadSpinWaitTime;
+        int counter = 0;
+        while(!isReady()){
+            if((++counter & 0xff) == 0){
+                if(std::chrono::steady_clock::now() > deadline){
                     break;
                 }
-                controlCondition.wait(lock);
+                std::this_thread::yield();
             }
         }
+    }
+    if(!isReady()){
+        std::unique_lock<std::mutex> lock(controlMutex);
+        ++numSleepingControlThreads;
+        controlCondition.wait(lock, isReady);
+        --numSleepingControlThreads;
+    }
+}
 
-        bool doContinue = controllerItem->control();
-        
-        {
-            std::lock_guard<std::mutex> lock(controlMutex);
-            isControlFinished = true;
-            isControlToBeContinued = doContinue;
-        }
+
+void ControllerInfo::notifyControlThreadStateChange()
+{
+    if(numSleepingControlThreads > 0){
+        std::lock_guard<std::mutex> lock(controlMutex);
         controlCondition.notify_all();
     }
+}
+
+
+void ControllerInfo::concurrentControlLoop()
+{
+    unsigned int requestCounter = 0;
     
-exitConcurrentControlLoop:
-    return;
+    while(true){
+        waitForControlThreadState(
+            [&](){ return isExitingControlLoopRequested || controlRequestCounter != requestCounter; });
+
+        if(isExitingControlLoopRequested){
+            break;
+        }
+        requestCounter = controlRequestCounter;
+
+        isControlToBeContinued = controllerItem->control();
+        
+        controlFinishCounter = requestCounter;
+        notifyControlThreadStateChange();
+    }
 }
 
 
@@ -2360,14 +2759,34 @@ void SimulatorItem::Impl::flushRecords()
 }
 
 
-int SimulatorItem::Impl::flushMainRecords()
+/**
+   The buffers written by the simulation thread are swapped with the flushing buffers so that
+   the simulation thread only waits for the swapping while the records are flushed.
+*/
+void SimulatorItem::Impl::swapRecordBuffers()
 {
     recordBufMutex.lock();
 
+    for(auto& simBody : activeSimBodies){
+        simBody->impl->swapRecordBuffers();
+    }
+    collisionPairsBuf.swap(flushingCollisionPairsBuf);
+    numFlushingFrames = numBufferedFrames;
+    frameAtLastFlushing = frameAtLastBufferWriting;
+    numBufferedFrames = 0;
+
+    recordBufMutex.unlock();
+}
+
+
+int SimulatorItem::Impl::flushMainRecords()
+{
+    swapRecordBuffers();
+
     if(worldLogFileItem){
-        if(numBufferedFrames > 0){
-            int firstFrame = frameAtLastBufferWriting - (numBufferedFrames - 1);
-            for(int bufFrame = 0; bufFrame < numBufferedFrames; ++bufFrame){
+        if(numFlushingFrames > 0){
+            int firstFrame = frameAtLastFlushing - (numFlushingFrames - 1);
+            for(int bufFrame = 0; bufFrame < numFlushingFrames; ++bufFrame){
                 double time = (firstFrame + bufFrame) * worldTimeStep_;
                 while(time >= nextLogTime){
                     worldLogFileItem->beginFrameOutput(time);
@@ -2388,27 +2807,22 @@ int SimulatorItem::Impl::flushMainRecords()
     bool offsetChanged;
     if(doRecordCollisionData){
         offsetChanged = false;
-        for(size_t i=0 ; i < collisionPairsBuf.size(); ++i){
+        for(size_t i=0 ; i < flushingCollisionPairsBuf.size(); ++i){
             if(collisionSeq->numFrames() >= ringBufferSize){
                 collisionSeq->popFrontFrame();
                 offsetChanged = true;
             }
             CollisionSeq::Frame collisionSeq0 = collisionSeq->appendFrame();
-            collisionSeq0[0] = collisionPairsBuf[i];
+            collisionSeq0[0] = flushingCollisionPairsBuf[i];
         }
         if(offsetChanged){
-            collisionSeq->setOffsetTimeFrame(currentFrame + 1 - collisionSeq->numFrames());
+            collisionSeq->setOffsetTimeFrame(frameAtLastFlushing + 1 - collisionSeq->numFrames());
         }
     }
-    collisionPairsBuf.clear();
+    flushingCollisionPairsBuf.clear();
+    numFlushingFrames = 0;
 
-    int frame = frameAtLastBufferWriting;
-    
-    numBufferedFrames = 0;
-    
-    recordBufMutex.unlock();
-
-    return frame;
+    return frameAtLastFlushing;
 }
 
 
@@ -2497,6 +2911,9 @@ void SimulatorItem::Impl::onSimulationLoopStopped(bool isForced)
     }
 
     flushRecords();
+    if(worldLogFileItem){
+        worldLogFileItem->finishOutput();
+    }
     logEngine->stopOngoingTimeUpdate();
 
     mv->notify(formatR(_("Simulation by {0} has finished at {1} [s]."), self->displayName(), finishTime));
@@ -2789,6 +3206,10 @@ void SimulatorItem::Impl::doPutProperties(PutPropertyFunction& putProperty)
                 changeProperty(isCollisionDataRecordingEnabled));
     putProperty(_("Controller Threads"), useControllerThreadsProperty,
                 changeProperty(useControllerThreadsProperty));
+    putProperty(_("Controller thread sync"), controllerThreadSyncMode,
+                [&](int index){ return controllerThreadSyncMode.select(index); });
+    putProperty(_("Pin controller threads"), isControllerThreadCpuPinningEnabled,
+                changeProperty(isControllerThreadCpuPinningEnabled));
     putProperty(_("Controller options"), controllerOptionString_,
                 changeProperty(controllerOptionString_));
     putProperty(_("Block scene view edit mode"), isSceneViewEditModeBlockedDuringSimulation,
@@ -2818,6 +3239,8 @@ bool SimulatorItem::Impl::store(Archive& archive)
     archive.write("output_all_link_positions", isAllLinkPositionOutputMode);
     archive.write("output_device_states", isDeviceStateOutputEnabled);
     archive.write("use_controller_threads", useControllerThreadsProperty);
+    archive.write("controller_thread_sync_mode", controllerThreadSyncModeSymbols[controllerThreadSyncMode.which()]);
+    archive.write("pin_controller_threads", isControllerThreadCpuPinningEnabled);
     archive.write("record_collision_data", isCollisionDataRecordingEnabled);
     archive.write("controller_options", controllerOptionString_, DOUBLE_QUOTED);
     archive.write("block_scene_view_edit_mode", isSceneViewEditModeBlockedDuringSimulation);
@@ -2908,6 +3331,14 @@ bool SimulatorItem::Impl::restore(const Archive& archive)
     archive.read({ "output_device_states", "deviceStateOutput" }, isDeviceStateOutputEnabled);
     archive.read({ "record_collision_data", "recordCollisionData" }, isCollisionDataRecordingEnabled);
     archive.read({ "use_controller_threads", "controllerThreads" }, useControllerThreadsProperty);
+    if(archive.read("controller_thread_sync_mode", symbol)){
+        for(int i=0; i < NumControllerThreadSyncModes; ++i){
+            if(symbol == controllerThreadSyncModeSymbols[i]){
+                controllerThreadSyncMode.select(i);
+            }
+        }
+    }
+    archive.read("pin_controller_threads", isControllerThreadCpuPinningEnabled);
     archive.read({ "controller_options", "controllerOptions" }, controllerOptionString_);
     archive.read({ "block_scene_view_edit_mode", "scene_view_edit_mode_blocking" },
                  isSceneViewEditModeBlockedDuringSimulation);
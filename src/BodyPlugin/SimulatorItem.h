@@ -160,6 +160,24 @@ public:
 
     [[deprecated("Use setRealtimeSyncMode(int mode)")]]
     void setRealtimeSyncMode(bool on);
+
+    /**
+       Synchronization between the simulation thread and the controller threads.
+       In the spin mode, the waiting thread polls the state for a short time before sleeping,
+       which reduces the latency of the handshake in every frame at the cost of CPU time.
+    */
+    enum ControllerThreadSyncMode {
+        BlockingControllerThreadSync,
+        SpinControllerThreadSync,
+        NumControllerThreadSyncModes
+    };
+
+    void setControllerThreadSyncMode(int mode);
+    int controllerThreadSyncMode() const;
+
+    //! The controller threads are pinned to different CPU cores. This is only supported on Linux.
+    void setControllerThreadCpuPinningEnabled(bool on);
+    bool isControllerThreadCpuPinningEnabled() const;
     
     void setSlowerThanRealtimeEnabled(bool on);
     
@@ -174,6 +192,18 @@ public:
     const std::string& controllerOptionString() const;
 
     void setSceneViewEditModeBlockedDuringSimulation(bool on);    
+
+    /**
+       The headless simulation is initialized and stepped by the caller without the simulation
+       thread, the controllers, the recording and the GUI updates. The item does not have to be
+       in the item tree, so the clones of a simulator item can simulate the world of the original
+       item independently of each other. The mesh data of the original bodies is shared with
+       the simulation bodies. SimulationBatch uses these functions to run the clones in parallel.
+    */
+    bool initializeHeadlessSimulation(WorldItem* worldItem, bool doReset = true);
+    void stepHeadlessSimulation();
+    void finalizeHeadlessSimulation();
+    bool isDoingHeadlessSimulation() const;
     
     /**
        For sub simulators
@@ -28,9 +28,27 @@
 #include <QDateTime>
 #include <QElapsedTimer>
 #include <fstream>
+#include <cstdio>
 #include <stack>
+#include <deque>
 #include <map>
 #include <regex>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "gettext.h"
 
 using namespace std;
@@ -49,35 +67,457 @@ enum DataTypeID {
     BODY_STATE,
     LINK_POSITIONS,
     JOINT_POSITIONS,
-    DEVICE_STATES
+    DEVICE_STATES,
+    // The following blocks are the deltas from the positions of a key frame
+    LINK_POSITION_DELTAS,
+    JOINT_POSITION_DELTAS
 };
 
+const int defaultKeyFrameInterval = 100;
+const double defaultQuantizationStep = 1.0e-6;
+
 struct CorruptLogException { };
 
+const char* outputSyncModeSymbols[] = { "none", "flush", "data" };
+
+const char frameIndexFileSignature[] = { 'C', 'W', 'L', 'I' };
+const int frameIndexFileVersion = 1;
+
+struct FrameIndexEntry
+{
+    float time;
+    int pos;
+};
+
+bool operator<(double time, const FrameIndexEntry& entry)
+{
+    return time < entry.time;
+}
+
+const int defaultMaxOutputQueueSize = 64 * 1024 * 1024;
+// The queue size in bytes must be representable by int
+const int maxOutputQueueSizeInMegaBytes = std::numeric_limits<int>::max() / (1024 * 1024);
+
+
+/**
+   The encoded frames are passed to this writer and written to the file by its own thread
+   so that the thread outputting the frames is not blocked by the file I/O.
+*/
+class LogFileWriter
+{
+public:
+    int syncMode;
+    size_t maxQueueSize;
+    bool hasWriteError;
+
+    LogFileWriter();
+    ~LogFileWriter();
+    bool open(const string& filename);
+    bool isOpen() const { return fp != nullptr; }
+    void close();
+    size_t numPushedBytes() const { return numPushedBytes_; }
+    void push(vector<char>& data);
+    WorldLogFileItem::OutputStatistics statistics();
+
+private:
+    FILE* fp;
+    std::thread writerThread;
+    std::mutex queueMutex;
+    std::condition_variable queueCondition;
+    std::condition_variable roomCondition;
+    deque<vector<char>> queue;
+    vector<vector<char>> spareBuffers;
+    size_t numPendingBytes;
+    size_t numPushedBytes_;
+    bool isClosing;
+    WorldLogFileItem::OutputStatistics statistics_;
+
+    void writeQueuedData();
+    void syncFile();
+};
+
+
+LogFileWriter::LogFileWriter()
+{
+    syncMode = WorldLogFileItem::FlushOutputSync;
+    maxQueueSize = defaultMaxOutputQueueSize;
+    statistics_ = WorldLogFileItem::OutputStatistics();
+    hasWriteError = false;
+    fp = nullptr;
+    numPendingBytes = 0;
+    numPushedBytes_ = 0;
+    isClosing = false;
+}
+
+
+LogFileWriter::~LogFileWriter()
+{
+    close();
+}
+
+
+bool LogFileWriter::open(const string& filename)
+{
+    close();
+
+#ifndef _WIN32
+    /*
+      The existing file is removed instead of being truncated because accessing the truncated
+      part of a file mapped by a reader in the live playback causes SIGBUS.
+    */
+    std::remove(filename.c_str());
+#endif
+    fp = std::fopen(filename.c_str(), "wb");
+    if(!fp){
+        return false;
+    }
+    // The frames are batched in this buffer to reduce the number of the system calls
+    std::setvbuf(fp, nullptr, _IOFBF, 1024 * 1024);
+
+    statistics_ = WorldLogFileItem::OutputStatistics();
+    hasWriteError = false;
+    numPendingBytes = 0;
+    numPushedBytes_ = 0;
+    isClosing = false;
+    writerThread = std::thread([this](){ writeQueuedData(); });
+
+    return true;
+}
+
+
+void LogFileWriter::close()
+{
+    if(fp){
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            isClosing = true;
+        }
+        queueCondition.notify_all();
+        writerThread.join();
+        if(syncMode == WorldLogFileItem::DataOutputSync){
+            syncFile();
+        }
+        std::fclose(fp);
+        fp = nullptr;
+    }
+    queue.clear();
+    spareBuffers.clear();
+}
+
+
+/**
+   The data is moved to the queue and the argument is replaced with a spare buffer that
+   retains the capacity of the buffers already written.
+*/
+void LogFileWriter::push(vector<char>& data)
+{
+    if(!fp || data.empty()){
+        data.clear();
+        return;
+    }
+    const size_t size = data.size();
+    
+    std::unique_lock<std::mutex> lock(queueMutex);
+
+    if(numPendingBytes > 0 && numPendingBytes + size > maxQueueSize){
+        auto waitStart = std::chrono::steady_clock::now();
+        roomCondition.wait(
+            lock, [&](){ return numPendingBytes == 0 || numPendingBytes + size <= maxQueueSize; });
+        std::chrono::duration<double> waitTime = std::chrono::steady_clock::now() - waitStart;
+        ++statistics_.numBlockedFrames;
+        statistics_.blockedTime += waitTime.count();
+    }
+    
+    queue.push_back(std::move(data));
+    numPendingBytes += size;
+    numPushedBytes_ += size;
+    if(static_cast<int>(numPendingBytes) > statistics_.maxQueuedBytes){
+        statistics_.maxQueuedBytes = numPendingBytes;
+    }
+    if(!spareBuffers.empty()){
+        data = std::move(spareBuffers.back());
+        spareBuffers.pop_back();
+    }
+    data.clear();
+    
+    lock.unlock();
+    queueCondition.notify_one();
+}
+
+
+WorldLogFileItem::OutputStatistics LogFileWriter::statistics()
+{
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return statistics_;
+}
+
+
+void LogFileWriter::writeQueuedData()
+{
+    deque<vector<char>> batch;
+    
+    std::unique_lock<std::mutex> lock(queueMutex);
+    
+    while(true){
+        queueCondition.wait(lock, [&](){ return !queue.empty() || isClosing; });
+        if(queue.empty()){
+            break;
+        }
+        batch.swap(queue);
+        lock.unlock();
+
+        size_t batchSize = 0;
+        for(auto& data : batch){
+            if(std::fwrite(&data.front(), 1, data.size(), fp) != data.size()){
+                hasWriteError = true;
+            }
+            batchSize += data.size();
+        }
+        if(syncMode != WorldLogFileItem::NoOutputSync){
+            if(std::fflush(fp) != 0){
+                hasWriteError = true;
+            }
+            if(syncMode == WorldLogFileItem::DataOutputSync){
+                syncFile();
+            }
+        }
+
+        lock.lock();
+        numPendingBytes -= batchSize;
+        statistics_.writtenBytes += batchSize;
+        ++statistics_.numBatchWrites;
+        // Keep a few buffers to avoid reallocating them for every frame
+        while(!batch.empty()){
+            if(spareBuffers.size() < 8){
+                spareBuffers.push_back(std::move(batch.front()));
+            }
+            batch.pop_front();
+        }
+        roomCondition.notify_all();
+    }
+}
+
+
+void LogFileWriter::syncFile()
+{
+    std::fflush(fp);
+#ifdef _WIN32
+    _commit(_fileno(fp));
+#elif defined(__APPLE__)
+    fsync(fileno(fp));
+#else
+    fdatasync(fileno(fp));
+#endif
+}
+
+/**
+   The file mapped to the memory for reading the log without copying the data.
+   The mapping is extended when the requested data is beyond the mapped size and the file has
+   grown, which happens in the live playback of the log being recorded.
+   The read position is kept like the one of a stream.
+*/
+class MappedLogFile
+{
+public:
+    MappedLogFile();
+    ~MappedLogFile();
+    bool open(const filesystem::path& path);
+    bool is_open() const { return isOpen; }
+    void close();
+    void seekg(size_t pos) { position = pos; }
+    size_t tellg() const { return position; }
+    const char* data() const { return mappedData; }
+    bool ensureSize(size_t size);
+
+private:
+    bool isOpen;
+    const char* mappedData;
+    size_t mappedSize;
+    size_t position;
+#ifdef _WIN32
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+#else
+    int fd;
+#endif
+    bool map();
+    void unmap();
+};
+
+
+MappedLogFile::MappedLogFile()
+{
+    isOpen = false;
+    mappedData = nullptr;
+    mappedSize = 0;
+    position = 0;
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mappingHandle = nullptr;
+#else
+    fd = -1;
+#endif
+}
+
+
+MappedLogFile::~MappedLogFile()
+{
+    close();
+}
+
+
+bool MappedLogFile::open(const filesystem::path& path)
+{
+    close();
+#ifdef _WIN32
+    // The writer must be able to continue writing the file in the live playback
+    fileHandle = CreateFileW(
+        path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(fileHandle == INVALID_HANDLE_VALUE){
+        return false;
+    }
+#else
+    fd = ::open(path.string().c_str(), O_RDONLY);
+    if(fd < 0){
+        return false;
+    }
+#endif
+    isOpen = true;
+    position = 0;
+    map();
+    return true;
+}
+
+
+void MappedLogFile::close()
+{
+    unmap();
+#ifdef _WIN32
+    if(fileHandle != INVALID_HANDLE_VALUE){
+        CloseHandle(fileHandle);
+        fileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if(fd >= 0){
+        ::close(fd);
+        fd = -1;
+    }
+#endif
+    isOpen = false;
+    position = 0;
+}
+
+
+//! Maps the whole current file if its size has changed. An empty file is not mapped.
+bool MappedLogFile::map()
+{
+#ifdef _WIN32
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(fileHandle, &fileSize)){
+        return false;
+    }
+    if(static_cast<size_t>(fileSize.QuadPart) == mappedSize){
+        return mappedData != nullptr;
+    }
+    unmap();
+    if(fileSize.QuadPart == 0){
+        return false;
+    }
+    mappingHandle = CreateFileMappingW(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(!mappingHandle){
+        return false;
+    }
+    auto p = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+    if(!p){
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+        return false;
+    }
+    mappedData = static_cast<const char*>(p);
+    mappedSize = fileSize.QuadPart;
+#else
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0){
+        return false;
+    }
+    if(static_cast<size_t>(fileStat.st_size) == mappedSize){
+        return mappedData != nullptr;
+    }
+    unmap();
+    if(fileStat.st_size == 0){
+        return false;
+    }
+    void* p = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED){
+        return false;
+    }
+    mappedData = static_cast<const char*>(p);
+    mappedSize = fileStat.st_size;
+#endif
+
+    return true;
+}
+
+
+void MappedLogFile::unmap()
+{
+    if(mappedData){
+#ifdef _WIN32
+        UnmapViewOfFile(mappedData);
+        CloseHandle(mappingHandle);
+        mappingHandle = nullptr;
+#else
+        munmap(const_cast<char*>(mappedData), mappedSize);
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+}
+
+
+/**
+   \return true if the data up to the size is available.
+   \note The pointer returned by data() is changed when the file is remapped.
+*/
+bool MappedLogFile::ensureSize(size_t size)
+{
+    if(size <= mappedSize){
+        return true;
+    }
+    if(!isOpen){
+        return false;
+    }
+    map();
+    return size <= mappedSize;
+}
+
+
+/**
+   The view of the log data from the read position of the file at the time when clear()
+   is called. The data is not copied, and checkSize only checks that the data is available.
+*/
 class ReadBuf
 {
 public:
-    vector<char> data;
-    ifstream& ifs;
+    MappedLogFile& file;
+    size_t startPos;
+    int size_;
     int pos;
 
-    ReadBuf(ifstream& ifs)
-        : ifs(ifs) {
+    ReadBuf(MappedLogFile& file)
+        : file(file) {
+        startPos = 0;
+        size_ = 0;
         pos = 0;
     }
 
     bool checkSize(int size){
-        int left = data.size() - pos;
-        if(left < size){
-            int len = size - left;
-            data.resize(data.size() + len);
-            ifs.read(&data[pos], len);
-            if(!ifs.fail()){
-                return true;
-            } else {
-                ifs.clear();
+        if(size_ - pos < size){
+            if(!file.ensureSize(startPos + pos + size)){
                 return false;
             }
+            size_ = pos + size;
         }
         return true;
     }
@@ -98,62 +538,63 @@ public:
         return pos + size;
     }
 
-    char* buf() {
-        return &data.front();
+    const char* buf() {
+        return file.data() + startPos;
     }
 
     void clear(){
-        data.clear();
+        startPos = file.tellg();
+        size_ = 0;
         pos = 0;
     }
 
     int size() const {
-        return data.size();
+        return size_;
     }
 
-    char* current() {
-        return &data[pos];
+    const char* current() {
+        return buf() + pos;
     }
 
-    char* end() {
-        return &data.front() + data.size();
+    const char* end() {
+        return buf() + size_;
     }
 
     bool isEnd() {
-        return (pos >= static_cast<int>(data.size()));
+        return (pos >= size_);
     }
 
     void seek(int pos = 0) { this->pos = pos; }
 
     char readID(){
         ensureSize(1);
-        return data[pos++];
+        return buf()[pos++];
     }
 
     bool readBool(){
         ensureSize(1);
-        return data[pos++];
+        return buf()[pos++];
     }
 
     char readOctet(){
         ensureSize(1);
-        return data[pos++];
+        return buf()[pos++];
     }
 
     short readShort(){
         ensureSize(2);
-        unsigned char low = data[pos++];
-        unsigned char high = data[pos++];
+        unsigned char low = buf()[pos++];
+        unsigned char high = buf()[pos++];
         short value = low + (high << 8);
         return value;
     }
 
     int readInt(){
         ensureSize(4);
-        unsigned char d0 = data[pos++];
-        unsigned char d1 = data[pos++];
-        unsigned char d2 = data[pos++];
-        unsigned char d3 = data[pos++];
+        unsigned char d0 = buf()[pos++];
+        unsigned char d1 = buf()[pos++];
+        unsigned char d2 = buf()[pos++];
+        unsigned char d3 = buf()[pos++];
         int value = d0 + (d1 << 8) + (d2 << 16) + (d3 << 24);
         return value;
     }
@@ -166,13 +607,26 @@ public:
         return offset;
     }
 
+    //! Reads a zigzag-encoded variable-length integer
+    int readVarInt(){
+        unsigned int value = 0;
+        for(int shift = 0; shift < 35; shift += 7){
+            unsigned char byte = readOctet();
+            value |= static_cast<unsigned int>(byte & 0x7f) << shift;
+            if(!(byte & 0x80)){
+                return static_cast<int>(value >> 1) ^ -static_cast<int>(value & 1);
+            }
+        }
+        throw CorruptLogException();
+    }
+
     float readFloat(){
         ensureSize(sizeof(float));
         float value;
         char* p = (char*)&value;
         const int n = sizeof(float);
         for(int i=0; i < n; ++i){
-            p[i] = data[pos++];
+            p[i] = buf()[pos++];
         }
         return value;
     }
@@ -201,7 +655,7 @@ public:
         std::string str;
         str.reserve(size);
         for(int i=0; i < size; ++i){
-            str.append(1, data[pos++]);
+            str.append(1, buf()[pos++]);
         }
         return str;
     }
@@ -212,11 +666,11 @@ class WriteBuf
 {
 public:
     vector<char> data;
-    ofstream& ofs;
+    LogFileWriter& writer;
     size_t seekOffset;
 
-    WriteBuf(ofstream& ofs)
-        : ofs(ofs) {
+    WriteBuf(LogFileWriter& writer)
+        : writer(writer) {
         seekOffset = 0;
     }
     
@@ -234,7 +688,7 @@ public:
 
     void clear(){
         data.clear();
-        seekOffset = ofs.tellp();
+        seekOffset = writer.numPushedBytes();
     }
 
     int size() const {
@@ -242,8 +696,7 @@ public:
     }
 
     void flush(){
-        ofs.write(&data.front(), data.size());
-        ofs.flush();
+        writer.push(data);
         clear();
     }
         
@@ -290,6 +743,16 @@ public:
         writeInt(pos, offset);
     }
     
+    //! Writes a zigzag-encoded variable-length integer
+    void writeVarInt(int value){
+        unsigned int zigzag = (static_cast<unsigned int>(value) << 1) ^ static_cast<unsigned int>(value >> 31);
+        while(zigzag >= 0x80){
+            data.push_back(static_cast<char>((zigzag & 0x7f) | 0x80));
+            zigzag >>= 7;
+        }
+        data.push_back(static_cast<char>(zigzag));
+    }
+
     void writeFloat(float value){
         char* p = (char*)&value;
         const int n = sizeof(float);
@@ -333,12 +796,26 @@ public:
 };
 
 
+/**
+   The values of a key frame block which the delta blocks refer to.
+   The position is the seek position of the values in the log file.
+*/
+struct KeyFrameValues
+{
+    int seekPos;
+    vector<float> values;
+    KeyFrameValues() { seekPos = -1; }
+};
+
+
 class BodyInfo : public Referenced
 {
 public:
     BodyItem* bodyItem;
     Body* body;
     vector<DeviceInfo> deviceInfos;
+    KeyFrameValues keyLinkPositions;
+    KeyFrameValues keyJointPositions;
     
     BodyInfo(BodyItem* bodyItem){
         this->bodyItem = bodyItem;
@@ -404,10 +881,28 @@ public:
     bool isTimeStampSuffixEnabled;
     vector<string> bodyNames;
     
-    ofstream ofs;
+    LogFileWriter writer;
     WriteBuf writeBuf;
+    Selection outputSyncMode;
     int lastOutputFramePos;
+    vector<FrameIndexEntry> outputFrameIndex;
     double recordingFrameRate;
+
+    // for the delta encoding of the positions
+    bool isDeltaEncodingEnabled;
+    int keyFrameInterval;
+    double quantizationStep;
+    int numFramesFromKeyFrame;
+    bool isKeyFrame;
+    int outputBodyIndex;
+    struct OutputKeyFrameValues {
+        KeyFrameValues linkPositions;
+        KeyFrameValues jointPositions;
+    };
+    vector<OutputKeyFrameValues> outputKeyFrameValues;
+    vector<float> floatWriteBuf;
+    vector<int> deltaWriteBuf;
+    vector<float> decodedValues;
     stack<int> sizeHeaderStack;
 
     // for device state recording and playback
@@ -426,7 +921,7 @@ public:
     vector<double> doubleWriteBuf;
 
     filesystem::path readFilePath;
-    ifstream ifs;
+    MappedLogFile mappedFile;
     ReadBuf readBuf;
     ReadBuf readBuf2;
     int currentReadFramePos;
@@ -436,6 +931,10 @@ public:
     bool isCurrentFrameDataLoaded;
     bool isOverRange;
 
+    // The time and the position of the frames read so far or loaded from the index file
+    vector<FrameIndexEntry> frameIndex;
+    int nextFrameIndexPos;
+
     vector<BodyInfoPtr> bodyInfos;
     ScopedConnection worldSubTreeChangedConnection;
     bool isBodyInfoUpdateNeeded;
@@ -460,6 +959,10 @@ public:
     void onWorldSubTreeChanged();
     bool readTopHeader();
     bool readFrameHeader(int pos);
+    string getFrameIndexFilename();
+    bool loadFrameIndexFile();
+    void saveFrameIndexFile();
+    void extendFrameIndex(double time);
     bool seek(double time);
     bool seekToLivePlaybackLastFrame();
     bool loadCurrentFrameData();
@@ -468,14 +971,20 @@ public:
     void readBodyState(BodyInfo* bodyInfo, double time);
     int readLinkPositions(Body* body);
     int readJointPositions(Body* body);
+    int readDeltaEncodedValues(KeyFrameValues& key, int elementSize);
+    int readLinkPositionDeltas(BodyInfo* bodyInfo);
+    int readJointPositionDeltas(BodyInfo* bodyInfo);
     void readDeviceStates(BodyInfo* bodyInfo, double time);
     void readDeviceState(DeviceInfo& devInfo, Device* device, ReadBuf& buf, int size);
     void readLastDeviceState(DeviceInfo& devInfo, Device* device);
     void clearOutput();
+    void finishOutput();
     void reserveSizeHeader();
     void fixSizeHeader();
     void endHeaderOutput();
     void beginFrameOutput(double time);
+    void outputPositions(
+        DataTypeID fullDataType, DataTypeID deltaDataType, KeyFrameValues& key, int numElements, int elementSize);
     void outputDeviceState(DeviceState* state);
     void exchangeDeviceStateCacheArrays();
     void openDialogToSelectDirectoryToSavePlaybackArchive();
@@ -534,12 +1043,20 @@ WorldLogFileItem::WorldLogFileItem()
 
 WorldLogFileItem::Impl::Impl(WorldLogFileItem* self)
     : self(self),
-      writeBuf(ofs),
-      readBuf(ifs),
-      readBuf2(ifs)
-{
+      writeBuf(writer),
+      outputSyncMode(WorldLogFileItem::NumOutputSyncModes, CNOID_GETTEXT_DOMAIN_NAME),
+      readBuf(mappedFile),
+      readBuf2(mappedFile)
+{
+    outputSyncMode.setSymbol(WorldLogFileItem::NoOutputSync, N_("None"));
+    outputSyncMode.setSymbol(WorldLogFileItem::FlushOutputSync, N_("Flush"));
+    outputSyncMode.setSymbol(WorldLogFileItem::DataOutputSync, N_("Data sync"));
+    outputSyncMode.select(WorldLogFileItem::FlushOutputSync);
     isTimeStampSuffixEnabled = false;
     recordingFrameRate = 0.0;
+    isDeltaEncodingEnabled = false;
+    keyFrameInterval = defaultKeyFrameInterval;
+    quantizationStep = defaultQuantizationStep;
     isBodyInfoUpdateNeeded = true;
     livePlaybackTimer = nullptr;
     livePlaybackLogFileSize = 0;
@@ -558,12 +1075,17 @@ WorldLogFileItem::WorldLogFileItem(const WorldLogFileItem& org)
 
 WorldLogFileItem::Impl::Impl(WorldLogFileItem* self, Impl& org)
     : self(self),
-      writeBuf(ofs),
-      readBuf(ifs),
-      readBuf2(ifs)
+      writeBuf(writer),
+      outputSyncMode(org.outputSyncMode),
+      readBuf(mappedFile),
+      readBuf2(mappedFile)
 {
+    writer.maxQueueSize = org.writer.maxQueueSize;
     isTimeStampSuffixEnabled = org.isTimeStampSuffixEnabled;
     recordingFrameRate = org.recordingFrameRate;
+    isDeltaEncodingEnabled = org.isDeltaEncodingEnabled;
+    keyFrameInterval = org.keyFrameInterval;
+    quantizationStep = org.quantizationStep;
     currentReadFramePos = 0;
     isBodyInfoUpdateNeeded = true;
     livePlaybackTimer = nullptr;
@@ -716,14 +1238,16 @@ bool WorldLogFileItem::Impl::readTopHeader()
     currentReadFrameDataSize = 0;
     prevReadFrameOffset = 0;
     currentReadFrameTime = -1.0;
+    frameIndex.clear();
+    nextFrameIndexPos = 0;
     
-    if(ifs.is_open()){
-        ifs.close();
+    if(mappedFile.is_open()){
+        mappedFile.close();
     }
     readFilePath = filesystem::path(fromUTF8(getActualFilename()));
     if(filesystem::exists(readFilePath)){
-        ifs.open(readFilePath.string(), ios::in | ios::binary);
-        if(ifs.is_open()){
+        mappedFile.open(readFilePath);
+        if(mappedFile.is_open()){
             readBuf.clear();
             try {
                 int headerSize = readBuf.readSeekOffset();
@@ -732,6 +1256,8 @@ bool WorldLogFileItem::Impl::readTopHeader()
                         bodyNames.push_back(readBuf.readString());
                     }
                     currentReadFramePos = readBuf.pos;
+                    nextFrameIndexPos = readBuf.pos;
+                    loadFrameIndexFile();
                     result = readFrameHeader(readBuf.pos);
                 }
             } catch(CorruptLogException&){
@@ -752,20 +1278,14 @@ bool WorldLogFileItem::Impl::readFrameHeader(int pos)
 {
     isCurrentFrameDataLoaded = false;
     
-    if(!ifs.is_open()){
-        return false;
-    }
-
-    ifs.seekg(pos);
-
-    if(ifs.eof()){
-        ifs.seekg(currentReadFramePos);
+    if(!mappedFile.is_open()){
         return false;
     }
 
+    mappedFile.seekg(pos);
     readBuf.clear();
     if(!readBuf.checkSize(frameHeaderSize)){
-        ifs.seekg(currentReadFramePos);
+        mappedFile.seekg(currentReadFramePos);
         return false;
     }
 
@@ -779,12 +1299,12 @@ bool WorldLogFileItem::Impl::readFrameHeader(int pos)
     } catch(CorruptLogException&){
         bodyNames.clear();
         mout->putErrorln(formatR(_("Log file of {0} is corrupt."), self->displayName()));
-        ifs.seekg(currentReadFramePos);
+        mappedFile.seekg(currentReadFramePos);
         return false;
     }
 
     if(!readBuf.checkSize(currentReadFrameDataSize)){
-        ifs.seekg(currentReadFramePos);
+        mappedFile.seekg(currentReadFramePos);
         return false;
     }
     
@@ -797,6 +1317,122 @@ bool WorldLogFileItem::Impl::readFrameHeader(int pos)
 }
         
         
+string WorldLogFileItem::Impl::getFrameIndexFilename()
+{
+    return getActualFilename() + ".index";
+}
+
+
+/**
+   The index file contains the time and the position of every frame in the log file.
+   It is ignored if the size of the log file is different from the size when the index file
+   was written, and the index is built from the frame headers in that case.
+*/
+bool WorldLogFileItem::Impl::loadFrameIndexFile()
+{
+    stdx::error_code ec;
+    auto indexFilePath = filesystem::path(fromUTF8(getFrameIndexFilename()));
+    if(!filesystem::exists(indexFilePath, ec)){
+        return false;
+    }
+    MappedLogFile indexFile;
+    if(!indexFile.open(indexFilePath)){
+        return false;
+    }
+    ReadBuf buf(indexFile);
+    try {
+        buf.ensureSize(sizeof(frameIndexFileSignature));
+        if(!std::equal(frameIndexFileSignature, frameIndexFileSignature + sizeof(frameIndexFileSignature), buf.current())){
+            return false;
+        }
+        buf.seek(sizeof(frameIndexFileSignature));
+        if(buf.readInt() != frameIndexFileVersion){
+            return false;
+        }
+        std::uintmax_t logFileSize = static_cast<unsigned int>(buf.readInt());
+        logFileSize |= static_cast<std::uintmax_t>(static_cast<unsigned int>(buf.readInt())) << 32;
+        if(logFileSize != filesystem::file_size(readFilePath, ec) || ec){
+            return false;
+        }
+        int numFrames = buf.readSeekOffset();
+        buf.ensureSize(numFrames * (sizeof(float) + sizeof(int)));
+        vector<FrameIndexEntry> entries(numFrames);
+        for(auto& entry : entries){
+            entry.time = buf.readFloat();
+            entry.pos = buf.readSeekOffset();
+        }
+        frameIndex = std::move(entries);
+        nextFrameIndexPos = logFileSize;
+    }
+    catch(CorruptLogException&){
+        return false;
+    }
+    return true;
+}
+
+
+void WorldLogFileItem::Impl::saveFrameIndexFile()
+{
+    stdx::error_code ec;
+    std::uintmax_t logFileSize = filesystem::file_size(fromUTF8(getActualFilename()), ec);
+    if(ec){
+        return;
+    }
+    vector<char> data;
+    data.reserve(20 + outputFrameIndex.size() * (sizeof(float) + sizeof(int)));
+    auto writeInt = [&data](int value){
+        for(int i=0; i < 4; ++i){
+            data.push_back((value >> (8 * i)) & 0xff);
+        }
+    };
+    data.insert(data.end(), frameIndexFileSignature, frameIndexFileSignature + sizeof(frameIndexFileSignature));
+    writeInt(frameIndexFileVersion);
+    writeInt(logFileSize & 0xffffffff);
+    writeInt(logFileSize >> 32);
+    writeInt(outputFrameIndex.size());
+    for(auto& entry : outputFrameIndex){
+        const char* p = (const char*)&entry.time;
+        data.insert(data.end(), p, p + sizeof(float));
+        writeInt(entry.pos);
+    }
+    ofstream indexFile(fromUTF8(getFrameIndexFilename()).c_str(), ios::out | ios::binary | ios::trunc);
+    indexFile.write(&data.front(), data.size());
+}
+
+
+/**
+   The frame headers after the indexed frames are read until the first frame after the time
+   is found. The frames whose data is not completely written yet are not indexed.
+*/
+void WorldLogFileItem::Impl::extendFrameIndex(double time)
+{
+    if(!mappedFile.is_open() || nextFrameIndexPos <= 0){
+        return;
+    }
+    
+    while(frameIndex.empty() || frameIndex.back().time <= time){
+        mappedFile.seekg(nextFrameIndexPos);
+        readBuf2.clear();
+        FrameIndexEntry entry;
+        int dataSize;
+        try {
+            readBuf2.readSeekOffset(); // offset to the prev frame
+            entry.time = readBuf2.readFloat();
+            dataSize = readBuf2.readSeekOffset();
+        } catch(CorruptLogException&){
+            break;
+        }
+        const int nextPos = nextFrameIndexPos + frameHeaderSize + dataSize;
+        if(!mappedFile.ensureSize(nextPos)){
+            break;
+        }
+        entry.pos = nextFrameIndexPos;
+        frameIndex.push_back(entry);
+        nextFrameIndexPos = nextPos;
+    }
+}
+
+
 bool WorldLogFileItem::Impl::seek(double time)
 {
     isOverRange = false;
@@ -809,40 +1445,34 @@ bool WorldLogFileItem::Impl::seek(double time)
         return true;
     }
 
-    if(currentReadFrameTime < time){
-        while(true){
-            int pos = currentReadFramePos;
-            if(!readFrameHeader(currentReadFramePos + frameHeaderSize + currentReadFrameDataSize)){
-                isOverRange = true;
-                return (currentReadFrameTime >= 0.0);
-            }
-            if(currentReadFrameTime == time){
-                return true;
-            } else if(currentReadFrameTime > time){
-                return readFrameHeader(pos);
-            }
-        }
+    if(frameIndex.empty() || frameIndex.back().time <= time){
+        extendFrameIndex(time);
+    }
+    if(frameIndex.empty()){
+        isOverRange = true;
+        return false;
     }
 
-    // currentReadFrameTime > time
-    while(true){
-        if(prevReadFrameOffset <= 0){
+    // Find the last frame whose time is not later than the time
+    auto p = std::upper_bound(frameIndex.begin(), frameIndex.end(), time);
+    if(p == frameIndex.begin()){
+        isOverRange = true;
+    } else {
+        --p;
+        if(p + 1 == frameIndex.end() && p->time < time){
             isOverRange = true;
-            return (currentReadFrameTime >= 0.0);
-        }
-        if(!readFrameHeader(currentReadFramePos - prevReadFrameOffset)){
-            return false;
-        }
-        if(currentReadFrameTime <= time){
-            return true;
         }
     }
+    if(!readFrameHeader(p->pos)){
+        return false;
+    }
+    return isOverRange ? (currentReadFrameTime >= 0.0) : true;
 }
 
 
 bool WorldLogFileItem::Impl::loadCurrentFrameData()
 {
-    ifs.seekg(currentReadFramePos + frameHeaderSize);
+    mappedFile.seekg(currentReadFramePos + frameHeaderSize);
     readBuf.clear();
     isCurrentFrameDataLoaded = readBuf.checkSize(currentReadFrameDataSize);
     return isCurrentFrameDataLoaded;
@@ -934,6 +1564,20 @@ void WorldLogFileItem::Impl::readBodyState(BodyInfo* bodyInfo, double time)
                 updated = true;
             }
             break;
+        case LINK_POSITION_DELTAS:
+            numLinks = readLinkPositionDeltas(bodyInfo);
+            if(numLinks > 0){
+                updated = true;
+                if(numLinks > 1){
+                    doForwardKinematics = false;
+                }
+            }
+            break;
+        case JOINT_POSITION_DELTAS:
+            if(readJointPositionDeltas(bodyInfo)){
+                updated = true;
+            }
+            break;
         case DEVICE_STATES:
             if(updated){
                 bodyInfo->bodyItem->notifyKinematicStateChange(doForwardKinematics);
@@ -981,6 +1625,76 @@ int WorldLogFileItem::Impl::readJointPositions(Body* body)
 }
 
 
+/**
+   Reads the header of a delta block and decodes the values into decodedValues.
+   The values of the key frame are read from the file when they are not cached.
+   \return The number of the elements
+*/
+int WorldLogFileItem::Impl::readDeltaEncodedValues(KeyFrameValues& key, int elementSize)
+{
+    const int keyPos = readBuf.readSeekOffset();
+    const float step = readBuf.readFloat();
+    const int size = readBuf.readShort();
+
+    if(key.seekPos != keyPos){
+        key.seekPos = -1;
+        mappedFile.seekg(keyPos);
+        readBuf2.clear();
+        const int keySize = readBuf2.readShort();
+        // The key values are written in a preceding frame, so they must end before the current frame
+        if(keySize < 0 ||
+           static_cast<size_t>(keyPos) + 2 + static_cast<size_t>(keySize) * elementSize * sizeof(float) > readBuf.startPos){
+            throw CorruptLogException();
+        }
+        key.values.resize(keySize * elementSize);
+        for(auto& value : key.values){
+            value = readBuf2.readFloat();
+        }
+        key.seekPos = keyPos;
+    }
+    if(size < 0 || size * elementSize > static_cast<int>(key.values.size())){
+        throw CorruptLogException();
+    }
+    const int n = size * elementSize;
+    decodedValues.resize(n);
+    for(int i=0; i < n; ++i){
+        decodedValues[i] = key.values[i] + readBuf.readVarInt() * step;
+    }
+    return size;
+}
+
+
+int WorldLogFileItem::Impl::readLinkPositionDeltas(BodyInfo* bodyInfo)
+{
+    int endPos = readBuf.readNextBlockPos();
+    int size = readDeltaEncodedValues(bodyInfo->keyLinkPositions, 7);
+    Body* body = bodyInfo->body;
+    int n = std::min(size, body->numLinks());
+    for(int i=0; i < n; ++i){
+        const float* v = &decodedValues[i * 7];
+        Link* link = body->link(i);
+        link->p() = Vector3(v[0], v[1], v[2]);
+        link->R() = Quaternion(v[3], v[4], v[5], v[6]).normalized().toRotationMatrix();
+    }
+    readBuf.seek(endPos);
+    return n;
+}
+
+
+int WorldLogFileItem::Impl::readJointPositionDeltas(BodyInfo* bodyInfo)
+{
+    int endPos = readBuf.readNextBlockPos();
+    int size = readDeltaEncodedValues(bodyInfo->keyJointPositions, 1);
+    Body* body = bodyInfo->body;
+    int n = std::min(size, body->numAllJoints());
+    for(int i=0; i < n; ++i){
+        body->joint(i)->q() = decodedValues[i];
+    }
+    readBuf.seek(endPos);
+    return n;
+}
+
+
 void WorldLogFileItem::Impl::readDeviceStates(BodyInfo* bodyInfo, double time)
 {
     const int endPos = readBuf.readNextBlockPos();
@@ -1032,7 +1746,7 @@ void WorldLogFileItem::Impl::readLastDeviceState(DeviceInfo& devInfo, Device* de
             devInfo.isConsistent = true;
         }
     } else {
-        ifs.seekg(pos);
+        mappedFile.seekg(pos);
         devInfo.lastStateSeekPos = pos;
         readBuf2.clear();
         int size = readBuf2.readShort();
@@ -1065,17 +1779,24 @@ void WorldLogFileItem::Impl::clearOutput()
 {
     bodyNames.clear();
 
-    if(ifs.is_open()){
-        ifs.close();
-    }
-    if(ofs.is_open()){
-        ofs.close();
+    if(mappedFile.is_open()){
+        mappedFile.close();
     }
     recordingStartTime = QDateTime::currentDateTime();
-    
-    ofs.open(fromUTF8(getActualFilename()).c_str(), ios::out | ios::binary | ios::trunc);
+
+    writer.syncMode = outputSyncMode.which();
+    auto filename = getActualFilename();
+    // The index file of the previous log is not valid for the new log
+    stdx::error_code ec;
+    filesystem::remove(fromUTF8(getFrameIndexFilename()), ec);
+    if(!writer.open(fromUTF8(filename))){
+        mout->putErrorln(formatR(_("Log file \"{0}\" cannot be opened."), filename));
+    }
     writeBuf.clear();
     lastOutputFramePos = 0;
+    outputFrameIndex.clear();
+    numFramesFromKeyFrame = 0;
+    outputKeyFrameValues.clear();
 
     currentDeviceStateCacheArrayIndex = 0;
     exchangeDeviceStateCacheArrays();
@@ -1155,6 +1876,13 @@ void WorldLogFileItem::Impl::beginFrameOutput(double time)
         writeBuf.writeSeekOffset(0);
     }
     lastOutputFramePos = pos;
+    outputFrameIndex.push_back({ static_cast<float>(time), static_cast<int>(pos) });
+
+    isKeyFrame = (!isDeltaEncodingEnabled || numFramesFromKeyFrame == 0);
+    if(++numFramesFromKeyFrame >= keyFrameInterval){
+        numFramesFromKeyFrame = 0;
+    }
+    outputBodyIndex = -1;
     
     deviceIndex = 0;
     writeBuf.writeFloat(time);
@@ -1166,37 +1894,96 @@ void WorldLogFileItem::beginBodyStateOutput()
 {
     impl->writeBuf.writeID(BODY_STATE);
     impl->reserveSizeHeader();
+    if(++impl->outputBodyIndex >= static_cast<int>(impl->outputKeyFrameValues.size())){
+        impl->outputKeyFrameValues.resize(impl->outputBodyIndex + 1);
+    }
 }
 
 
 void WorldLogFileItem::outputLinkPositions(double* positions, int numLinkPositions)
 {
-    impl->writeBuf.writeID(LINK_POSITIONS);
-    impl->reserveSizeHeader();
-    impl->writeBuf.writeShort(numLinkPositions);
+    auto& buf = impl->floatWriteBuf;
+    buf.resize(numLinkPositions * 7);
+    float* v = buf.data();
     for(int i=0; i < numLinkPositions; ++i){
-        impl->writeBuf.writeFloat(positions[0]); // x
-        impl->writeBuf.writeFloat(positions[1]); // y
-        impl->writeBuf.writeFloat(positions[2]); // z
-        impl->writeBuf.writeFloat(positions[6]); // qw
-        impl->writeBuf.writeFloat(positions[3]); // qx
-        impl->writeBuf.writeFloat(positions[4]); // qy
-        impl->writeBuf.writeFloat(positions[5]); // qz
+        v[0] = positions[0]; // x
+        v[1] = positions[1]; // y
+        v[2] = positions[2]; // z
+        v[3] = positions[6]; // qw
+        v[4] = positions[3]; // qx
+        v[5] = positions[4]; // qy
+        v[6] = positions[5]; // qz
         positions += 7;
+        v += 7;
     }
-    impl->fixSizeHeader();
+    impl->outputPositions(
+        LINK_POSITIONS, LINK_POSITION_DELTAS,
+        impl->outputKeyFrameValues[impl->outputBodyIndex].linkPositions, numLinkPositions, 7);
 }    
 
 
 void WorldLogFileItem::outputJointPositions(double* values, int size)
 {
-    impl->writeBuf.writeID(JOINT_POSITIONS);
-    impl->reserveSizeHeader();
-    impl->writeBuf.writeShort(size);
+    auto& buf = impl->floatWriteBuf;
+    buf.resize(size);
     for(int i=0; i < size; ++i){
-        impl->writeBuf.writeFloat(values[i]);
+        buf[i] = values[i];
     }
-    impl->fixSizeHeader();
+    impl->outputPositions(
+        JOINT_POSITIONS, JOINT_POSITION_DELTAS,
+        impl->outputKeyFrameValues[impl->outputBodyIndex].jointPositions, size, 1);
+}
+
+
+/**
+   Outputs the values in floatWriteBuf. In the delta encoding mode, the values of the frames
+   between the key frames are written as the quantized deltas from the values of the last
+   key frame. The full values are written when the deltas cannot be represented.
+*/
+void WorldLogFileItem::Impl::outputPositions
+(DataTypeID fullDataType, DataTypeID deltaDataType, KeyFrameValues& key, int numElements, int elementSize)
+{
+    const int n = numElements * elementSize;
+    
+    // The step is rounded to float in the same way as the step written in the block
+    const float step = quantizationStep;
+    bool doOutputDeltas = false;
+    if(!isKeyFrame && key.seekPos >= 0 && static_cast<int>(key.values.size()) == n){
+        doOutputDeltas = true;
+        deltaWriteBuf.resize(n);
+        const double maxDelta = std::numeric_limits<int>::max() - 1;
+        for(int i=0; i < n; ++i){
+            double delta = (static_cast<double>(floatWriteBuf[i]) - key.values[i]) / step;
+            if(!(std::abs(delta) < maxDelta)){ // This is also false for NaN
+                doOutputDeltas = false;
+                break;
+            }
+            deltaWriteBuf[i] = static_cast<int>(std::lround(delta));
+        }
+    }
+
+    if(doOutputDeltas){
+        writeBuf.writeID(deltaDataType);
+        reserveSizeHeader();
+        writeBuf.writeSeekPos(key.seekPos);
+        writeBuf.writeFloat(step);
+        writeBuf.writeShort(numElements);
+        for(int i=0; i < n; ++i){
+            writeBuf.writeVarInt(deltaWriteBuf[i]);
+        }
+    } else {
+        writeBuf.writeID(fullDataType);
+        reserveSizeHeader();
+        if(isDeltaEncodingEnabled){
+            key.seekPos = writeBuf.seekPos();
+            key.values.assign(floatWriteBuf.begin(), floatWriteBuf.begin() + n);
+        }
+        writeBuf.writeShort(numElements);
+        for(int i=0; i < n; ++i){
+            writeBuf.writeFloat(floatWriteBuf[i]);
+        }
+    }
+    fixSizeHeader();
 }
 
 
@@ -1267,6 +2054,104 @@ void WorldLogFileItem::endFrameOutput()
 }
 
 
+void WorldLogFileItem::finishOutput()
+{
+    impl->finishOutput();
+}
+
+
+void WorldLogFileItem::Impl::finishOutput()
+{
+    if(!writer.isOpen()){
+        return;
+    }
+    writer.close();
+
+    if(writer.hasWriteError){
+        mout->putErrorln(
+            formatR(_("Some frames could not be written to the log file of {0}."), self->displayName()));
+    } else {
+        saveFrameIndexFile();
+    }
+    outputFrameIndex.clear();
+    auto stat = writer.statistics();
+    if(stat.numBlockedFrames > 0){
+        mout->putWarningln(
+            formatR(_("The output of {0} frames to the log file of {1} waited {2:.3f} [s] in total "
+                      "because the output queue was full."),
+                    stat.numBlockedFrames, self->displayName(), stat.blockedTime));
+    }
+}
+
+
+void WorldLogFileItem::setDeltaEncodingEnabled(bool on)
+{
+    impl->isDeltaEncodingEnabled = on;
+}
+
+
+bool WorldLogFileItem::isDeltaEncodingEnabled() const
+{
+    return impl->isDeltaEncodingEnabled;
+}
+
+
+void WorldLogFileItem::setKeyFrameInterval(int numFrames)
+{
+    impl->keyFrameInterval = std::max(1, numFrames);
+}
+
+
+int WorldLogFileItem::keyFrameInterval() const
+{
+    return impl->keyFrameInterval;
+}
+
+
+void WorldLogFileItem::setQuantizationStep(double step)
+{
+    if(step > 0.0){
+        impl->quantizationStep = step;
+    }
+}
+
+
+double WorldLogFileItem::quantizationStep() const
+{
+    return impl->quantizationStep;
+}
+
+
+void WorldLogFileItem::setOutputSyncMode(int mode)
+{
+    impl->outputSyncMode.select(mode);
+}
+
+
+int WorldLogFileItem::outputSyncMode() const
+{
+    return impl->outputSyncMode.which();
+}
+
+
+void WorldLogFileItem::setMaxOutputQueueSize(int bytes)
+{
+    impl->writer.maxQueueSize = std::max(bytes, 0);
+}
+
+
+int WorldLogFileItem::maxOutputQueueSize() const
+{
+    return impl->writer.maxQueueSize;
+}
+
+
+WorldLogFileItem::OutputStatistics WorldLogFileItem::outputStatistics() const
+{
+    return impl->writer.statistics();
+}
+
+
 void WorldLogFileItem::Impl::exchangeDeviceStateCacheArrays()
 {
     int i = 1 - currentDeviceStateCacheArrayIndex;
@@ -1288,8 +2173,22 @@ void WorldLogFileItem::doPutProperties(PutPropertyFunction& putProperty)
                 changeProperty(impl->isTimeStampSuffixEnabled));
     putProperty(_("Recording frame rate"), impl->recordingFrameRate,
                 changeProperty(impl->recordingFrameRate));
-    putProperty.min(1)(_("Live playback read interval (ms)"), impl->livePlaybackReadInterval,
-                       [this](int value){ return setLivePlaybackReadInterval(value); });
+    putProperty(_("Delta encoding"), impl->isDeltaEncodingEnabled,
+                changeProperty(impl->isDeltaEncodingEnabled));
+    putProperty.min(1)(_("Key frame interval"), impl->keyFrameInterval,
+                       [this](int n){ setKeyFrameInterval(n); return true; });
+    putProperty.decimals(8).min(1.0e-8)(_("Quantization step"), impl->quantizationStep,
+                                        [this](double step){ setQuantizationStep(step); return true; });
+    putProperty(_("Output sync"), impl->outputSyncMode,
+                [this](int index){ return impl->outputSyncMode.select(index); });
+    putProperty.reset().range(1, maxOutputQueueSizeInMegaBytes)(
+        _("Output queue size (MB)"), static_cast<int>(impl->writer.maxQueueSize / (1024 * 1024)),
+        [this](int size){
+            setMaxOutputQueueSize(std::min(size, maxOutputQueueSizeInMegaBytes) * 1024 * 1024);
+            return true;
+        });
+    putProperty.reset().min(1)(_("Live playback read interval (ms)"), impl->livePlaybackReadInterval,
+                               [this](int value){ return setLivePlaybackReadInterval(value); });
     putProperty.min(0.0)(_("Live playback read timeout"), impl->livePlaybackReadTimeout,
                          [this](double value){ return setLivePlaybackReadTimeout(value); });
 }
@@ -1300,6 +2199,11 @@ bool WorldLogFileItem::store(Archive& archive)
     archive.writeFileInformation(this);
     archive.write("time_stamp_suffix", impl->isTimeStampSuffixEnabled);
     archive.write("recording_frame_rate", impl->recordingFrameRate);
+    archive.write("delta_encoding", impl->isDeltaEncodingEnabled);
+    archive.write("key_frame_interval", impl->keyFrameInterval);
+    archive.write("quantization_step", impl->quantizationStep);
+    archive.write("output_sync_mode", outputSyncModeSymbols[impl->outputSyncMode.which()]);
+    archive.write("output_queue_size", static_cast<int>(impl->writer.maxQueueSize));
     archive.write("live_playback_read_interval_ms", impl->livePlaybackReadInterval);
     archive.write("live_playback_read_timeout", impl->livePlaybackReadTimeout);
     return true;
@@ -1310,6 +2214,18 @@ bool WorldLogFileItem::restore(const Archive& archive)
 {
     archive.read({"time_stamp_suffix", "timeStampSuffix" }, impl->isTimeStampSuffixEnabled);
     archive.read({"recording_frame_rate", "recordingFrameRate" }, impl->recordingFrameRate);
+    archive.read("delta_encoding", impl->isDeltaEncodingEnabled);
+    setKeyFrameInterval(archive.get("key_frame_interval", impl->keyFrameInterval));
+    setQuantizationStep(archive.get("quantization_step", impl->quantizationStep));
+    string symbol;
+    if(archive.read("output_sync_mode", symbol)){
+        for(int i=0; i < NumOutputSyncModes; ++i){
+            if(symbol == outputSyncModeSymbols[i]){
+                impl->outputSyncMode.select(i);
+            }
+        }
+    }
+    setMaxOutputQueueSize(archive.get("output_queue_size", maxOutputQueueSize()));
     setLivePlaybackReadInterval(archive.get("live_playback_read_interval_ms", impl->livePlaybackReadInterval));
     setLivePlaybackReadTimeout(archive.get("live_playback_read_timeout", impl->livePlaybackReadTimeout));
 
@@ -1704,12 +2620,9 @@ bool WorldLogFileItem::Impl::seekToLivePlaybackLastFrame()
             return false;
         }
     }
-    int framePos = currentReadFramePos;
-    while(true){
-        if(!readFrameHeader(framePos)){
-            break;
-        }
-        framePos += frameHeaderSize + currentReadFrameDataSize;
+    extendFrameIndex(std::numeric_limits<double>::max());
+    if(!frameIndex.empty()){
+        readFrameHeader(frameIndex.back().pos);
     }
 
     bool hasNewFrames = currentReadFramePos > livePlaybackLastFramePos;
@@ -41,6 +41,51 @@ public:
     void endBodyStateOutput();
     void endFrameOutput();
 
+    /**
+       Waits for the writer thread to write all the queued frames and closes the log file.
+       The output statistics are kept until the next output is started.
+    */
+    void finishOutput();
+
+    /**
+       In the delta encoding mode, the link and joint positions of the frames between the key
+       frames are written as the deltas from the last key frame quantized with the step.
+    */
+    void setDeltaEncodingEnabled(bool on);
+    bool isDeltaEncodingEnabled() const;
+    void setKeyFrameInterval(int numFrames);
+    int keyFrameInterval() const;
+    void setQuantizationStep(double step);
+    double quantizationStep() const;
+
+    enum OutputSyncMode {
+        //! The written data is left in the buffer of the writer until it becomes full
+        NoOutputSync,
+        //! The written data is passed to the OS after each batch of the frames
+        FlushOutputSync,
+        //! The written data is stored in the storage device after each batch of the frames
+        DataOutputSync,
+        NumOutputSyncModes
+    };
+    void setOutputSyncMode(int mode);
+    int outputSyncMode() const;
+
+    //! The frames are written by a background thread, and the output blocks when the size exceeds this.
+    void setMaxOutputQueueSize(int bytes);
+    int maxOutputQueueSize() const;
+
+    struct OutputStatistics
+    {
+        double writtenBytes;
+        int numBatchWrites;
+        //! Number of the frames that waited for the queue to have room
+        int numBlockedFrames;
+        //! Total time of the waits in seconds
+        double blockedTime;
+        int maxQueuedBytes;
+    };
+    OutputStatistics outputStatistics() const;
+
     int numBodies() const;
     const std::string& bodyName(int bodyIndex) const;
 
@@ -1,4 +1,5 @@
 #include "../SimulatorItem.h"
+#include "../SimulationBatch.h"
 #include "../AISTSimulatorItem.h"
 #include "../SubSimulatorItem.h"
 #include "../GLVisionSimulatorItem.h"
@@ -43,6 +44,10 @@ void exportSimulationClasses(py::module m)
         .def("isRecordingEnabled", &SimulatorItem::isRecordingEnabled)
         .def("isDeviceStateOutputEnabled", &SimulatorItem::isDeviceStateOutputEnabled)
         .def("setRealtimeSyncMode", [](SimulatorItem& self, int mode){ self.setRealtimeSyncMode(mode); })
+        .def("setControllerThreadSyncMode", &SimulatorItem::setControllerThreadSyncMode)
+        .def_property_readonly("controllerThreadSyncMode", &SimulatorItem::controllerThreadSyncMode)
+        .def("setControllerThreadCpuPinningEnabled", &SimulatorItem::setControllerThreadCpuPinningEnabled)
+        .def("isControllerThreadCpuPinningEnabled", &SimulatorItem::isControllerThreadCpuPinningEnabled)
         .def("setDeviceStateOutputEnabled", &SimulatorItem::setDeviceStateOutputEnabled)
         .def("isAllLinkPositionOutputMode", &SimulatorItem::isAllLinkPositionOutputMode)
         .def("setAllLinkPositionOutputMode", &SimulatorItem::setAllLinkPositionOutputMode)
@@ -106,6 +111,12 @@ void exportSimulationClasses(py::module m)
         .value("NumRealtimeSyncModes", SimulatorItem::NumRealtimeSyncModes)
         .export_values();
 
+    py::enum_<SimulatorItem::ControllerThreadSyncMode>(simulatorItemClass, "ControllerThreadSyncMode")
+        .value("BlockingControllerThreadSync", SimulatorItem::BlockingControllerThreadSync)
+        .value("SpinControllerThreadSync", SimulatorItem::SpinControllerThreadSync)
+        .value("NumControllerThreadSyncModes", SimulatorItem::NumControllerThreadSyncModes)
+        .export_values();
+
     PyItemList<SimulatorItem>(m, "SimulatorItemList", simulatorItemClass);
 
     py::class_<AISTSimulatorItem, AISTSimulatorItemPtr, SimulatorItem>
@@ -125,6 +136,8 @@ void exportSimulationClasses(py::module m)
         .def("setEpsilon", &AISTSimulatorItem::setEpsilon)
         .def("set2Dmode", &AISTSimulatorItem::set2Dmode)
         .def("setKinematicWalkingEnabled", &AISTSimulatorItem::setKinematicWalkingEnabled)
+        .def("setNumDynamicsThreads", &AISTSimulatorItem::setNumDynamicsThreads)
+        .def_property_readonly("numDynamicsThreads", &AISTSimulatorItem::numDynamicsThreads)
         .def("clearExtraJoints", &AISTSimulatorItem::clearExtraJoints)
         .def("addExtraJoint", &AISTSimulatorItem::addExtraJoint)
 
@@ -150,6 +163,20 @@ void exportSimulationClasses(py::module m)
 
     PyItemList<AISTSimulatorItem>(m, "AISTSimulatorItemList");
 
+    py::class_<SimulationBatch, SimulationBatchPtr, Referenced>(m, "SimulationBatch")
+        .def(py::init<>())
+        .def("initialize", &SimulationBatch::initialize)
+        .def("finalize", &SimulationBatch::finalize)
+        .def_property_readonly("numSimulations", &SimulationBatch::numSimulations)
+        .def("simulatorItem", &SimulationBatch::simulatorItem)
+        .def("step", &SimulationBatch::step, py::arg("numFrames") = 1,
+             py::call_guard<py::gil_scoped_release>())
+        .def("reset", &SimulationBatch::reset)
+        .def("resetAll", &SimulationBatch::resetAll)
+        .def("currentFrame", &SimulationBatch::currentFrame)
+        .def("currentTime", &SimulationBatch::currentTime)
+        ;
+
     py::class_<SubSimulatorItem, SubSimulatorItemPtr, Item>(m, "SubSimulatorItem")
         .def(py::init<>())
         .def("isEnabled", &SubSimulatorItem::isEnabled)
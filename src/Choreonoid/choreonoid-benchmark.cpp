@@ -0,0 +1,425 @@
+/**
+   The benchmark of the dynamics core used by the AIST simulator.
+   The scenes are built from the models in the share directory and the simulation of each scene
+   is stepped as fast as possible. The throughput and the time of each phase of the steps are
+   output in a machine-readable format to compare the performance between versions.
+*/
+
+#include <cnoid/DyWorld>
+#include <cnoid/DyBody>
+#include <cnoid/ConstraintForceSolver>
+#include <cnoid/BodyLoader>
+#include <cnoid/BodyMotion>
+#include <cnoid/MaterialTable>
+#include <cnoid/ExecutablePath>
+#include <cnoid/TimeMeasure>
+#include <cnoid/Config>
+#include <cnoid/UTF8>
+#include <cnoid/Format>
+#include <cnoid/stdx/filesystem>
+#include <CLI11.hpp>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <functional>
+#include <map>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+using namespace cnoid;
+namespace filesystem = cnoid::stdx::filesystem;
+
+namespace {
+
+const double DEFAULT_GRAVITY_ACCELERATION = 9.80665;
+
+struct Result
+{
+    string scene;
+    int numBodies;
+    int numSteps;
+    double timeStep;
+    double computationTime;
+    ConstraintForceSolver::Statistics statistics;
+};
+
+class Scene
+{
+public:
+    string name;
+    double timeStep;
+    DyWorld<ConstraintForceSolver> world;
+    MaterialTablePtr materialTable;
+    std::function<void(int step)> control;
+
+    Scene(const string& name, double timeStep);
+    void addBody(DyBody* body, bool isSelfCollisionDetectionEnabled = false);
+    Result run(double timeLength, int numThreads);
+};
+
+class SceneBuilder
+{
+public:
+    BodyLoader bodyLoader;
+    map<string, DyBodyPtr> prototypes;
+    shared_ptr<MultiValueSeq> walkPattern;
+
+    DyBodyPtr createBody(const string& modelFile, const Vector3& translation);
+    bool loadWalkPattern();
+    unique_ptr<Scene> createHumanoidWalkingScene(const string& name, int numRobotsInRow);
+    unique_ptr<Scene> createTanksOnTerrainScene();
+    unique_ptr<Scene> createBoxPileScene();
+    unique_ptr<Scene> createScene(const string& name);
+};
+
+const char* sceneNames[] = {
+    "humanoid-walking", "tanks-on-terrain", "box-pile", "many-robots"
+};
+
+}
+
+
+Scene::Scene(const string& name, double timeStep)
+    : name(name),
+      timeStep(timeStep)
+{
+    world.setEulerMethod();
+    world.setGravityAcceleration(Vector3(0.0, 0.0, -DEFAULT_GRAVITY_ACCELERATION));
+    world.enableSensors(false);
+    world.setTimeStep(timeStep);
+    world.setCurrentTime(0.0);
+
+    materialTable = new MaterialTable;
+    materialTable->load(toUTF8((shareDirPath() / "default" / "materials.yaml").string()), cerr);
+    world.constraintForceSolver.setMaterialTable(materialTable);
+}
+
+
+void Scene::addBody(DyBody* body, bool isSelfCollisionDetectionEnabled)
+{
+    body->setCurrentTimeFunction([this](){ return world.currentTime(); });
+    body->initializeState();
+    int bodyIndex = world.addBody(body);
+    world.constraintForceSolver.setBodyCollisionDetectionMode(bodyIndex, true, isSelfCollisionDetectionEnabled);
+}
+
+
+Result Scene::run(double timeLength, int numThreads)
+{
+    ConstraintForceSolver& cfs = world.constraintForceSolver;
+    world.setNumThreads(numThreads);
+    world.initialize();
+    cfs.setStatisticsEnabled(true);
+    cfs.clearStatistics();
+
+    Result result;
+    result.scene = name;
+    result.numBodies = world.numBodies();
+    result.numSteps = std::max(1, static_cast<int>(std::lround(timeLength / timeStep)));
+    result.timeStep = timeStep;
+
+    TimeMeasure timer;
+    for(int step = 0; step < result.numSteps; ++step){
+        if(control){
+            control(step);
+        }
+        timer.begin();
+        world.calcNextState();
+        timer.end();
+        cfs.clearExternalForces();
+    }
+    result.computationTime = timer.totalTime();
+    result.statistics = cfs.statistics();
+
+    return result;
+}
+
+
+DyBodyPtr SceneBuilder::createBody(const string& modelFile, const Vector3& translation)
+{
+    DyBodyPtr& prototype = prototypes[modelFile];
+    if(!prototype){
+        prototype = new DyBody;
+        auto path = shareDirPath() / "model" / fromUTF8(modelFile);
+        if(!bodyLoader.load(prototype, toUTF8(path.make_preferred().string()))){
+            cerr << formatR("Body file \"{}\" cannot be loaded.", modelFile) << endl;
+            prototype.reset();
+            return nullptr;
+        }
+    }
+    DyBodyPtr body = static_cast<DyBody*>(prototype->clone());
+    body->initializePosition();
+    body->rootLink()->translation() += translation;
+    body->calcForwardKinematics();
+    return body;
+}
+
+
+bool SceneBuilder::loadWalkPattern()
+{
+    if(walkPattern){
+        return true;
+    }
+    auto path = shareDirPath() / "motion" / "SR1" / "SR1WalkPattern2.seq";
+    BodyMotion motion;
+    if(!motion.load(toUTF8(path.make_preferred().string()), cerr)){
+        return false;
+    }
+    motion.updateJointPosSeqWithBodyStateSeq();
+    walkPattern = motion.jointPosSeq();
+    return walkPattern->numFrames() > 0;
+}
+
+
+/**
+   The SR1 robots walk on the floor by following the walking pattern with the joints of
+   the displacement actuation mode.
+*/
+unique_ptr<Scene> SceneBuilder::createHumanoidWalkingScene(const string& name, int numRobotsInRow)
+{
+    if(!loadWalkPattern()){
+        return nullptr;
+    }
+    unique_ptr<Scene> scene(new Scene(name, walkPattern->timeStep()));
+
+    auto floor = createBody("misc/floor.body", Vector3::Zero());
+    if(!floor){
+        return nullptr;
+    }
+    scene->addBody(floor);
+
+    vector<DyBodyPtr> robots;
+    const double offset = (numRobotsInRow - 1) / 2.0;
+    for(int i=0; i < numRobotsInRow; ++i){
+        for(int j=0; j < numRobotsInRow; ++j){
+            auto robot = createBody("SR1/SR1.body", Vector3(1.5 * (i - offset) - 1.0, 1.0 * (j - offset), 0.0));
+            if(!robot || robot->numJoints() != walkPattern->numParts()){
+                return nullptr;
+            }
+            auto q0 = walkPattern->frame(0);
+            for(auto& joint : robot->joints()){
+                joint->setActuationMode(Link::JointDisplacement);
+                joint->q() = q0[joint->jointId()];
+            }
+            robot->calcForwardKinematics();
+            scene->addBody(robot);
+            robots.push_back(robot);
+        }
+    }
+
+    auto pattern = walkPattern;
+    scene->control = [robots, pattern](int step){
+        auto q = pattern->frame(std::min(step, pattern->numFrames() - 1));
+        for(auto& robot : robots){
+            for(auto& joint : robot->joints()){
+                joint->q_target() = q[joint->jointId()];
+            }
+        }
+    };
+
+    return scene;
+}
+
+
+/**
+   The tanks drive over the uneven ground with the pseudo continuous tracks.
+*/
+unique_ptr<Scene> SceneBuilder::createTanksOnTerrainScene()
+{
+    unique_ptr<Scene> scene(new Scene("tanks-on-terrain", 0.001));
+
+    auto ground = createBody("misc/unevenground.body", Vector3::Zero());
+    if(!ground){
+        return nullptr;
+    }
+    scene->addBody(ground);
+
+    vector<Link*> tracks;
+    for(int i=0; i < 3; ++i){
+        for(int j=0; j < 3; ++j){
+            auto tank = createBody("Tank/Tank.body", Vector3(-2.0 + 2.0 * i, -6.0 + 2.0 * j, 0.0));
+            if(!tank){
+                return nullptr;
+            }
+            for(auto& link : tank->links()){
+                if(link->jointType() == Link::PseudoContinuousTrackJoint){
+                    tracks.push_back(link);
+                } else if(link->isRevoluteJoint() || link->isPrismaticJoint()){
+                    link->setActuationMode(Link::JointDisplacement);
+                }
+            }
+            scene->addBody(tank);
+        }
+    }
+
+    scene->control = [tracks](int){
+        for(auto& track : tracks){
+            track->dq_target() = 0.5;
+        }
+    };
+
+    return scene;
+}
+
+
+/**
+   The boxes are dropped on the floor to make a pile. The layers are shifted alternately so
+   that the boxes of the adjacent layers are in contact with each other.
+*/
+unique_ptr<Scene> SceneBuilder::createBoxPileScene()
+{
+    unique_ptr<Scene> scene(new Scene("box-pile", 0.001));
+
+    auto floor = createBody("misc/floor.body", Vector3::Zero());
+    if(!floor){
+        return nullptr;
+    }
+    scene->addBody(floor);
+
+    const int numBoxesInRow = 6;
+    const int numLayers = 8;
+    const double pitch = 0.13;
+    for(int k=0; k < numLayers; ++k){
+        const double shift = (k % 2) * pitch / 2.0;
+        for(int i=0; i < numBoxesInRow; ++i){
+            for(int j=0; j < numBoxesInRow; ++j){
+                Vector3 p(pitch * (i - numBoxesInRow / 2) + shift,
+                          pitch * (j - numBoxesInRow / 2) + shift,
+                          0.13 * k + 0.01);
+                auto box = createBody("misc/box.body", p);
+                if(!box){
+                    return nullptr;
+                }
+                scene->addBody(box);
+            }
+        }
+    }
+
+    return scene;
+}
+
+
+unique_ptr<Scene> SceneBuilder::createScene(const string& name)
+{
+    if(name == "humanoid-walking"){
+        return createHumanoidWalkingScene(name, 1);
+    } else if(name == "tanks-on-terrain"){
+        return createTanksOnTerrainScene();
+    } else if(name == "box-pile"){
+        return createBoxPileScene();
+    } else if(name == "many-robots"){
+        return createHumanoidWalkingScene(name, 4);
+    }
+    return nullptr;
+}
+
+
+static void putResults(ostream& os, const vector<Result>& results, bool isCsvFormat)
+{
+    if(isCsvFormat){
+        os << "scene,num_bodies,time_step,num_steps,computation_time,steps_per_second,real_time_factor,"
+            "collision_time,lcp_building_time,lcp_solving_time,integration_time,"
+            "contacts_per_step,islands_per_step,gauss_seidel_iterations_per_step\n";
+    } else {
+        os << "{\n  \"version\": \"" << CNOID_FULL_VERSION_STRING << "\",\n  \"results\": [";
+    }
+
+    for(size_t i=0; i < results.size(); ++i){
+        auto& r = results[i];
+        auto& s = r.statistics;
+        const double n = r.numSteps;
+        // The time of each phase is the average time per step in microseconds
+        const double collisionTime = s.collisionDetectionTime / n * 1.0e6;
+        const double lcpBuildingTime = s.lcpBuildingTime / n * 1.0e6;
+        const double lcpSolvingTime = s.lcpSolvingTime / n * 1.0e6;
+        const double integrationTime =
+            (r.computationTime - s.collisionDetectionTime - s.lcpBuildingTime - s.lcpSolvingTime) / n * 1.0e6;
+        const double stepsPerSecond = n / r.computationTime;
+        const double realTimeFactor = n * r.timeStep / r.computationTime;
+
+        if(isCsvFormat){
+            os << formatC("{},{},{},{},{:.6f},{:.1f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.2f},{:.2f},{:.2f}\n",
+                          r.scene, r.numBodies, r.timeStep, r.numSteps, r.computationTime,
+                          stepsPerSecond, realTimeFactor,
+                          collisionTime, lcpBuildingTime, lcpSolvingTime, integrationTime,
+                          s.numContacts / n, s.numConstraintIslands / n, s.numGaussSeidelIterations / n);
+        } else {
+            os << (i == 0 ? "\n" : ",\n");
+            os << formatC(
+                "    {{ \"scene\": \"{}\", \"num_bodies\": {}, \"time_step\": {}, \"num_steps\": {},\n"
+                "      \"computation_time\": {:.6f}, \"steps_per_second\": {:.1f}, \"real_time_factor\": {:.3f},\n"
+                "      \"phase_times_us\": {{ \"collision\": {:.3f}, \"lcp_building\": {:.3f}, "
+                "\"lcp_solving\": {:.3f}, \"integration\": {:.3f} }},\n"
+                "      \"contacts_per_step\": {:.2f}, \"islands_per_step\": {:.2f}, "
+                "\"gauss_seidel_iterations_per_step\": {:.2f} }}",
+                r.scene, r.numBodies, r.timeStep, r.numSteps,
+                r.computationTime, stepsPerSecond, realTimeFactor,
+                collisionTime, lcpBuildingTime, lcpSolvingTime, integrationTime,
+                s.numContacts / n, s.numConstraintIslands / n, s.numGaussSeidelIterations / n);
+        }
+    }
+
+    if(!isCsvFormat){
+        os << "\n  ]\n}\n";
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    vector<string> scenes;
+    double timeLength = 5.0;
+    int numThreads = 1;
+    string format = "json";
+    string outputFile;
+
+    CLI::App app("Benchmark of the dynamics core of the AIST simulator");
+    app.add_option("--scene", scenes, "scene to simulate (all the scenes by default)")
+        ->check(CLI::IsMember(vector<string>(std::begin(sceneNames), std::end(sceneNames))));
+    app.add_option("--time", timeLength, "simulation time length of each scene [s]");
+    app.add_option("--threads", numThreads, "number of the dynamics threads (0: all the hardware threads)")
+        ->check(CLI::NonNegativeNumber);
+    app.add_option("--format", format, "output format")->check(CLI::IsMember({ "json", "csv" }));
+    app.add_option("--output", outputFile, "file to write the results instead of the standard output");
+
+    try {
+        app.parse(argc, argv);
+    }
+    catch(const CLI::ParseError& ex){
+        return app.exit(ex);
+    }
+
+    if(scenes.empty()){
+        scenes.assign(std::begin(sceneNames), std::end(sceneNames));
+    }
+    if(numThreads == 0){
+        numThreads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+
+    SceneBuilder builder;
+    vector<Result> results;
+    for(auto& name : scenes){
+        auto scene = builder.createScene(name);
+        if(!scene){
+            cerr << formatR("Scene \"{}\" cannot be created.", name) << endl;
+            return 1;
+        }
+        cerr << formatR("Simulating {0} for {1} [s] ...", name, timeLength) << endl;
+        results.push_back(scene->run(timeLength, numThreads));
+    }
+
+    bool isCsvFormat = (format == "csv");
+    if(outputFile.empty()){
+        putResults(cout, results, isCsvFormat);
+    } else {
+        ofstream ofs(fromUTF8(outputFile));
+        if(!ofs){
+            cerr << formatR("\"{}\" cannot be opened.", outputFile) << endl;
+            return 1;
+        }
+        putResults(ofs, results, isCsvFormat);
+    }
+
+    return 0;
+}
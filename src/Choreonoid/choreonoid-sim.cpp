@@ -0,0 +1,911 @@
+/**
+   The command to do the simulation of the AIST simulator without the GUI.
+   A project file or body files are loaded and the simulation is stepped as fast as possible.
+   The motions of the bodies are directly written to the body motion files.
+*/
+
+#include <cnoid/DyWorld>
+#include <cnoid/DyBody>
+#include <cnoid/ConstraintForceSolver>
+#include <cnoid/BodyLoader>
+#include <cnoid/BodyMotion>
+#include <cnoid/SimpleController>
+#include <cnoid/MaterialTable>
+#include <cnoid/YAMLReader>
+#include <cnoid/EigenArchive>
+#include <cnoid/FilePathVariableProcessor>
+#include <cnoid/ExecutablePath>
+#include <cnoid/MathUtil>
+#include <cnoid/UTF8>
+#include <cnoid/Format>
+#include <cnoid/stdx/filesystem>
+#include <CLI11.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+using namespace std;
+using namespace cnoid;
+namespace filesystem = cnoid::stdx::filesystem;
+
+namespace {
+
+const double DEFAULT_GRAVITY_ACCELERATION = 9.80665;
+
+#ifdef _WIN32
+typedef HINSTANCE DllHandle;
+inline DllHandle loadDll(const char* filename) { return LoadLibrary(filename); }
+inline void* resolveDllSymbol(DllHandle handle, const char* symbol) { return GetProcAddress(handle, symbol); }
+inline void unloadDll(DllHandle handle) { FreeLibrary(handle); }
+#else
+typedef void* DllHandle;
+inline DllHandle loadDll(const char* filename) { return dlopen(filename, RTLD_LAZY); }
+inline void* resolveDllSymbol(DllHandle handle, const char* symbol) { return dlsym(handle, symbol); }
+inline void unloadDll(DllHandle handle) { dlclose(handle); }
+#endif
+
+class SimBody;
+
+class SimpleControllerInstance : public SimulationSimpleControllerIO
+{
+public:
+    string name;
+    string moduleFile;
+    string optionString_;
+    bool isNoDelayMode_;
+    SimBody* simBody;
+    Body* simulationBody;
+    BodyPtr ioBody;
+    DllHandle module;
+    unique_ptr<SimpleController> controller;
+    vector<int> linkIndexToInputStateTypeMap;
+    vector<int> outputLinkIndices;
+    vector<bool> inputEnabledDeviceFlags;
+
+    SimpleControllerInstance(SimBody* simBody);
+    ~SimpleControllerInstance();
+    bool load();
+    bool initialize();
+    void input();
+    void output();
+
+    // virtual functions of ControllerIO
+    virtual std::string controllerName() const override { return name; }
+    virtual Body* body() override { return ioBody; }
+    virtual std::string optionString() const override { return optionString_; }
+    virtual double timeStep() const override;
+    virtual double currentTime() const override;
+    virtual std::shared_ptr<BodyMotion> logBodyMotion() override { return nullptr; }
+    virtual SignalProxy<void()> sigLogFlushRequested() override { return sigLogFlushRequested_; }
+    virtual bool enableLog() override { return false; }
+    virtual void outputLogFrame(Referenced* /* logFrame */) override { }
+    virtual bool isNoDelayMode() const override { return isNoDelayMode_; }
+    virtual bool setNoDelayMode(bool on) override { isNoDelayMode_ = on; return on; }
+    virtual bool isSimulationFromInitialState() const override { return true; }
+
+    // virtual functions of SimpleControllerIO
+    virtual void enableIO(Link* link) override;
+    virtual void enableInput(Link* link) override;
+    virtual void enableInput(Link* link, int stateFlags) override;
+    virtual void enableInput(Device* device) override;
+    virtual void enableOutput(Link* link) override;
+    virtual void enableOutput(Link* link, int stateFlags) override;
+
+    // deprecated virtual functions
+    virtual bool isImmediateMode() const override { return isNoDelayMode_; }
+    virtual void setImmediateMode(bool on) override { isNoDelayMode_ = on; }
+
+private:
+    Signal<void()> sigLogFlushRequested_;
+};
+
+class SimBody
+{
+public:
+    DyBodyPtr body;
+    bool isCollisionDetectionEnabled;
+    bool isSelfCollisionDetectionEnabled;
+    vector<unique_ptr<SimpleControllerInstance>> controllers;
+    shared_ptr<BodyMotion> motion;
+    DyWorld<ConstraintForceSolver>* world;
+
+    SimBody() : isCollisionDetectionEnabled(true), isSelfCollisionDetectionEnabled(false) { }
+};
+
+class SimulationRunner
+{
+public:
+    DyWorld<ConstraintForceSolver> world;
+    vector<unique_ptr<SimBody>> simBodies;
+    vector<DyLink*> highGainStateLinks;
+    FilePathVariableProcessorPtr pathVariableProcessor;
+    MaterialTablePtr materialTable;
+    BodyLoader bodyLoader;
+
+    double timeStep;
+    double timeLength;
+    double logFrameRate;
+    string logDirectory;
+    int numDynamicsThreads;
+    bool isVerbose;
+
+    // AIST simulator parameters
+    bool isRungeKuttaMode;
+    Vector3 gravity;
+    double minFrictionCoefficient;
+    double maxFrictionCoefficient;
+    double contactCullingDistance;
+    double contactCullingDepth;
+    double errorCriterion;
+    int maxNumIterations;
+    double contactCorrectionDepth;
+    double contactCorrectionVelocityRatio;
+    double epsilon;
+    bool is2Dmode;
+    bool isKinematicsMode;
+    bool isKinematicWalkingEnabled;
+
+    SimulationRunner();
+    bool loadProject(const string& filename);
+    void extractItems(Mapping* itemNode, SimBody* ownerSimBody);
+    void readSimulatorItem(Mapping* data);
+    SimBody* readBodyItem(Mapping* data);
+    void readSimpleControllerItem(Mapping* data, SimBody* simBody);
+    SimBody* loadBody(const string& filename);
+    bool initialize();
+    void run();
+    void refreshHighGainStates();
+    void stepKinematics();
+    bool writeLogs();
+};
+
+}
+
+
+SimpleControllerInstance::SimpleControllerInstance(SimBody* simBody)
+    : isNoDelayMode_(false),
+      simBody(simBody),
+      module(nullptr)
+{
+    simulationBody = simBody->body;
+}
+
+
+SimpleControllerInstance::~SimpleControllerInstance()
+{
+    // The controller must be deleted before its code is unloaded
+    controller.reset();
+    if(module){
+        unloadDll(module);
+    }
+}
+
+
+bool SimpleControllerInstance::load()
+{
+    filesystem::path modulePath(fromUTF8(moduleFile));
+    if(!modulePath.is_absolute()){
+        modulePath = pluginDirPath() / "simplecontroller" / modulePath;
+    }
+    if(modulePath.extension().empty()){
+#ifdef _WIN32
+        modulePath += ".dll";
+#else
+        modulePath += ".so";
+#endif
+    }
+    string filename = toUTF8(modulePath.make_preferred().string());
+    module = loadDll(filename.c_str());
+    if(!module){
+        cerr << formatR("The controller module \"{0}\" of {1} cannot be loaded.", filename, name) << endl;
+        return false;
+    }
+    auto factory = reinterpret_cast<SimpleController::Factory>(resolveDllSymbol(module, "createSimpleController"));
+    if(!factory){
+        cerr << formatR("The factory function \"createSimpleController()\" is not found in \"{}\".", filename) << endl;
+        return false;
+    }
+    controller.reset(factory());
+    if(!controller){
+        cerr << formatR("The controller factory of {} failed to create a controller instance.", name) << endl;
+        return false;
+    }
+    return true;
+}
+
+
+bool SimpleControllerInstance::initialize()
+{
+    ioBody = simulationBody->clone();
+    inputEnabledDeviceFlags.clear();
+    inputEnabledDeviceFlags.resize(ioBody->numDevices(), false);
+
+    SimpleControllerConfig config(this);
+    if(!controller->configure(&config)){
+        cerr << formatR("{} failed to configure the controller.", name) << endl;
+        return false;
+    }
+    if(!controller->initialize(this)){
+        cerr << formatR("{}'s initialize method failed.", name) << endl;
+        return false;
+    }
+    for(auto& index : outputLinkIndices){
+        simulationBody->link(index)->setActuationMode(ioBody->link(index)->actuationMode());
+    }
+    for(size_t i=0; i < linkIndexToInputStateTypeMap.size(); ++i){
+        simulationBody->link(i)->mergeSensingMode(linkIndexToInputStateTypeMap[i]);
+    }
+    return true;
+}
+
+
+double SimpleControllerInstance::timeStep() const
+{
+    return simBody->world->timeStep();
+}
+
+
+double SimpleControllerInstance::currentTime() const
+{
+    return simBody->world->currentTime();
+}
+
+
+void SimpleControllerInstance::enableIO(Link* link)
+{
+    enableInput(link);
+    enableOutput(link);
+}
+
+
+void SimpleControllerInstance::enableInput(Link* link)
+{
+    int stateTypes = Link::StateNone;
+    int actuationMode = link->actuationMode();
+    if(actuationMode & (Link::JointEffort | Link::JointDisplacement | Link::JointVelocity)){
+        if(link->jointType() != Link::PseudoContinuousTrackJoint){
+            stateTypes = Link::JointDisplacement;
+        }
+    }
+    if(actuationMode & Link::LinkExtWrench){
+        stateTypes |= Link::LinkPosition;
+    }
+    enableInput(link, stateTypes);
+}
+
+
+void SimpleControllerInstance::enableInput(Link* link, int stateFlags)
+{
+    if(link->index() >= static_cast<int>(linkIndexToInputStateTypeMap.size())){
+        linkIndexToInputStateTypeMap.resize(link->index() + 1, 0);
+    }
+    linkIndexToInputStateTypeMap[link->index()] |= stateFlags;
+    link->mergeSensingMode(stateFlags);
+}
+
+
+void SimpleControllerInstance::enableInput(Device* device)
+{
+    inputEnabledDeviceFlags[device->index()] = true;
+}
+
+
+void SimpleControllerInstance::enableOutput(Link* link)
+{
+    int index = link->index();
+    for(auto& outputIndex : outputLinkIndices){
+        if(outputIndex == index){
+            return;
+        }
+    }
+    outputLinkIndices.push_back(index);
+}
+
+
+void SimpleControllerInstance::enableOutput(Link* link, int stateFlags)
+{
+    link->setActuationMode(stateFlags);
+    if(stateFlags){
+        enableOutput(link);
+    }
+}
+
+
+void SimpleControllerInstance::input()
+{
+    for(size_t i=0; i < linkIndexToInputStateTypeMap.size(); ++i){
+        const int types = linkIndexToInputStateTypeMap[i];
+        if(!types){
+            continue;
+        }
+        const Link* simLink = simulationBody->link(i);
+        Link* ioLink = ioBody->link(i);
+        if(types & Link::JointDisplacement){
+            ioLink->q() = simLink->q();
+        }
+        if(types & Link::JointVelocity){
+            ioLink->dq() = simLink->dq();
+        }
+        if(types & Link::JointAcceleration){
+            ioLink->ddq() = simLink->ddq();
+        }
+        if(types & Link::JointEffort){
+            ioLink->u() = simLink->u();
+        }
+        if(types & Link::LinkPosition){
+            ioLink->T() = simLink->T();
+        }
+        if(types & Link::LinkTwist){
+            ioLink->v() = simLink->v();
+            ioLink->w() = simLink->w();
+        }
+        if(types & Link::LinkAcceleration){
+            ioLink->dv() = simLink->dv();
+            ioLink->dw() = simLink->dw();
+        }
+        if(types & Link::LinkExtWrench){
+            ioLink->F_ext() = simLink->F_ext();
+        }
+        if(types & Link::LinkContactState){
+            ioLink->contactPoints() = simLink->contactPoints();
+        }
+    }
+
+    const int numDevices = inputEnabledDeviceFlags.size();
+    for(int i=0; i < numDevices; ++i){
+        if(inputEnabledDeviceFlags[i]){
+            ioBody->device(i)->copyStateFrom(*simulationBody->device(i));
+        }
+    }
+}
+
+
+void SimpleControllerInstance::output()
+{
+    for(auto& index : outputLinkIndices){
+        const Link* ioLink = ioBody->link(index);
+        Link* simLink = simulationBody->link(index);
+        const int mode = ioLink->actuationMode();
+        if(mode & Link::JointDisplacement){
+            simLink->q_target() = ioLink->q_target();
+        }
+        if(mode & (Link::JointVelocity | Link::DeprecatedJointSurfaceVelocity)){
+            simLink->dq_target() = ioLink->dq_target();
+        }
+        if(mode & Link::JointAcceleration){
+            simLink->ddq() = ioLink->ddq();
+        }
+        if(mode & Link::JointEffort){
+            simLink->u() = ioLink->u();
+        }
+        if(mode & Link::LinkPosition){
+            simLink->T() = ioLink->T();
+        }
+        if(mode & Link::LinkTwist){
+            simLink->v() = ioLink->v();
+            simLink->w() = ioLink->w();
+        }
+        if(mode & Link::LinkAcceleration){
+            simLink->dv() = ioLink->dv();
+            simLink->dw() = ioLink->dw();
+        }
+        if(mode & Link::LinkExtWrench){
+            simLink->F_ext() += ioLink->F_ext();
+        }
+    }
+}
+
+
+SimulationRunner::SimulationRunner()
+{
+    pathVariableProcessor = new FilePathVariableProcessor(*FilePathVariableProcessor::systemInstance());
+
+    timeStep = 0.001;
+    timeLength = 10.0;
+    logFrameRate = 0.0;
+    numDynamicsThreads = 0;
+    isVerbose = false;
+
+    // The same default values as AISTSimulatorItem
+    isRungeKuttaMode = false;
+    gravity << 0.0, 0.0, -DEFAULT_GRAVITY_ACCELERATION;
+
+    ConstraintForceSolver& cfs = world.constraintForceSolver;
+    minFrictionCoefficient = cfs.minFrictionCoefficient();
+    maxFrictionCoefficient = cfs.maxFrictionCoefficient();
+    contactCullingDistance = cfs.contactCullingDistance();
+    contactCullingDepth = cfs.contactCullingDepth();
+    epsilon = cfs.coefficientOfRestitution();
+    errorCriterion = cfs.gaussSeidelErrorCriterion();
+    maxNumIterations = cfs.gaussSeidelMaxNumIterations();
+    contactCorrectionDepth = cfs.contactCorrectionDepth();
+    contactCorrectionVelocityRatio = cfs.contactCorrectionVelocityRatio();
+    is2Dmode = false;
+    isKinematicsMode = false;
+    isKinematicWalkingEnabled = false;
+}
+
+
+bool SimulationRunner::loadProject(const string& filename)
+{
+    YAMLReader reader;
+    MappingPtr archive;
+    try {
+        if(auto node = reader.loadDocument(filename)){
+            archive = node->toMapping();
+        }
+    }
+    catch(const ValueNode::Exception& ex){
+        cerr << ex.message() << endl;
+    }
+    if(!archive){
+        cerr << formatR("Project file \"{0}\" cannot be loaded: {1}", filename, reader.errorMessage()) << endl;
+        return false;
+    }
+
+    auto projectDir = filesystem::absolute(fromUTF8(filename)).parent_path();
+    pathVariableProcessor->setBaseDirPath(projectDir);
+    pathVariableProcessor->setProjectDirPath(projectDir);
+
+    auto items = archive->findMapping("items");
+    if(!items->isValid()){
+        cerr << formatR("Project file \"{}\" does not have any item.", filename) << endl;
+        return false;
+    }
+    extractItems(items, nullptr);
+
+    return true;
+}
+
+
+void SimulationRunner::extractItems(Mapping* itemNode, SimBody* ownerSimBody)
+{
+    string className = itemNode->get("class", "");
+    auto data = itemNode->findMapping("data");
+
+    if(className == "AISTSimulatorItem"){
+        if(data->isValid()){
+            readSimulatorItem(data);
+        }
+    } else if(className == "BodyItem"){
+        if(data->isValid()){
+            ownerSimBody = readBodyItem(data);
+            string name;
+            if(ownerSimBody && itemNode->read("name", name)){
+                ownerSimBody->body->setName(name);
+            }
+        }
+    } else if(className == "SimpleControllerItem"){
+        if(ownerSimBody && data->isValid()){
+            readSimpleControllerItem(data, ownerSimBody);
+        }
+    }
+
+    auto children = itemNode->findListing("children");
+    if(children->isValid()){
+        for(auto& child : *children){
+            if(child->isMapping()){
+                extractItems(child->toMapping(), ownerSimBody);
+            }
+        }
+    }
+}
+
+
+void SimulationRunner::readSimulatorItem(Mapping* data)
+{
+    double value;
+    if(data->read("time_step", value) || data->read("timeStep", value)){
+        timeStep = value;
+    } else if(data->read("frame_rate", value)){
+        timeStep = 1.0 / value;
+    }
+    if(data->get("time_range_mode", "") == "specified"){
+        data->read("time_length", timeLength);
+    }
+    if(data->get("integrationMode", "") == "runge-kutta"){
+        isRungeKuttaMode = true;
+    }
+    read(data, "gravity", gravity);
+    data->read("min_friction_coefficient", minFrictionCoefficient);
+    data->read("max_friction_coefficient", maxFrictionCoefficient);
+    data->read("cullingThresh", contactCullingDistance);
+    data->read("contactCullingDepth", contactCullingDepth);
+    data->read("errorCriterion", errorCriterion);
+    data->read("maxNumIterations", maxNumIterations);
+    data->read("contactCorrectionDepth", contactCorrectionDepth);
+    data->read("contactCorrectionVelocityRatio", contactCorrectionVelocityRatio);
+    data->read("2Dmode", is2Dmode);
+    if(data->get("dynamicsMode", "") == "Kinematics"){
+        isKinematicsMode = true;
+    }
+    data->read("kinematicWalking", isKinematicWalkingEnabled);
+    if(numDynamicsThreads == 0){
+        data->read("num_dynamics_threads", numDynamicsThreads);
+    }
+}
+
+
+SimBody* SimulationRunner::readBodyItem(Mapping* data)
+{
+    string file;
+    if(!data->read({ "file", "modelFile" }, file)){
+        return nullptr;
+    }
+    file = pathVariableProcessor->expand(file, true);
+    if(file.empty()){
+        cerr << pathVariableProcessor->errorMessage() << endl;
+        return nullptr;
+    }
+    auto simBody = loadBody(file);
+    if(!simBody){
+        return nullptr;
+    }
+    auto body = simBody->body;
+
+    bool on;
+    if(data->read("fix_root", on)){
+        body->setRootLinkFixed(on);
+    }
+    data->read("collisionDetection", simBody->isCollisionDetectionEnabled);
+    data->read("selfCollisionDetection", simBody->isSelfCollisionDetectionEnabled);
+
+    Vector3 p = body->rootLink()->p();
+    Matrix3 R = body->rootLink()->R();
+    read(data, { "initialRootPosition", "rootPosition" }, p);
+    read(data, { "initialRootAttitude", "rootAttitude" }, R);
+    body->rootLink()->p() = p;
+    body->rootLink()->R() = R;
+
+    auto qs = data->findListing({ "initialJointDisplacements", "jointDisplacements" });
+    if(qs->isValid()){
+        const int n = std::min(qs->size(), body->numAllJoints());
+        for(int i=0; i < n; ++i){
+            body->joint(i)->q() = radian(qs->at(i)->toDouble());
+        }
+    } else {
+        // Old format using radian
+        qs = data->findListing({ "initialJointPositions", "jointPositions" });
+        if(qs->isValid()){
+            const int n = std::min(qs->size(), body->numAllJoints());
+            for(int i=0; i < n; ++i){
+                body->joint(i)->q() = qs->at(i)->toDouble();
+            }
+        }
+    }
+    body->calcForwardKinematics();
+
+    return simBody;
+}
+
+
+void SimulationRunner::readSimpleControllerItem(Mapping* data, SimBody* simBody)
+{
+    unique_ptr<SimpleControllerInstance> controller(new SimpleControllerInstance(simBody));
+    if(!data->read("controller", controller->moduleFile)){
+        return;
+    }
+    controller->moduleFile = pathVariableProcessor->expand(controller->moduleFile, false);
+    if(data->get("base_directory", "") == "Project directory"){
+        filesystem::path modulePath(fromUTF8(controller->moduleFile));
+        if(!modulePath.is_absolute()){
+            controller->moduleFile = toUTF8((pathVariableProcessor->projectDirPath() / modulePath).string());
+        }
+    }
+    controller->name = filesystem::path(fromUTF8(controller->moduleFile)).stem().string();
+    data->read("controllerOptions", controller->optionString_);
+    data->read("isNoDelayMode", controller->isNoDelayMode_);
+    simBody->controllers.push_back(std::move(controller));
+}
+
+
+SimBody* SimulationRunner::loadBody(const string& filename)
+{
+    DyBodyPtr body = new DyBody;
+    if(!bodyLoader.load(body, filename)){
+        cerr << formatR("Body file \"{}\" cannot be loaded.", filename) << endl;
+        return nullptr;
+    }
+    if(body->name().empty()){
+        body->setName(body->modelName());
+    }
+    body->initializePosition();
+    if(!body->isStaticModel() && body->mass() <= 0.0){
+        cerr << formatR("The mass of {0} is {1}, which cannot be simulated.", body->name(), body->mass()) << endl;
+        return nullptr;
+    }
+    auto simBody = new SimBody;
+    simBody->body = body;
+    simBody->world = &world;
+    simBodies.emplace_back(simBody);
+    return simBody;
+}
+
+
+bool SimulationRunner::initialize()
+{
+    if(simBodies.empty()){
+        cerr << "There is no body to simulate." << endl;
+        return false;
+    }
+    if(isKinematicsMode && isKinematicWalkingEnabled){
+        cerr << "The kinematic walking of the kinematics mode is not supported." << endl;
+        return false;
+    }
+
+    if(isRungeKuttaMode){
+        world.setRungeKuttaMethod();
+    } else {
+        world.setEulerMethod();
+    }
+    world.setGravityAcceleration(gravity);
+    world.enableSensors(true);
+    world.setNumThreads(numDynamicsThreads);
+    world.setTimeStep(timeStep);
+    world.setCurrentTime(0.0);
+
+    materialTable = new MaterialTable;
+    materialTable->load(toUTF8((shareDirPath() / "default" / "materials.yaml").string()), cerr);
+
+    ConstraintForceSolver& cfs = world.constraintForceSolver;
+    cfs.setMaterialTable(materialTable);
+    cfs.setGaussSeidelErrorCriterion(errorCriterion);
+    cfs.setGaussSeidelMaxNumIterations(maxNumIterations);
+    cfs.setContactDepthCorrection(contactCorrectionDepth, contactCorrectionVelocityRatio);
+    cfs.setFrictionCoefficientRange(minFrictionCoefficient, maxFrictionCoefficient);
+    cfs.setContactCullingDistance(contactCullingDistance);
+    cfs.setContactCullingDepth(contactCullingDepth);
+    cfs.setCoefficientOfRestitution(epsilon);
+    if(is2Dmode){
+        cfs.set2Dmode(true);
+    }
+
+    if(logFrameRate <= 0.0){
+        logFrameRate = 1.0 / timeStep;
+    }
+
+    for(auto& simBody : simBodies){
+        auto body = simBody->body;
+        body->setCurrentTimeFunction([this](){ return world.currentTime(); });
+        body->initializeState();
+
+        auto iter = simBody->controllers.begin();
+        while(iter != simBody->controllers.end()){
+            auto& controller = *iter;
+            if(controller->load() && controller->initialize()){
+                ++iter;
+            } else {
+                iter = simBody->controllers.erase(iter);
+            }
+        }
+
+        // The states of these links are given by the controllers as in AISTSimulatorItem
+        for(auto& link : body->links()){
+            if(link->actuationMode() == Link::AllStateHighGainActuationMode){
+                highGainStateLinks.push_back(link);
+            }
+        }
+
+        int bodyIndex = world.addBody(body);
+        cfs.setBodyCollisionDetectionMode(
+            bodyIndex, simBody->isCollisionDetectionEnabled, simBody->isSelfCollisionDetectionEnabled);
+
+        if(!logDirectory.empty() && !body->isStaticModel()){
+            simBody->motion = make_shared<BodyMotion>();
+            simBody->motion->setFrameRate(logFrameRate);
+            auto seq = simBody->motion->stateSeq();
+            seq->setNumLinkPositionsHint(body->numLinks());
+            seq->setNumJointDisplacementsHint(body->numAllJoints());
+            seq->setNumDeviceStatesHint(0);
+        }
+    }
+
+    world.initialize();
+
+    for(auto& simBody : simBodies){
+        for(auto& controller : simBody->controllers){
+            if(!controller->controller->start()){
+                cerr << formatR("{} failed to start.", controller->name) << endl;
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void SimulationRunner::run()
+{
+    const int numFrames = std::max(1, static_cast<int>(std::lround(timeLength / timeStep)));
+    const double logTimeStep = 1.0 / logFrameRate;
+    double nextLogTime = 0.0;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    for(int frame = 0; frame <= numFrames; ++frame){
+        const double time = frame * timeStep;
+        if(time >= nextLogTime - timeStep * 0.5){
+            for(auto& simBody : simBodies){
+                if(auto& motion = simBody->motion){
+                    auto body = simBody->body;
+                    auto block = motion->stateSeq()->appendAllocatedFrame().firstBlock();
+                    const int numLinks = body->numLinks();
+                    for(int i=0; i < numLinks; ++i){
+                        block.linkPosition(i).set(body->link(i)->T());
+                    }
+                    auto displacements = block.jointDisplacements();
+                    const int numJoints = body->numAllJoints();
+                    for(int i=0; i < numJoints; ++i){
+                        displacements[i] = body->joint(i)->q();
+                    }
+                }
+            }
+            nextLogTime += logTimeStep;
+        }
+        if(frame == numFrames){
+            break;
+        }
+
+        for(auto& simBody : simBodies){
+            for(auto& controller : simBody->controllers){
+                controller->input();
+                controller->controller->control();
+                if(controller->isNoDelayMode_){
+                    controller->output();
+                }
+            }
+        }
+        if(isKinematicsMode){
+            stepKinematics();
+        } else {
+            refreshHighGainStates();
+            world.calcNextState();
+        }
+        world.constraintForceSolver.clearExternalForces();
+        for(auto& simBody : simBodies){
+            for(auto& controller : simBody->controllers){
+                if(!controller->isNoDelayMode_){
+                    controller->output();
+                }
+            }
+        }
+    }
+
+    for(auto& simBody : simBodies){
+        for(auto& controller : simBody->controllers){
+            controller->controller->stop();
+        }
+    }
+
+    if(isVerbose){
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - startTime;
+        cout << formatR("Simulation of {0} [s] has finished. Computation time is {1} [s], "
+                        "computation time / simulation time = {2}.",
+                        numFrames * timeStep, elapsed.count(), elapsed.count() / (numFrames * timeStep))
+             << endl;
+    }
+}
+
+
+/**
+   This function updates the states of the links in the all state high-gain actuation mode
+   in the same way as AISTSimulatorItem.
+*/
+void SimulationRunner::refreshHighGainStates()
+{
+    bool doRefresh = false;
+    for(auto& link : highGainStateLinks){
+        if(link->actuationMode() == Link::AllStateHighGainActuationMode){
+            if(link->hasActualJoint()){
+                link->q() = link->q_target();
+                link->dq() = link->dq_target();
+            }
+            link->vo() = link->v() - link->w().cross(link->p());
+            doRefresh = true;
+        }
+    }
+    if(doRefresh){
+        world.refreshState();
+    }
+}
+
+
+//! The same as the kinematics mode of AISTSimulatorItem without the kinematic walking
+void SimulationRunner::stepKinematics()
+{
+    for(auto& simBody : simBodies){
+        auto body = simBody->body;
+        bool hasJointAngleActuation = false;
+        for(auto& joint : body->allJoints()){
+            if(joint->actuationMode() == Link::JointDisplacement){
+                joint->q() = joint->q_target();
+                joint->dq() = joint->dq_target();
+                hasJointAngleActuation = true;
+            }
+        }
+        if(hasJointAngleActuation){
+            body->calcForwardKinematics(true, true);
+        }
+    }
+    world.setCurrentTime(world.currentTime() + timeStep);
+}
+
+
+bool SimulationRunner::writeLogs()
+{
+    if(logDirectory.empty()){
+        return true;
+    }
+    filesystem::path dirPath(fromUTF8(logDirectory));
+    stdx::error_code ec;
+    filesystem::create_directories(dirPath, ec);
+
+    bool result = true;
+    for(auto& simBody : simBodies){
+        if(simBody->motion){
+            auto file = toUTF8((dirPath / (simBody->body->name() + ".seq")).string());
+            if(!simBody->motion->save(file, cerr)){
+                cerr << formatR("The motion of {0} cannot be written to \"{1}\".", simBody->body->name(), file) << endl;
+                result = false;
+            } else if(isVerbose){
+                cout << formatR("The motion of {0} has been written to \"{1}\".", simBody->body->name(), file) << endl;
+            }
+        }
+    }
+    return result;
+}
+
+
+int main(int argc, char* argv[])
+{
+    SimulationRunner runner;
+
+    double timeLength = -1.0;
+    double timeStep = -1.0;
+    vector<string> files;
+
+    CLI::App app("Choreonoid simulation runner without the GUI");
+    app.add_option("files", files, "project file (.cnoid) or body files to simulate")->required();
+    app.add_option("--time", timeLength, "simulation time length [s]");
+    app.add_option("--time-step", timeStep, "time step of the simulation [s]");
+    app.add_option("--log", runner.logDirectory, "directory to write the motion file of each body");
+    app.add_option("--log-frame-rate", runner.logFrameRate, "frame rate of the motion files");
+    app.add_option("--threads", runner.numDynamicsThreads, "number of the dynamics threads");
+    app.add_flag("--verbose", runner.isVerbose, "output the progress messages");
+
+    try {
+        app.parse(argc, argv);
+    }
+    catch(const CLI::ParseError& ex){
+        return app.exit(ex);
+    }
+
+    for(auto& file : files){
+        if(filesystem::path(fromUTF8(file)).extension() == ".cnoid"){
+            if(!runner.loadProject(file)){
+                return 1;
+            }
+        } else if(!runner.loadBody(file)){
+            return 1;
+        }
+    }
+
+    if(timeLength > 0.0){
+        runner.timeLength = timeLength;
+    }
+    if(timeStep > 0.0){
+        runner.timeStep = timeStep;
+    }
+
+    if(!runner.initialize()){
+        return 1;
+    }
+    runner.run();
+
+    return runner.writeLogs() ? 0 : 1;
+}
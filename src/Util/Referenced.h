@@ -92,10 +92,15 @@ protected:
     Referenced() : refCount_(0), weakCounter_(nullptr) { }
     Referenced(const Referenced&) : refCount_(0), weakCounter_(nullptr) { }
 
+public:
+    /**
+       \note The value may be changed by other threads holding the references.
+       The only reliable use in the multi-thread environment is to check if the
+       object is referenced by the caller alone, that is, the count is one.
+    */
     //int refCount() const { return refCount_.load(std::memory_order_relaxed); }
     int refCount() const { return refCount_.load(); }
     
-public:
     virtual ~Referenced();
 };
 
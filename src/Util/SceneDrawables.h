@@ -157,6 +157,12 @@ private:
 };
 
 
+/**
+   The element buffer is shared by the copies of an array and it is copied when a copy
+   is modified (copy-on-write) in the same way as the image of SgImage. Note that an iterator
+   or a reference obtained by a non-const function is invalidated when the array is copied
+   by another object and the array is modified after that.
+*/
 template<class T, class Alloc = std::allocator<T>> class SgVectorArray : public SgObject
 {
     typedef std::vector<T> Container;
@@ -172,16 +178,16 @@ public:
     typedef typename Container::const_pointer const_pointer;
     typedef typename T::Scalar Scalar;
 
-    SgVectorArray() { }
-    SgVectorArray(size_t size) : values(size) { }
-    SgVectorArray(const std::vector<T>& org) : values(org) { }
-    SgVectorArray(std::initializer_list<T> init) : values(init) { }
+    SgVectorArray() : values(std::make_shared<Container>()) { }
+    SgVectorArray(size_t size) : values(std::make_shared<Container>(size)) { }
+    SgVectorArray(const std::vector<T>& org) : values(std::make_shared<Container>(org)) { }
+    SgVectorArray(std::initializer_list<T> init) : values(std::make_shared<Container>(init)) { }
 
     template<class Element>
-    SgVectorArray(const std::vector<Element>& org) {
-        values.reserve(org.size());
+    SgVectorArray(const std::vector<Element>& org) : values(std::make_shared<Container>()) {
+        values->reserve(org.size());
         for(typename std::vector<Element>::const_iterator p = org.begin(); p != org.end(); ++p){
-            values.push_back(p->template cast<typename T::Scalar>());
+            values->push_back(p->template cast<typename T::Scalar>());
         }
     }
         
@@ -191,40 +197,66 @@ public:
         values = rhs.values;
         return *this;
     }
-    iterator begin() { return values.begin(); }
-    const_iterator begin() const { return values.begin(); }
-    iterator end() { return values.end(); }
-    const_iterator end() const { return values.end(); }
-    size_type size() const { return values.size(); }
-    void resize(size_type s) { values.resize(s); }
-    void resize(size_type s, const T& v) { values.resize(s, v); }
-    bool empty() const { return values.empty(); }
-    void reserve(size_type s) { values.reserve(s); }
-    size_type capacity() const { return values.capacity(); }
-    T& operator[](size_type i) { return values[i]; }
-    const T& operator[](size_type i) const { return values[i]; }
-    T& at(size_type i) { return values[i]; }
-    const T& at(size_type i) const { return values[i]; }
-    T& front() { return values.front(); }
-    const T& front() const { return values.front(); }
-    T& back() { return values.back(); }
-    const T& back() const { return values.back(); }
-    Scalar* data() { return values.front().data(); }
-    const Scalar* data() const { return values.front().data(); }
-    iterator insert(const_iterator pos, std::initializer_list<T> il){ return values.insert(pos, il); }
-    void push_back(const T& v) { values.push_back(v); }
-    template<class... Args> void emplace_back(Args&&... args) { values.emplace_back(args...); }
-    void pop_back() { values.pop_back(); }
-    iterator erase(iterator p) { return values.erase(p); }
-    iterator erase(iterator first, iterator last) { return values.erase(first, last); }
-    void clear() { values.clear(); }
-    void shrink_to_fit() { values.shrink_to_fit(); }
+    iterator begin() { return writableValues().begin(); }
+    const_iterator begin() const { return values->begin(); }
+    iterator end() { return writableValues().end(); }
+    const_iterator end() const { return values->end(); }
+    size_type size() const { return values->size(); }
+    void resize(size_type s) { writableValues().resize(s); }
+    void resize(size_type s, const T& v) { writableValues().resize(s, v); }
+    bool empty() const { return values->empty(); }
+    void reserve(size_type s) { writableValues().reserve(s); }
+    size_type capacity() const { return values->capacity(); }
+    T& operator[](size_type i) { return writableValues()[i]; }
+    const T& operator[](size_type i) const { return (*values)[i]; }
+    T& at(size_type i) { return writableValues()[i]; }
+    const T& at(size_type i) const { return (*values)[i]; }
+    T& front() { return writableValues().front(); }
+    const T& front() const { return values->front(); }
+    T& back() { return writableValues().back(); }
+    const T& back() const { return values->back(); }
+    Scalar* data() { return writableValues().front().data(); }
+    const Scalar* data() const { return values->front().data(); }
+    iterator insert(const_iterator pos, std::initializer_list<T> il){
+        auto offset = pos - values->cbegin();
+        auto& v = writableValues();
+        return v.insert(v.cbegin() + offset, il);
+    }
+    void push_back(const T& v) { writableValues().push_back(v); }
+    template<class... Args> void emplace_back(Args&&... args) { writableValues().emplace_back(args...); }
+    void pop_back() { writableValues().pop_back(); }
+    iterator erase(iterator p) {
+        auto offset = p - values->begin();
+        auto& v = writableValues();
+        return v.erase(v.begin() + offset);
+    }
+    iterator erase(iterator first, iterator last) {
+        auto offset = first - values->begin();
+        auto length = last - first;
+        auto& v = writableValues();
+        return v.erase(v.begin() + offset, v.begin() + offset + length);
+    }
+    void clear() {
+        if(values.use_count() > 1){
+            values = std::make_shared<Container>();
+        } else {
+            values->clear();
+        }
+    }
+    void shrink_to_fit() { writableValues().shrink_to_fit(); }
 
 protected:
     virtual Referenced* doClone(CloneMap*) const override { return new SgVectorArray(*this); }
         
 private:
-    Container values;
+    Container& writableValues() {
+        if(values.use_count() > 1){
+            values = std::make_shared<Container>(*values);
+        }
+        return *values;
+    }
+    
+    std::shared_ptr<Container> values;
 };
 
 typedef SgVectorArray<Vector3f> SgVertexArray;
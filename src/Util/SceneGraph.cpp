@@ -22,6 +22,16 @@ CloneMap::FlagId DisableMetaSceneCloning("SgObjectDisableMetaSceneCloning");
 
 const BoundingBox emptyBoundingBox;
 
+struct UpdateBatchState
+{
+    int depth;
+    // The objects whose pending actions have been set in the batch
+    vector<SgObjectPtr> pendingObjects;
+    UpdateBatchState() : depth(0) { }
+};
+
+thread_local UpdateBatchState updateBatchState;
+
 }
 
 
@@ -29,12 +39,14 @@ SgObject::SgObject()
 {
     attributes_ = 0;
     hasValidBoundingBoxCache_ = false;
+    pendingUpdateAction_ = 0;
 }
 
 
 SgObject::SgObject(const SgObject& org)
     : attributes_(org.attributes_),
       hasValidBoundingBoxCache_(false),
+      pendingUpdateAction_(0),
       name_(org.name_)
 {
     if(org.uriInfo){
@@ -121,6 +133,10 @@ bool SgObject::traverseObjects_(std::function<TraverseStatus(SgObject* object)>&
 
 void SgObject::notifyUpperNodesOfUpdate(SgUpdate& update)
 {
+    if(updateBatchState.depth > 0 && !update.hasAction(SgUpdate::Added | SgUpdate::Removed)){
+        accumulatePendingUpdateAction(update.action(), update.hasAction(SgUpdate::GeometryModified));
+        return;
+    }
     notifyUpperNodesOfUpdate(update, update.hasAction(SgUpdate::GeometryModified));
 }
 
@@ -139,10 +155,62 @@ void SgObject::notifyUpperNodesOfUpdate(SgUpdate& update, bool doInvalidateBound
 }
 
 
+void SgObject::accumulatePendingUpdateAction(int action, bool doInvalidateBoundingBox)
+{
+    /*
+      The upper nodes have already accumulated the action when this object has it, so the
+      accumulation is finished here. A group node which has the invalid bounding box cache can
+      also be skipped because the cache of a group is always updated together with the caches
+      of its descendant groups. This makes the repeated updates of an object in a batch O(1).
+    */
+    if((pendingUpdateAction_ & action) == action){
+        if(!doInvalidateBoundingBox || (hasAttribute(GroupNode) && !hasValidBoundingBoxCache_)){
+            return;
+        }
+    }
+    if(doInvalidateBoundingBox){
+        invalidateBoundingBox();
+    }
+    if(!pendingUpdateAction_){
+        updateBatchState.pendingObjects.push_back(this);
+    }
+    pendingUpdateAction_ |= action;
+    for(auto& parent : parents){
+        parent->accumulatePendingUpdateAction(action, doInvalidateBoundingBox);
+    }
+}
+
+
+/**
+   The pending action is cleared when the signal is emitted, so the upper nodes which have
+   already been notified via another updated object are skipped.
+*/
+void SgObject::emitPendingUpdate(SgUpdate& update)
+{
+    const int action = pendingUpdateAction_;
+    if(!action){
+        return;
+    }
+    pendingUpdateAction_ = 0;
+    update.pushNode(this);
+    update.setAction(action);
+    sigUpdated_(update);
+    for(auto& parent : parents){
+        parent->emitPendingUpdate(update);
+    }
+    update.popNode();
+}
+
+
 void SgObject::addParent(SgObject* parent, SgUpdateRef update)
 {
     parents.insert(parent);
 
+    // The new parent must also have the pending action for the early return of the accumulation
+    if(pendingUpdateAction_ && updateBatchState.depth > 0){
+        parent->accumulatePendingUpdateAction(pendingUpdateAction_, false);
+    }
+
     if(update){
         update->clearPath();
         update->pushNode(this);
@@ -181,6 +249,45 @@ bool SgObject::checkIfAncestorOf(SgObject* obj) const
 }
 
 
+SgUpdateBatch::SgUpdateBatch()
+{
+    ++updateBatchState.depth;
+}
+
+
+SgUpdateBatch::~SgUpdateBatch()
+{
+    auto& state = updateBatchState;
+    if(--state.depth > 0){
+        return;
+    }
+    /*
+      The objects are recorded in the order of the accumulation, so the signals are emitted from
+      the updated objects first. The remaining objects are the former ancestors of an updated
+      object which has been removed from them in the batch, and they are notified from themselves
+      so that no pending action is left. The signal handlers may update the objects again, which
+      are notified immediately.
+    */
+    vector<SgObjectPtr> pendingObjects;
+    pendingObjects.swap(state.pendingObjects);
+    SgTmpUpdate update;
+    for(auto& object : pendingObjects){
+        update.clearPath();
+        object->emitPendingUpdate(update);
+    }
+    pendingObjects.clear();
+    if(state.pendingObjects.empty()){
+        state.pendingObjects.swap(pendingObjects);
+    }
+}
+
+
+bool SgUpdateBatch::isActive()
+{
+    return updateBatchState.depth > 0;
+}
+
+
 const std::string& SgObject::uri() const
 {
     if(!uriInfo){
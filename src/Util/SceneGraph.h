@@ -169,6 +169,8 @@ protected:
 private:
     unsigned short attributes_;
     mutable bool hasValidBoundingBoxCache_;
+    // The actions of the update notifications deferred by SgUpdateBatch
+    unsigned char pendingUpdateAction_;
     ParentContainer parents;
     Signal<void(const SgUpdate& update)> sigUpdated_;
     Signal<void(bool on)> sigGraphConnection_;
@@ -186,11 +188,41 @@ private:
 
     SgObject* findObject_(std::function<bool(SgObject* object)>& pred);
     bool traverseObjects_(std::function<TraverseStatus(SgObject* object)>& pred);
+    void accumulatePendingUpdateAction(int action, bool doInvalidateBoundingBox);
+    void emitPendingUpdate(SgUpdate& update);
+
+    friend class SgUpdateBatch;
 };
 
 typedef ref_ptr<SgObject> SgObjectPtr;
 
 
+/**
+   While an instance of this class exists, the update notifications issued by the current
+   thread are deferred, and the bounding box caches of the updated objects and their upper
+   nodes are only invalidated. When the outermost instance is destroyed, the sigUpdated signal
+   of each updated object and each of its upper nodes is emitted only once with the union of
+   the actions, so that a node whose many descendants are updated, such as a SceneBody whose
+   link positions are updated, is notified once instead of once per descendant.
+
+   The notifications with the Added or Removed action are not deferred because their paths
+   are used to identify the added and removed nodes. The path of a deferred notification is
+   the path from one of the updated objects below the notified node. When an updated object
+   is removed from its parent in the batch, the former upper nodes of the object are notified
+   with the paths beginning with themselves.
+*/
+class CNOID_EXPORT SgUpdateBatch
+{
+public:
+    SgUpdateBatch();
+    ~SgUpdateBatch();
+    SgUpdateBatch(const SgUpdateBatch&) = delete;
+    SgUpdateBatch& operator=(const SgUpdateBatch&) = delete;
+
+    static bool isActive();
+};
+
+
 class CNOID_EXPORT SgNode : public SgObject
 {
 public:
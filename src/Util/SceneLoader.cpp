@@ -1,4 +1,6 @@
 #include "SceneLoader.h"
+#include "SceneGraph.h"
+#include "CloneMap.h"
 #include "NullOut.h"
 #include "UTF8.h"
 #include "Format.h"
@@ -6,6 +8,8 @@
 #include <mutex>
 #include <map>
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include "gettext.h"
 
 using namespace std;
@@ -21,6 +25,35 @@ vector<LoaderFactory> loaderFactories;
 mutex loaderMutex;
 Signal<void(const std::vector<std::string>& extensions)> sigAvailableFileExtensionsAdded_;
 
+struct SceneCacheEntry
+{
+    SgNodePtr scene;
+    std::time_t fileTime;
+    uintmax_t fileSize;
+    uint64_t lastAccessCount;
+};
+
+map<string, SceneCacheEntry> sceneCache;
+mutex sceneCacheMutex;
+bool isSceneCacheEnabled_ = false;
+bool isSceneCacheEnabledInitialized = false;
+int maxNumCachedScenes_ = 100;
+uint64_t sceneCacheAccessCounter = 0;
+
+// sceneCacheMutex must be locked
+void evictLeastRecentlyUsedScenes(int maxNumScenes)
+{
+    while(static_cast<int>(sceneCache.size()) > maxNumScenes){
+        auto oldest = sceneCache.begin();
+        for(auto p = sceneCache.begin(); p != sceneCache.end(); ++p){
+            if(p->second.lastAccessCount < oldest->second.lastAccessCount){
+                oldest = p;
+            }
+        }
+        sceneCache.erase(oldest);
+    }
+}
+
 }
 
 namespace cnoid {
@@ -40,6 +73,9 @@ public:
     Impl(SceneLoader* impl);
     AbstractSceneLoaderPtr findLoader(string ext);
     SgNode* load(const std::string& filename, bool* out_isSupportedFormat);
+    string getSceneCacheKey(const stdx::filesystem::path& filepath);
+    SgNode* findCachedScene(const string& key, const stdx::filesystem::path& filepath);
+    void storeSceneInCache(const string& key, const stdx::filesystem::path& filepath, SgNode* scene);
 };
 
 }
@@ -90,6 +126,53 @@ SignalProxy<void(const std::vector<std::string>& extensions)> SceneLoader::sigAv
 }
 
 
+void SceneLoader::setSceneCacheEnabled(bool on)
+{
+    lock_guard<mutex> lock(sceneCacheMutex);
+    isSceneCacheEnabled_ = on;
+    isSceneCacheEnabledInitialized = true;
+    if(!on){
+        sceneCache.clear();
+    }
+}
+
+
+bool SceneLoader::isSceneCacheEnabled()
+{
+    lock_guard<mutex> lock(sceneCacheMutex);
+    if(!isSceneCacheEnabledInitialized){
+        char* CNOID_ENABLE_SCENE_CACHE = getenv("CNOID_ENABLE_SCENE_CACHE");
+        if(CNOID_ENABLE_SCENE_CACHE && (strcmp(CNOID_ENABLE_SCENE_CACHE, "0") != 0)){
+            isSceneCacheEnabled_ = true;
+        }
+        isSceneCacheEnabledInitialized = true;
+    }
+    return isSceneCacheEnabled_;
+}
+
+
+void SceneLoader::clearSceneCache()
+{
+    lock_guard<mutex> lock(sceneCacheMutex);
+    sceneCache.clear();
+}
+
+
+void SceneLoader::setMaxNumCachedScenes(int n)
+{
+    lock_guard<mutex> lock(sceneCacheMutex);
+    maxNumCachedScenes_ = std::max(0, n);
+    evictLeastRecentlyUsedScenes(maxNumCachedScenes_);
+}
+
+
+int SceneLoader::maxNumCachedScenes()
+{
+    lock_guard<mutex> lock(sceneCacheMutex);
+    return maxNumCachedScenes_;
+}
+
+
 SceneLoader::SceneLoader()
 {
     impl = new Impl(this);
@@ -198,8 +281,18 @@ SgNode* SceneLoader::Impl::load(const std::string& filename, bool* out_isSupport
         }
         loader->setLengthUnitHint(self->lengthUnitHint());
         loader->setUpperAxisHint(self->upperAxisHint());
-        
-        node = loader->load(filename);
+
+        string cacheKey;
+        if(SceneLoader::isSceneCacheEnabled()){
+            cacheKey = getSceneCacheKey(filepath);
+            node = findCachedScene(cacheKey, filepath);
+        }
+        if(!node){
+            node = loader->load(filename);
+            if(node && !cacheKey.empty()){
+                storeSceneInCache(cacheKey, filepath, node);
+            }
+        }
         
         actualSceneLoaderOnLastLoading = loader;
         os().flush();
@@ -209,6 +302,93 @@ SgNode* SceneLoader::Impl::load(const std::string& filename, bool* out_isSupport
 }
 
 
+/**
+   The key consists of the absolute file path and the loading options that affect the loaded scene.
+*/
+string SceneLoader::Impl::getSceneCacheKey(const stdx::filesystem::path& filepath)
+{
+    stdx::error_code ec;
+    auto absolutePath = stdx::filesystem::absolute(filepath, ec);
+    if(ec){
+        return string();
+    }
+    return formatC("{0}?unit={1}&axis={2}&division={3}&crease={4}",
+                   toUTF8(absolutePath.lexically_normal().string()),
+                   static_cast<int>(self->lengthUnitHint()), static_cast<int>(self->upperAxisHint()),
+                   defaultDivisionNumber, defaultCreaseAngle);
+}
+
+
+SgNode* SceneLoader::Impl::findCachedScene(const string& key, const stdx::filesystem::path& filepath)
+{
+    if(key.empty()){
+        return nullptr;
+    }
+    
+    lock_guard<mutex> lock(sceneCacheMutex);
+    auto p = sceneCache.find(key);
+    if(p == sceneCache.end()){
+        return nullptr;
+    }
+    auto& entry = p->second;
+    // Only the time stamp and the size of the top-level file are checked
+    stdx::error_code ec;
+    auto fileSize = stdx::filesystem::file_size(filepath, ec);
+    bool isValid = !ec && (fileSize == entry.fileSize);
+    if(isValid){
+        try {
+            isValid = (stdx::filesystem::last_write_time_to_time_t(filepath) == entry.fileTime);
+        }
+        catch(...){
+            isValid = false;
+        }
+    }
+    if(!isValid){
+        sceneCache.erase(p);
+        return nullptr;
+    }
+    entry.lastAccessCount = ++sceneCacheAccessCounter;
+
+    /*
+      The scene objects including the meshes are cloned in the lock so that no object is shared
+      with the scenes used by the other threads. Sharing an object makes the threads update its
+      parent set concurrently. The element buffers of the vertex, normal, color and texture
+      coordinate arrays are not copied here but shared with the cached scene until a clone
+      modifies them.
+    */
+    CloneMap cloneMap;
+    return cloneMap.getClone<SgNode>(entry.scene);
+}
+
+
+void SceneLoader::Impl::storeSceneInCache(const string& key, const stdx::filesystem::path& filepath, SgNode* scene)
+{
+    SceneCacheEntry entry;
+    stdx::error_code ec;
+    entry.fileSize = stdx::filesystem::file_size(filepath, ec);
+    if(ec){
+        return;
+    }
+    try {
+        entry.fileTime = stdx::filesystem::last_write_time_to_time_t(filepath);
+    }
+    catch(...){
+        return;
+    }
+
+    // The loaded scene is returned to the caller, and a clone sharing only the array buffers with it is cached
+    CloneMap cloneMap;
+    entry.scene = cloneMap.getClone<SgNode>(scene);
+
+    lock_guard<mutex> lock(sceneCacheMutex);
+    if(maxNumCachedScenes_ > 0){
+        entry.lastAccessCount = ++sceneCacheAccessCounter;
+        sceneCache[key] = entry;
+        evictLeastRecentlyUsedScenes(maxNumCachedScenes_);
+    }
+}
+
+
 std::shared_ptr<AbstractSceneLoader> SceneLoader::actualSceneLoaderOnLastLoading()
 {
     return impl->actualSceneLoaderOnLastLoading;
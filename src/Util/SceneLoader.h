@@ -22,6 +22,26 @@ public:
     static std::vector<std::string> availableFileExtensions();
     static SignalProxy<void(const std::vector<std::string>& extensions)> sigAvailableFileExtensionsAdded();
 
+    /**
+       When the scene cache is enabled, a scene loaded from a file is kept in the process-wide cache
+       and the following loads of the same file return clones of the cached scene. A clone shares
+       no scene object with the cache and the other clones, so the scenes can be used in different
+       threads. The vertex data of the meshes and the texture images are shared copy-on-write.
+       A cached scene is reloaded when the time stamp or the size of the file has changed.
+       Note that only the file given to the load function is checked, so the cached scene is not
+       updated when only the files referred from the file such as the mesh and texture files have
+       been changed. Call clearSceneCache() in that case.
+       The cache is disabled by default and it can be enabled by the CNOID_ENABLE_SCENE_CACHE
+       environment variable as well as this function.
+    */
+    static void setSceneCacheEnabled(bool on);
+    static bool isSceneCacheEnabled();
+    static void clearSceneCache();
+
+    //! The least recently used scenes are removed when the number of the cached scenes exceeds this limit.
+    static void setMaxNumCachedScenes(int n);
+    static int maxNumCachedScenes();
+
     SceneLoader();
     virtual ~SceneLoader();
     virtual void setMessageSink(std::ostream& os) override;
@@ -0,0 +1,294 @@
+#include "TaskScheduler.h"
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+struct Task
+{
+    TaskScheduler::TaskFunction function;
+    void* data;
+    TaskScheduler::TaskGroup* group;
+};
+
+/**
+   Ring buffer of the tasks. The buffer only grows, so no memory is allocated
+   after the number of the queued tasks reaches its maximum.
+*/
+class alignas(64) TaskDeque
+{
+public:
+    TaskDeque() : buffer(64), head(0), size(0) { }
+
+    void pushBack(const Task& task){
+        lock_guard<mutex> guard(mutex_);
+        if(size == buffer.size()){
+            vector<Task> newBuffer(buffer.size() * 2);
+            for(size_t i=0; i < size; ++i){
+                newBuffer[i] = buffer[(head + i) % buffer.size()];
+            }
+            buffer.swap(newBuffer);
+            head = 0;
+        }
+        buffer[(head + size) % buffer.size()] = task;
+        ++size;
+    }
+
+    bool popBack(Task& out_task){
+        lock_guard<mutex> guard(mutex_);
+        if(size == 0){
+            return false;
+        }
+        --size;
+        out_task = buffer[(head + size) % buffer.size()];
+        return true;
+    }
+
+    bool popFront(Task& out_task){
+        lock_guard<mutex> guard(mutex_);
+        if(size == 0){
+            return false;
+        }
+        out_task = buffer[head];
+        head = (head + 1) % buffer.size();
+        --size;
+        return true;
+    }
+
+private:
+    mutex mutex_;
+    vector<Task> buffer;
+    size_t head;
+    size_t size;
+};
+
+}
+
+namespace cnoid {
+
+class TaskScheduler::Impl
+{
+public:
+    vector<unique_ptr<TaskDeque>> deques;
+    vector<thread> threads;
+    atomic<int> numQueuedTasks;
+    atomic<int> numSleepingThreads;
+    atomic<unsigned int> nextDequeIndex;
+    bool isDestroying;
+    mutex sleepMutex;
+    condition_variable condition;
+
+    static thread_local Impl* currentImpl;
+    static thread_local int currentWorkerIndex;
+
+    Impl(int numThreads);
+    ~Impl();
+    int getWorkerIndex() const { return (currentImpl == this) ? currentWorkerIndex : -1; }
+    void run(int workerIndex);
+    void submit(const Task& task);
+    bool popTask(int workerIndex, Task& out_task);
+    void execute(const Task& task);
+    void wait(TaskGroup& group);
+};
+
+thread_local TaskScheduler::Impl* TaskScheduler::Impl::currentImpl = nullptr;
+thread_local int TaskScheduler::Impl::currentWorkerIndex = -1;
+
+}
+
+
+TaskScheduler::TaskScheduler(int numThreads)
+{
+    impl = new Impl(numThreads);
+}
+
+
+TaskScheduler::Impl::Impl(int numThreads)
+    : numQueuedTasks(0),
+      numSleepingThreads(0),
+      nextDequeIndex(0),
+      isDestroying(false)
+{
+    for(int i=0; i < numThreads; ++i){
+        deques.emplace_back(new TaskDeque);
+    }
+    for(int i=0; i < numThreads; ++i){
+        threads.emplace_back([this, i](){ run(i); });
+    }
+}
+
+
+TaskScheduler::~TaskScheduler()
+{
+    delete impl;
+}
+
+
+TaskScheduler::Impl::~Impl()
+{
+    {
+        lock_guard<mutex> guard(sleepMutex);
+        isDestroying = true;
+        condition.notify_all();
+    }
+    for(auto& thread : threads){
+        if(thread.joinable()){
+            thread.join();
+        }
+    }
+}
+
+
+TaskScheduler* TaskScheduler::instance()
+{
+    static TaskScheduler scheduler(std::max(static_cast<int>(thread::hardware_concurrency()), 1) - 1);
+    return &scheduler;
+}
+
+
+int TaskScheduler::numThreads() const
+{
+    return impl->threads.size();
+}
+
+
+void TaskScheduler::Impl::run(int workerIndex)
+{
+    currentImpl = this;
+    currentWorkerIndex = workerIndex;
+    
+    Task task;
+    while(true){
+        if(popTask(workerIndex, task)){
+            execute(task);
+        } else {
+            unique_lock<mutex> lock(sleepMutex);
+            if(isDestroying && numQueuedTasks == 0){
+                break;
+            }
+            ++numSleepingThreads;
+            condition.wait(lock, [&](){ return numQueuedTasks > 0 || isDestroying; });
+            --numSleepingThreads;
+        }
+    }
+}
+
+
+void TaskScheduler::submit(TaskGroup& group, TaskFunction function, void* data)
+{
+    group.numPendingTasks.fetch_add(1, std::memory_order_relaxed);
+    Task task { function, data, &group };
+    if(impl->threads.empty()){
+        impl->execute(task);
+    } else {
+        impl->submit(task);
+    }
+}
+
+
+void TaskScheduler::Impl::submit(const Task& task)
+{
+    int index = getWorkerIndex();
+    if(index < 0){
+        index = nextDequeIndex.fetch_add(1, std::memory_order_relaxed) % deques.size();
+    }
+    deques[index]->pushBack(task);
+    ++numQueuedTasks;
+    if(numSleepingThreads > 0){
+        lock_guard<mutex> guard(sleepMutex);
+        condition.notify_one();
+    }
+}
+
+
+bool TaskScheduler::Impl::popTask(int workerIndex, Task& out_task)
+{
+    const int n = deques.size();
+    bool popped = false;
+    if(workerIndex >= 0){
+        popped = deques[workerIndex]->popBack(out_task);
+    }
+    if(!popped){
+        const int start = (workerIndex >= 0) ? (workerIndex + 1) : 0;
+        for(int i=0; i < n; ++i){
+            if(deques[(start + i) % n]->popFront(out_task)){
+                popped = true;
+                break;
+            }
+        }
+    }
+    if(popped){
+        --numQueuedTasks;
+    }
+    return popped;
+}
+
+
+void TaskScheduler::Impl::execute(const Task& task)
+{
+    task.function(task.data);
+
+    // The group may be destroyed by the waiting thread after the counter becomes zero
+    if(task.group->numPendingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1){
+        lock_guard<mutex> guard(sleepMutex);
+        condition.notify_all();
+    }
+}
+
+
+void TaskScheduler::wait(TaskGroup& group)
+{
+    impl->wait(group);
+}
+
+
+void TaskScheduler::Impl::wait(TaskGroup& group)
+{
+    const int workerIndex = getWorkerIndex();
+    Task task;
+    while(!group.isFinished()){
+        if(popTask(workerIndex, task)){
+            execute(task);
+        } else {
+            unique_lock<mutex> lock(sleepMutex);
+            ++numSleepingThreads;
+            condition.wait(lock, [&](){ return group.isFinished() || numQueuedTasks > 0; });
+            --numSleepingThreads;
+        }
+    }
+}
+
+
+void TaskScheduler::runParallelForJob(ParallelForJob& job, int maxNumThreads)
+{
+    const int numChunks = (job.end - job.nextIndex + job.chunkSize - 1) / job.chunkSize;
+    if(numChunks <= 0){
+        return;
+    }
+    int numHelpers = std::min(numThreads(), numChunks - 1);
+    if(maxNumThreads > 0){
+        numHelpers = std::min(numHelpers, maxNumThreads - 1);
+    }
+
+    auto process = [](void* data){
+        auto& job = *static_cast<ParallelForJob*>(data);
+        int index;
+        while((index = job.nextIndex.fetch_add(job.chunkSize)) < job.end){
+            job.invoke(job.function, index, std::min(index + job.chunkSize, job.end));
+        }
+    };
+
+    TaskGroup group;
+    for(int i=0; i < numHelpers; ++i){
+        submit(group, process, &job);
+    }
+    process(&job);
+    wait(group);
+}
@@ -0,0 +1,107 @@
+#ifndef CNOID_UTIL_TASK_SCHEDULER_H
+#define CNOID_UTIL_TASK_SCHEDULER_H
+
+#include <atomic>
+#include <type_traits>
+#include "exportdecl.h"
+
+namespace cnoid {
+
+/**
+   Work-stealing task scheduler.
+   Each worker thread has its own task deque. A worker takes the tasks from the back of its
+   own deque and steals the tasks from the front of the other deques when its deque is empty.
+   The tasks are stored as pairs of a function pointer and a pointer to the data owned by
+   the caller, so no memory is allocated to submit a task.
+*/
+class CNOID_EXPORT TaskScheduler
+{
+public:
+    typedef void (*TaskFunction)(void* data);
+
+    /**
+       Counter of the tasks submitted with the same group.
+       The group must be alive until wait() returns.
+    */
+    class TaskGroup
+    {
+    public:
+        TaskGroup() : numPendingTasks(0) { }
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+        bool isFinished() const { return numPendingTasks.load(std::memory_order_acquire) == 0; }
+    private:
+        std::atomic<int> numPendingTasks;
+        friend class TaskScheduler;
+    };
+
+    /**
+       \param numThreads The number of the worker threads, which does not include the threads
+       submitting the tasks.
+    */
+    TaskScheduler(int numThreads);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /**
+       The scheduler shared in the process. The number of the worker threads is the number of
+       the hardware threads minus one because the thread calling wait() also executes the tasks.
+    */
+    static TaskScheduler* instance();
+
+    int numThreads() const;
+
+    void submit(TaskGroup& group, TaskFunction function, void* data);
+
+    //! The function object must be alive until the task is finished.
+    template<class Function>
+    void submit(TaskGroup& group, Function& function) {
+        submit(group, [](void* data){ (*static_cast<Function*>(data))(); }, &function);
+    }
+
+    /**
+       The calling thread executes the tasks of any group until the tasks of the group are finished.
+       It sleeps without consuming the CPU when there is no task to execute.
+    */
+    void wait(TaskGroup& group);
+
+    /**
+       The range [begin, end) is divided into the chunks of chunkSize elements, and
+       function(chunkBegin, chunkEnd) is called for each chunk by the calling thread
+       and the worker threads. The chunks are taken in the ascending order.
+       \param maxNumThreads The maximum number of the threads including the calling thread.
+       Zero means no limit.
+    */
+    template<class Function>
+    void parallelFor(int begin, int end, int chunkSize, Function&& function, int maxNumThreads = 0) {
+        ParallelForJob job(begin, end, chunkSize);
+        job.function = &function;
+        job.invoke = [](void* function, int chunkBegin, int chunkEnd){
+            (*static_cast<typename std::remove_reference<Function>::type*>(function))(chunkBegin, chunkEnd);
+        };
+        runParallelForJob(job, maxNumThreads);
+    }
+
+private:
+    struct ParallelForJob
+    {
+        ParallelForJob(int begin, int end, int chunkSize)
+            : nextIndex(begin), end(end), chunkSize(chunkSize > 0 ? chunkSize : 1) { }
+        std::atomic<int> nextIndex;
+        int end;
+        int chunkSize;
+        void* function;
+        void (*invoke)(void* function, int chunkBegin, int chunkEnd);
+    };
+
+    void runParallelForJob(ParallelForJob& job, int maxNumThreads);
+
+    class Impl;
+    Impl* impl;
+};
+
+}
+
+#endif
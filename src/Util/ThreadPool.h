@@ -9,6 +9,10 @@
 
 namespace cnoid {
 
+/**
+   \note TaskScheduler, which shares the worker threads in the process and does not
+   allocate memory for each task, is recommended for the tasks executed in every step.
+*/
 class ThreadPool
 {
 private:
@@ -72,21 +76,9 @@ public:
         }
     }
 
-    /**
-       The behavior of this function is probably the same as the wait function,
-       but it is unclear now why this implementation is also necessary.
-    */
+    //! This is the same as the wait function. The busy loop previously used here wasted a core.
     void waitLoop(){
-        while(true){
-            {
-                std::unique_lock<std::mutex> lock(mutex, std::try_to_lock_t());
-                if(lock.owns_lock()){
-                    if(queue.empty() && numActiveThreads == 0){
-                        break;
-                    }
-                }
-            }
-        }
+        wait();
     }
 
     bool isRunning() {
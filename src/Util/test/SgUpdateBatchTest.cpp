@@ -0,0 +1,121 @@
+/**
+   The regression test of SgUpdateBatch. The program returns a non-zero exit code when one of
+   the checks fails.
+*/
+
+#include <cnoid/SceneGraph>
+#include <cnoid/SceneDrawables>
+#include <iostream>
+
+using namespace std;
+using namespace cnoid;
+
+namespace {
+
+int numFailures = 0;
+
+void check(bool condition, const char* description)
+{
+    if(!condition){
+        cerr << "Failed: " << description << endl;
+        ++numFailures;
+    }
+}
+
+class UpdateCounter
+{
+public:
+    int count;
+    int action;
+    UpdateCounter(SgObject* object) : count(0), action(0) {
+        object->sigUpdated().connect([this](const SgUpdate& update){ ++count; action |= update.action(); });
+    }
+    void reset() { count = 0; action = 0; }
+};
+
+void testUpdatesOfSiblings()
+{
+    SgGroupPtr root = new SgGroup;
+    SgGroup* group = new SgGroup;
+    root->addChild(group);
+    vector<SgPosTransformPtr> transforms;
+    for(int i=0; i < 10; ++i){
+        auto transform = new SgPosTransform;
+        transform->addChild(new SgShape);
+        group->addChild(transform);
+        transforms.push_back(transform);
+    }
+    root->boundingBox();
+    UpdateCounter rootCounter(root);
+
+    {
+        SgUpdateBatch batch;
+        for(int i=0; i < 3; ++i){
+            for(auto& transform : transforms){
+                transform->setTranslation(Vector3(i, 0.0, 0.0));
+                transform->notifyUpdate(SgUpdate::Modified | SgUpdate::GeometryModified);
+            }
+        }
+        check(rootCounter.count == 0, "The notifications are deferred in a batch");
+        check(!root->hasValidBoundingBoxCache(), "The bounding box cache is invalidated in a batch");
+    }
+    check(rootCounter.count == 1, "The root is notified once at the end of a batch");
+    check(rootCounter.action == (SgUpdate::Modified | SgUpdate::GeometryModified),
+          "The actions of the deferred notifications are merged");
+}
+
+/*
+  A node removed from its parent in a batch must not leave the pending actions in the former
+  upper nodes. Otherwise the accumulation of the following batches stops at those nodes and
+  the new upper nodes of them are never notified.
+*/
+void testUpdateOfRemovedNode()
+{
+    SgGroupPtr root = new SgGroup;
+    SgGroupPtr group = new SgGroup;
+    root->addChild(group);
+    SgPosTransformPtr removed = new SgPosTransform;
+    SgPosTransformPtr remaining = new SgPosTransform;
+    group->addChild(removed);
+    group->addChild(remaining);
+    UpdateCounter rootCounter(root);
+    UpdateCounter groupCounter(group);
+
+    {
+        SgUpdateBatch batch;
+        removed->notifyUpdate(SgUpdate::Modified);
+        group->removeChild(removed);
+    }
+    check(groupCounter.count == 1, "The former parent of a removed node is notified");
+    check(rootCounter.count == 1, "The former upper node of a removed node is notified");
+
+    // The group is moved to another root outside a batch
+    root->removeChild(group);
+    SgGroupPtr newRoot = new SgGroup;
+    newRoot->addChild(group);
+    UpdateCounter newRootCounter(newRoot);
+    groupCounter.reset();
+
+    {
+        SgUpdateBatch batch;
+        remaining->notifyUpdate(SgUpdate::Modified);
+    }
+    check(groupCounter.count == 1, "The parent of an updated node is notified");
+    check(newRootCounter.count == 1, "The new upper node of a moved group is notified");
+}
+
+}
+
+
+int main()
+{
+    testUpdatesOfSiblings();
+    testUpdateOfRemovedNode();
+
+    if(numFailures > 0){
+        cerr << numFailures << " check(s) failed." << endl;
+        return 1;
+    }
+    cout << "All the checks passed." << endl;
+    return 0;
+}